@@ -0,0 +1,77 @@
+#include "benchmark.h"
+
+#include <algorithm>
+#include <cmath>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+namespace {
+
+// Nearest-rank percentile of sorted samples, matching FrameTimings
+double percentile(const std::vector<double> &sorted, double p)
+{
+    size_t rank = static_cast<size_t>(std::ceil(p / 100.0 * sorted.size()));
+    return sorted[std::clamp<size_t>(rank, 1, sorted.size()) - 1];
+}
+
+}
+
+BenchmarkRunner::BenchmarkRunner(int minIterations, double minSeconds, const std::string &filter)
+    : m_minIterations(std::max(minIterations, 1)),
+      m_minSeconds(minSeconds),
+      m_filter(filter)
+{
+}
+
+void BenchmarkRunner::addResult(const std::string &name, const std::string &input, long long elements,
+                                std::vector<double> &samples)
+{
+    std::sort(samples.begin(), samples.end());
+
+    Result result;
+    result.name       = name;
+    result.input      = input;
+    result.elements   = elements;
+    result.iterations = samples.size();
+
+    double sum = 0;
+    for (double s : samples) sum += s;
+    result.meanMs = sum / samples.size();
+    double variance = 0;
+    for (double s : samples) variance += (s - result.meanMs) * (s - result.meanMs);
+    result.stddevMs = samples.size() > 1 ? std::sqrt(variance / (samples.size() - 1)) : 0;
+
+    result.minMs = samples.front();
+    result.p50Ms = percentile(samples, 50);
+    result.p90Ms = percentile(samples, 90);
+    result.p99Ms = percentile(samples, 99);
+    result.maxMs = samples.back();
+    m_results.push_back(result);
+
+    std::fprintf(stderr, "%-28s %-24s %8.4f ms +- %.4f (p99 %.4f, %d iterations)\n",
+                 name.c_str(), input.c_str(), result.meanMs, result.stddevMs, result.p99Ms, result.iterations);
+}
+
+void BenchmarkRunner::writeJson(FILE *file) const
+{
+#ifdef _OPENMP
+    int threads = omp_get_max_threads();
+#else
+    int threads = 1;
+#endif
+
+    std::fprintf(file, "{\n  \"threads\": %d,\n  \"benchmarks\": [", threads);
+    for (size_t i = 0; i < m_results.size(); i++) {
+        const Result &r = m_results[i];
+        double throughput = r.meanMs > 0 ? r.elements / (r.meanMs * 1e-3) : 0;
+        std::fprintf(file,
+                     "%s\n    {\"name\": \"%s\", \"input\": \"%s\", \"elements\": %lld, \"iterations\": %d, "
+                     "\"mean_ms\": %.6f, \"stddev_ms\": %.6f, \"min_ms\": %.6f, \"p50_ms\": %.6f, "
+                     "\"p90_ms\": %.6f, \"p99_ms\": %.6f, \"max_ms\": %.6f, \"elements_per_second\": %.1f}",
+                     i == 0 ? "" : ",", r.name.c_str(), r.input.c_str(), r.elements, r.iterations,
+                     r.meanMs, r.stddevMs, r.minMs, r.p50Ms, r.p90Ms, r.p99Ms, r.maxMs, throughput);
+    }
+    std::fprintf(file, "\n  ]\n}\n");
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// Minimal microbenchmark harness: runs a case until it has both enough iterations and enough total time,
+// then keeps summary statistics of the per-iteration times.
+class BenchmarkRunner
+{
+public:
+    struct Result {
+        std::string name;
+        std::string input;
+        long long   elements = 0; // Vertices, tets or faces processed per iteration, for throughput
+        int    iterations = 0;
+        double meanMs = 0;
+        double stddevMs = 0;
+        double minMs = 0;
+        double p50Ms = 0;
+        double p90Ms = 0;
+        double p99Ms = 0;
+        double maxMs = 0;
+    };
+
+    BenchmarkRunner(int minIterations, double minSeconds, const std::string &filter);
+
+    // Whether cases called `name` run, for skipping expensive setup
+    bool isSelected(const std::string &name) const { return m_filter.empty() || name.find(m_filter) != std::string::npos; }
+
+    // Times `body` (after one untimed warm-up call) if `name` matches the filter
+    template <typename Body>
+    void run(const std::string &name, const std::string &input, long long elements, Body &&body)
+    {
+        if (!isSelected(name)) return;
+
+        body();
+        std::vector<double> samples;
+        double total = 0;
+        while (static_cast<int>(samples.size()) < m_minIterations || total < m_minSeconds) {
+            auto start = std::chrono::steady_clock::now();
+            body();
+            double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            samples.push_back(seconds * 1e3);
+            total += seconds;
+            if (static_cast<int>(samples.size()) >= MAX_ITERATIONS) break;
+        }
+        addResult(name, input, elements, samples);
+    }
+
+    void writeJson(FILE *file) const;
+
+    const std::vector<Result> &getResults() const { return m_results; }
+
+private:
+    static const int MAX_ITERATIONS = 100000;
+
+    void addResult(const std::string &name, const std::string &input, long long elements, std::vector<double> &samples);
+
+    int         m_minIterations;
+    double      m_minSeconds;
+    std::string m_filter;
+    std::vector<Result> m_results;
+};
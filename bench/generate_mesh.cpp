@@ -0,0 +1,66 @@
+#include "graphics/meshgenerator.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+
+using namespace Eigen;
+
+// Writes a procedural tet mesh in the format read by MeshLoader::loadTetMesh.
+//
+// Usage: generate_mesh box|sphere|rod <resolution> <output.mesh> [--five] [--jitter 0.1] [--shuffle] [--seed 1]
+//   box     resolution^3 cubes in a unit cube
+//   sphere  resolution cubes across a unit-radius sphere
+//   rod     resolution cubes across a 0.25-radius rod of length 2
+// --jitter is a fraction of the cell size, below MAX_JITTER.
+
+namespace {
+
+const double MAX_JITTER = 0.2;
+
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 4) {
+        std::cerr << "Usage: " << argv[0] << " box|sphere|rod <resolution> <output.mesh>"
+                  << " [--five] [--jitter amount] [--shuffle] [--seed n]" << std::endl;
+        return 1;
+    }
+    std::string shape = argv[1];
+    int resolution = std::atoi(argv[2]);
+    std::string outputPath = argv[3];
+
+    MeshGenerator::Options options;
+    for (int i = 4; i < argc; i++) {
+        bool hasValue = i + 1 < argc;
+        if      (!std::strcmp(argv[i], "--five"))                options.split   = CubeSplit::Five;
+        else if (!std::strcmp(argv[i], "--shuffle"))             options.shuffle = true;
+        else if (!std::strcmp(argv[i], "--jitter") && hasValue) options.jitter  = std::atof(argv[++i]);
+        else if (!std::strcmp(argv[i], "--seed")   && hasValue) options.seed    = std::strtoull(argv[++i], nullptr, 10);
+        else {
+            std::cerr << "Unknown or incomplete option " << argv[i] << std::endl;
+            return 1;
+        }
+    }
+
+    // Beyond about a fifth of a cell, neighbouring vertices can cross and invert tets
+    if (options.jitter < 0 || options.jitter >= MAX_JITTER) {
+        std::cerr << "--jitter must be at least 0 and below " << MAX_JITTER << std::endl;
+        return 1;
+    }
+
+    std::vector<Vector3d> vertices;
+    std::vector<Vector4i> tets;
+    if      (shape == "box")    MeshGenerator::generateBox(resolution, resolution, resolution, Vector3d::Ones(), vertices, tets, options);
+    else if (shape == "sphere") MeshGenerator::generateSphere(resolution, 1, vertices, tets, options);
+    else if (shape == "rod")    MeshGenerator::generateRod(resolution, 2, 0.25, vertices, tets, options);
+    else {
+        std::cerr << "Unknown shape " << shape << std::endl;
+        return 1;
+    }
+
+    std::cout << shape << ": " << vertices.size() << " vertices, " << tets.size() << " tets" << std::endl;
+    return MeshGenerator::writeTetMesh(outputPath, vertices, tets) ? 0 : 1;
+}
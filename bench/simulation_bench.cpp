@@ -0,0 +1,693 @@
+#include "benchmark.h"
+
+#include "collision/colliders.h"
+#include "collision/signeddistancefield.h"
+#include "collision/spatialhash.h"
+#include "collision/trianglebvh.h"
+#include "fem/embeddedmesh.h"
+#include "fem/ensemble.h"
+#include "fem/femsolver.h"
+#include "fem/scene.h"
+#include "fem/surface.h"
+#include "graphics/flatnormals.h"
+#include "graphics/meshgenerator.h"
+#include "graphics/meshloader.h"
+#include "graphics/surfacelod.h"
+#include "io/animationcache.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace Eigen;
+
+// Runs the load, precompute, step and upload-preparation paths over the bundled example meshes and
+// generated boxes, and writes the timings as JSON.
+//
+// Usage: simulation_bench [--mesh-dir example-meshes] [--grid 8,16,32] [--shuffle] [--obstacles 16,256,4096]
+//                         [--timesteps 0.1,0.2,0.5,1,2,5] [--bodies 1,10,100] [--members 4,16,64]
+//                         [--render-vertices 100000,1000000] [--faces 1000000]
+//                         [--filter name]
+//                         [--output results.json]
+//                         [--min-iterations 10] [--min-time 0.5]
+//
+// Generated boxes are also written to the temporary directory so that loading can be timed at every size.
+// --shuffle randomly permutes their vertices and tets to measure the cost of poor memory locality.
+// --obstacles sets the sphere counts for the broadphase cases, which compare the spatial hash with testing every
+// vertex against every sphere.
+// --timesteps sets the step sizes for the tunneling cases, which drop a fast box onto a thin layer of spheres with
+// and without continuous collision, and report how many vertices end up through it.
+// --bodies sets the body counts for the multi-body cases, which step a stack of boxes in contact; time per tet
+// should follow the contacts per body, which grow slowly with the stack's weight, rather than the body count.
+// --members sets the ensemble sizes for the material sweep cases, which step every member of an ensemble either
+// concurrently (one member per thread), one after another (every thread on each member) or in lockstep batches.
+// The lockstep case also steps a drop onto the ground both ways, and the bench exits with 1 if the positions
+// differ by more than rounding.
+// --render-vertices sets the render mesh sizes for the embedding cases, which bind that many points to a coarse
+// box's tets and update them from its deformed vertices; update throughput is in render vertices.
+// --faces sets the surface sizes for the upload cases, which report the CPU time per frame that deriving flat
+// normals on the GPU saves.
+// --grid also sets the box sizes for the animation cache cases, which report how much smaller than raw doubles
+// the cache is, its error and its encode and decode throughput.
+
+namespace {
+
+const char *BUNDLED_MESHES[] = {"single-tet", "cube", "sphere", "ellipsoid", "cone"};
+
+// Small enough to stay stable for every input, so stepping can run for as long as the benchmark needs
+const double BENCH_TIMESTEP = 1e-4;
+
+struct BenchInput {
+    std::string name;
+    std::string path; // Empty if the mesh couldn't be written out for the load benchmark
+    std::vector<Vector3d> vertices;
+    std::vector<Vector4i> tets;
+};
+
+std::vector<int> parseList(const char *text)
+{
+    std::vector<int> values;
+    std::stringstream stream(text);
+    std::string item;
+    while (std::getline(stream, item, ',')) values.push_back(std::atoi(item.c_str()));
+    return values;
+}
+
+std::vector<double> parseDoubleList(const char *text)
+{
+    std::vector<double> values;
+    std::stringstream stream(text);
+    std::string item;
+    while (std::getline(stream, item, ',')) values.push_back(std::atof(item.c_str()));
+    return values;
+}
+
+void benchmarkInput(BenchmarkRunner &runner, const BenchInput &input)
+{
+    const long long numVertices = input.vertices.size();
+    const long long numTets     = input.tets.size();
+
+    if (!input.path.empty()) {
+        runner.run("load_tet_mesh", input.name, numTets, [&]() {
+            std::vector<Vector3d> vertices;
+            std::vector<Vector4i> tets;
+            MeshLoader::loadTetMesh(input.path, vertices, tets);
+        });
+    }
+
+    // Extracted (and the solver initialised) up front too, since the later cases need them even when these are
+    // filtered out
+    std::vector<Vector3i> faces;
+    extractSurface(input.vertices, input.tets, faces);
+    runner.run("extract_surface", input.name, numTets, [&]() {
+        extractSurface(input.vertices, input.tets, faces);
+    });
+
+    // Simplifying the surface into render levels of detail, per original surface triangle
+    SurfaceLod lod;
+    runner.run("surface_lod_build", input.name, faces.size(), [&]() {
+        lod.build(input.vertices, faces);
+    });
+
+    FemSolver solver;
+    solver.init(input.vertices, input.tets, Material());
+    runner.run("element_precompute", input.name, numTets, [&]() {
+        solver.init(input.vertices, input.tets, Material());
+    });
+
+    // Forces are evaluated on a fixed random deformation so that every element does real work
+    std::mt19937_64 rng(0);
+    std::uniform_real_distribution<double> noise(-0.01, 0.01);
+    std::vector<Vector3d> positions = input.vertices;
+    std::vector<Vector3d> velocities(numVertices);
+    for (size_t v = 0; v < positions.size(); v++) {
+        positions[v]  += Vector3d(noise(rng), noise(rng) + 1, noise(rng));
+        velocities[v]  = Vector3d(noise(rng), noise(rng), noise(rng));
+    }
+    std::vector<Vector3d> forces;
+
+    // Refitting to the deformed surface against rebuilding for it, and batched proximity queries over every
+    // vertex within a fiftieth of the mesh size
+    TriangleBvh bvh;
+    runner.run("bvh_build", input.name, faces.size(), [&]() {
+        bvh.build(positions, faces);
+    });
+    bvh.build(input.vertices, faces);
+    runner.run("bvh_refit", input.name, faces.size(), [&]() {
+        bvh.refit(positions);
+    });
+    AlignedBox3d bounds;
+    for (const Vector3d &v : input.vertices) bounds.extend(v);
+    std::vector<int> candidateStart, candidates;
+    runner.run("bvh_query_points", input.name, numVertices, [&]() {
+        bvh.queryPoints(positions, bounds.diagonal().norm() / 50, candidateStart, candidates);
+    });
+
+    // The surface as a static collider: sampling cost per vertex shouldn't grow with its triangle count
+    SignedDistanceField sdf;
+    const double voxelSize = bounds.sizes().maxCoeff() / 64;
+    runner.run("sdf_build", input.name, faces.size(), [&]() {
+        sdf.build(input.vertices, faces, voxelSize, 4 * voxelSize);
+    });
+    std::vector<double> distances(numVertices);
+    runner.run("sdf_sample", input.name, numVertices, [&]() {
+        #pragma omp parallel for schedule(static)
+        for (int v = 0; v < numVertices; v++) {
+            Vector3d normal;
+            if (!sdf.sample(input.vertices[v], distances[v], normal)) distances[v] = 0;
+        }
+    });
+
+    solver.setReduction(FemSolver::Reduction::Deterministic);
+    runner.run("forces_deterministic", input.name, numTets, [&]() {
+        solver.computeForces(positions, velocities, forces);
+    });
+    solver.setReduction(FemSolver::Reduction::Atomic);
+    runner.run("forces_atomic", input.name, numTets, [&]() {
+        solver.computeForces(positions, velocities, forces);
+    });
+
+    // Self-collision on top of the deterministic forces, with the time of each of its phases per evaluation
+    solver.setReduction(FemSolver::Reduction::Deterministic);
+    solver.setSelfCollision(true);
+    solver.resetTimings();
+    runner.run("forces_self_collision", input.name, numTets, [&]() {
+        solver.computeForces(positions, velocities, forces);
+    });
+    const SelfCollision::Timings &timings = solver.getSelfCollisionTimings();
+    if (timings.evaluations > 0) {
+        const double scale = 1e3 / timings.evaluations;
+        std::fprintf(stderr, "    bvh %.4f ms, broadphase %.4f ms, narrowphase %.4f ms, response %.4f ms; "
+                             "%lld candidates, %lld contacts per evaluation\n",
+                     scale * timings.bvhSeconds, scale * timings.broadphaseSeconds,
+                     scale * timings.narrowphaseSeconds, scale * timings.responseSeconds,
+                     timings.candidates / timings.evaluations, timings.contacts / timings.evaluations);
+    }
+    solver.setSelfCollision(false);
+
+    runner.run("step_explicit_midpoint", input.name, numTets, [&]() {
+        solver.step(positions, velocities, BENCH_TIMESTEP);
+    });
+    solver.setContinuousCollision(true);
+    runner.run("step_explicit_midpoint_ccd", input.name, numTets, [&]() {
+        solver.step(positions, velocities, BENCH_TIMESTEP);
+    });
+    solver.setContinuousCollision(false);
+
+    // Implicit Euler: assembling into the cached CSR pattern against rebuilding it from triplets, then a whole
+    // step with the cached assembly
+    solver.setIntegrator(FemSolver::Integrator::ImplicitEuler);
+    solver.assembleSystem(positions, velocities, BENCH_TIMESTEP);
+    solver.setAssembly(FemSolver::Assembly::Triplets);
+    runner.run("assembly_triplets", input.name, numTets, [&]() {
+        solver.assembleSystem(positions, velocities, BENCH_TIMESTEP);
+    });
+    solver.setAssembly(FemSolver::Assembly::Cached);
+    runner.run("assembly_cached", input.name, numTets, [&]() {
+        solver.assembleSystem(positions, velocities, BENCH_TIMESTEP);
+    });
+    solver.resetTimings();
+    runner.run("step_implicit_euler", input.name, numTets, [&]() {
+        solver.step(positions, velocities, BENCH_TIMESTEP);
+    });
+    if (solver.getForceEvaluations() > 0) {
+        const double steps = solver.getForceEvaluations();
+        std::fprintf(stderr, "    assembly %.4f ms, linear solve %.4f ms (%.1f iterations), %d colours per step, "
+                             "%d explicit fallbacks\n",
+                     1e3 * solver.getAssemblySeconds() / steps, 1e3 * solver.getLinearSolveSeconds() / steps,
+                     solver.getLinearSolveIterations() / steps, solver.getSystem().getColorCount(),
+                     solver.getImplicitFallbacks());
+    }
+    solver.setIntegrator(FemSolver::Integrator::Midpoint);
+
+    // The CPU half of Shape::setVertices when normals aren't derived on the GPU
+    std::vector<float> vertexData(faces.size() * 18);
+    runner.run("flat_normals", input.name, faces.size(), [&]() {
+        writeFlatShadedVertices(positions, faces, vertexData.data());
+    });
+}
+
+// The per-frame CPU work of uploading a `count`-face surface with flat normals written on the CPU, against the
+// positions alone that the GPU-normals path writes; the difference is what deriving normals in the fragment
+// shader saves every frame. The surface is a wavy height field, two faces per grid square.
+void benchmarkFlatNormals(BenchmarkRunner &runner, int count)
+{
+    const int n = std::max(1, static_cast<int>(std::lround(std::sqrt(count / 2.0))));
+    std::vector<Vector3d> vertices;
+    std::vector<Vector3i> faces;
+    for (int j = 0; j <= n; j++) {
+        for (int i = 0; i <= n; i++) {
+            double x = static_cast<double>(i) / n, z = static_cast<double>(j) / n;
+            vertices.emplace_back(x, 0.05 * std::sin(20 * x) * std::cos(20 * z), z);
+        }
+    }
+    for (int j = 0; j < n; j++) {
+        for (int i = 0; i < n; i++) {
+            int a = j * (n + 1) + i, b = a + 1, c = a + n + 1, d = c + 1;
+            faces.emplace_back(a, c, b);
+            faces.emplace_back(b, c, d);
+        }
+    }
+    const std::string input = "faces_" + std::to_string(faces.size());
+
+    std::vector<float> vertexData(faces.size() * 18);
+    runner.run("upload_flat_normals", input, faces.size(), [&]() {
+        writeFlatShadedVertices(vertices, faces, vertexData.data());
+    });
+    runner.run("upload_positions", input, faces.size(), [&]() {
+        float *dst = vertexData.data();
+        for (const Vector3d &v : vertices) dst = writeVec3(dst, v);
+    });
+    if (!runner.isSelected("upload_flat_normals") || !runner.isSelected("upload_positions")) return;
+    const std::vector<BenchmarkRunner::Result> &results = runner.getResults();
+    const double cpuMs = results[results.size() - 2].meanMs;
+    const double gpuMs = results.back().meanMs;
+    std::fprintf(stderr, "    GPU normals save %.3f ms of CPU time per frame (%.3f ms -> %.3f ms)\n",
+                 cpuMs - gpuMs, cpuMs, gpuMs);
+}
+
+// Vertices of a 16^3 box against `count` random spheres filling about a fifth of the same unit cube
+void benchmarkBroadphase(BenchmarkRunner &runner, int count)
+{
+    std::vector<Vector3d> points;
+    std::vector<Vector4i> tets;
+    MeshGenerator::generateBox(16, 16, 16, Vector3d::Ones(), points, tets);
+    const int numPoints = points.size();
+
+    std::mt19937_64 rng(count);
+    std::uniform_real_distribution<double> position(0, 1);
+    const double radius = std::cbrt(0.2 / count * 3 / (4 * M_PI));
+    std::vector<SphereCollider> spheres(count);
+    std::vector<AlignedBox3d> bounds(count);
+    for (int s = 0; s < count; s++) {
+        spheres[s].centre = Vector3d(position(rng), position(rng), position(rng));
+        spheres[s].radius = radius;
+        bounds[s] = spheres[s].getBounds();
+    }
+    const std::string input = "spheres_" + std::to_string(count);
+
+    SpatialHash hash;
+    runner.run("broadphase_build", input, count, [&]() {
+        hash.build(bounds);
+    });
+
+    std::vector<int> contacts(numPoints);
+    auto isInside = [&](int p, int s) {
+        return (points[p] - spheres[s].centre).squaredNorm() < spheres[s].radius * spheres[s].radius;
+    };
+    runner.run("broadphase_query", input, numPoints, [&]() {
+        #pragma omp parallel for schedule(static)
+        for (int p = 0; p < numPoints; p++) {
+            int n = 0;
+            hash.query(points[p], 0, [&](int s) { n += isInside(p, s); });
+            contacts[p] = n;
+        }
+    });
+    runner.run("brute_force_query", input, numPoints, [&]() {
+        #pragma omp parallel for schedule(static)
+        for (int p = 0; p < numPoints; p++) {
+            int n = 0;
+            for (int s = 0; s < count; s++) n += isInside(p, s);
+            contacts[p] = n;
+        }
+    });
+}
+
+// A 0.2 m box thrown down at 10 m/s onto a single layer of 2 cm spheres at y = 0.5, simulated for 0.2 s with
+// steps of `milliseconds`. Every drop is timed as a whole; the vertices that end up below the layer are reported.
+void benchmarkTunneling(BenchmarkRunner &runner, double milliseconds)
+{
+    std::vector<Vector3d> rest;
+    std::vector<Vector4i> tets;
+    MeshGenerator::generateBox(4, 4, 4, Vector3d::Constant(0.2), rest, tets);
+    for (Vector3d &v : rest) v += Vector3d(-0.1, 0.8, -0.1);
+
+    std::vector<SphereCollider> spheres;
+    // Spaced by their radius, so that the layer has no holes
+    for (int i = 0; i < 40; i++) {
+        for (int j = 0; j < 40; j++) {
+            SphereCollider sphere;
+            sphere.centre = Vector3d(-0.39 + 0.02 * i, 0.5, -0.39 + 0.02 * j);
+            sphere.radius = 0.02;
+            spheres.push_back(sphere);
+        }
+    }
+
+    const double dt = milliseconds * 1e-3;
+    const int steps = std::lround(0.2 / dt);
+    char input[32];
+    std::snprintf(input, sizeof(input), "dt_%gms", milliseconds);
+
+    for (bool ccd : {false, true}) {
+        const char *name = ccd ? "drop_ccd" : "drop_penalty";
+        if (!runner.isSelected(name)) continue;
+        int tunneled = 0;
+        runner.run(name, input, steps, [&]() {
+            FemSolver solver;
+            solver.init(rest, tets, Material());
+            solver.setSphereColliders(spheres);
+            solver.setContinuousCollision(ccd);
+            std::vector<Vector3d> positions = rest;
+            std::vector<Vector3d> velocities(rest.size(), Vector3d(0, -10, 0));
+            for (int s = 0; s < steps; s++) {
+                solver.step(positions, velocities, dt);
+            }
+            tunneled = 0;
+            for (const Vector3d &p : positions) tunneled += p.y() < 0.5;
+        });
+        std::fprintf(stderr, "    %d of %zu vertices tunneled\n", tunneled, rest.size());
+    }
+}
+
+// `count` 4^3-cube boxes of 0.2 m, stacked four to a layer with 1 cm gaps, dropped onto each other and settled
+// for 0.15 s before single steps are timed, so that from two bodies up every step has contacts between bodies to
+// resolve; with the narrow footprint, the count only changes the stack's height
+void benchmarkMultiBody(BenchmarkRunner &runner, int count)
+{
+    std::vector<Vector3d> vertices;
+    std::vector<Vector4i> tets;
+    MeshGenerator::generateBox(4, 4, 4, Vector3d::Constant(0.2), vertices, tets);
+
+    Scene scene;
+    for (int b = 0; b < count; b++) {
+        int i = b % 2, k = (b / 2) % 2, layer = b / 4;
+        scene.addBody(vertices, tets, Material(), Affine3d(Translation3d(0.21 * i, 0.01 + 0.21 * layer, 0.21 * k)));
+    }
+    const std::string input = "bodies_" + std::to_string(count);
+    const double dt = 1e-3;
+
+    FemSolver solver;
+    std::vector<Vector3d> positions = scene.getRestPositions();
+    std::vector<Vector3d> velocities(positions.size(), Vector3d::Zero());
+    runner.run("multibody_init", input, scene.getTetCount(), [&]() {
+        solver.init(scene);
+    });
+    if (!runner.isSelected("multibody_step")) return;
+    solver.init(scene);
+    for (int s = 0; s < 150; s++) solver.step(positions, velocities, dt);
+
+    solver.resetTimings();
+    runner.run("multibody_step", input, scene.getTetCount(), [&]() {
+        solver.step(positions, velocities, dt);
+    });
+    const SelfCollision::Timings &timings = solver.getSelfCollisionTimings();
+    if (timings.evaluations > 0) {
+        std::fprintf(stderr, "    %lld contacts and %.4f ms of contact per evaluation\n",
+                     timings.contacts / timings.evaluations,
+                     1e3 * (timings.bvhSeconds + timings.broadphaseSeconds + timings.narrowphaseSeconds +
+                            timings.responseSeconds) / timings.evaluations);
+    }
+}
+
+// `count` runs of one small box with Young's moduli spread over 1e4-5e4 Pa, each iteration advancing every
+// member by ENSEMBLE_STEPS; throughput is in member-steps. With the lockstep case selected, it also checks that
+// lockstep batches end a drop onto the ground where per-member solvers do, returning false if not.
+bool benchmarkEnsemble(BenchmarkRunner &runner, int count)
+{
+    const int ENSEMBLE_STEPS  = 20;
+    const int AGREEMENT_STEPS = 500; // Falls to the ground after about 250
+    const double AGREEMENT_TOLERANCE = 1e-9;
+    const double dt = 1e-3;
+
+    std::vector<Vector3d> vertices;
+    std::vector<Vector4i> tets;
+    MeshGenerator::generateBox(4, 4, 4, Vector3d::Constant(0.2), vertices, tets);
+    Scene scene;
+    scene.addBody(vertices, tets, Material(), Affine3d(Translation3d(0, 0.3, 0)));
+
+    std::vector<std::vector<Material>> runs(count, std::vector<Material>(1));
+    for (int m = 0; m < count; m++) {
+        runs[m][0].youngsModulus = 1e4 + 4e4 * m / std::max(count - 1, 1);
+    }
+    const std::string input = "members_" + std::to_string(count);
+
+    Ensemble ensemble;
+    ensemble.init(scene, runs);
+    const std::pair<Ensemble::Schedule, const char *> schedules[] = {
+        {Ensemble::Schedule::Lockstep,   "ensemble_lockstep"},
+        {Ensemble::Schedule::Concurrent, "ensemble_concurrent"},
+        {Ensemble::Schedule::Sequential, "ensemble_sequential"},
+    };
+    for (const auto &[schedule, name] : schedules) {
+        ensemble.reset();
+        runner.run(name, input, static_cast<long long>(count) * ENSEMBLE_STEPS, [&]() {
+            ensemble.run(ENSEMBLE_STEPS, dt, schedule);
+        });
+    }
+    if (!runner.isSelected("ensemble_lockstep")) return true;
+
+    ensemble.reset();
+    ensemble.run(AGREEMENT_STEPS, dt, Ensemble::Schedule::Lockstep);
+    std::vector<std::vector<Vector3d>> lockstep(count);
+    for (int m = 0; m < count; m++) lockstep[m] = ensemble.getPositions(m);
+    ensemble.reset();
+    ensemble.run(AGREEMENT_STEPS, dt, Ensemble::Schedule::Concurrent);
+    double difference = 0;
+    for (int m = 0; m < count; m++) {
+        const std::vector<Vector3d> &positions = ensemble.getPositions(m);
+        for (size_t v = 0; v < positions.size(); v++) {
+            difference = std::max(difference, (positions[v] - lockstep[m][v]).cwiseAbs().maxCoeff());
+        }
+    }
+    // NaN from a blown-up member fails the comparison too
+    const bool agree = difference <= AGREEMENT_TOLERANCE;
+    std::cerr << "    " << input << ": lockstep and per-member positions differ by up to " << difference
+              << " m after " << AGREEMENT_STEPS << " steps" << (agree ? "" : ", more than allowed") << std::endl;
+    return agree;
+}
+
+// `count` points spread through a slightly inflated 16^3-cube box, some just outside it as a render surface's
+// would be, embedded in its tets and updated from a random deformation of it. The points are sorted by coarse
+// cell, as a real mesh's vertices are mostly near their neighbours in the file. The update case places the box
+// last of SCENE_BODIES in the scene's shared vertex array, as Simulation does, so it pays only for its own body.
+void benchmarkEmbedding(BenchmarkRunner &runner, int count)
+{
+    const int GRID = 16;
+    const int SCENE_BODIES = 8;
+    std::vector<Vector3d> vertices;
+    std::vector<Vector4i> tets;
+    MeshGenerator::generateBox(GRID, GRID, GRID, Vector3d::Ones(), vertices, tets);
+
+    std::mt19937_64 rng(0);
+    std::uniform_real_distribution<double> inflated(-0.01, 1.01);
+    std::vector<Vector3d> points(count);
+    for (Vector3d &point : points) point = Vector3d(inflated(rng), inflated(rng), inflated(rng));
+    auto cellOf = [&](const Vector3d &point) {
+        Vector3i cell = (point * GRID).array().floor().cast<int>().cwiseMax(0).cwiseMin(GRID - 1);
+        return (cell.z() * GRID + cell.y()) * GRID + cell.x();
+    };
+    std::sort(points.begin(), points.end(), [&](const Vector3d &a, const Vector3d &b) { return cellOf(a) < cellOf(b); });
+
+    std::uniform_real_distribution<double> noise(-0.01, 0.01);
+    std::vector<Vector3d> positions = vertices;
+    for (Vector3d &p : positions) p += Vector3d(noise(rng), noise(rng) + 1, noise(rng));
+
+    const std::string input = "render_" + std::to_string(count);
+    EmbeddedMesh embedding;
+    runner.run("embedding_bind", input, count, [&]() {
+        embedding.bind(vertices, tets, points);
+    });
+    if (!runner.isSelected("embedding_update")) return;
+    const int offset = (SCENE_BODIES - 1) * vertices.size();
+    std::vector<Vector3d> sceneRest(offset, Vector3d::Zero()), scenePositions(offset, Vector3d::Zero());
+    sceneRest.insert(sceneRest.end(), vertices.begin(), vertices.end());
+    scenePositions.insert(scenePositions.end(), positions.begin(), positions.end());
+    std::vector<Vector4i> bodyTets = tets;
+    for (Vector4i &tet : bodyTets) tet.array() += offset;
+    embedding.bind(sceneRest, bodyTets, points);
+    std::vector<Vector3d> rendered;
+    runner.run("embedding_update", input, count, [&]() {
+        embedding.update(scenePositions, rendered);
+    });
+    std::fprintf(stderr, "    %d of %d render vertices outside their tet\n", embedding.getOutsideCount(), count);
+}
+
+// CACHE_FRAMES frames, 10 ms apart, of an n^3-cube box of 0.5 m dropped 0.2 m onto the ground, written to and
+// read back from an animation cache in the temporary directory; throughput is in vertex-frames
+void benchmarkAnimationCache(BenchmarkRunner &runner, int n)
+{
+    const int CACHE_FRAMES = 120;
+    const int STEPS_PER_FRAME = 10;
+    const double dt = 1e-3;
+    if (!runner.isSelected("cache_encode") && !runner.isSelected("cache_decode")) return;
+
+    std::vector<Vector3d> vertices;
+    std::vector<Vector4i> tets;
+    MeshGenerator::generateBox(n, n, n, Vector3d::Constant(0.5), vertices, tets);
+    std::vector<Vector3i> faces;
+    extractSurface(vertices, tets, faces);
+
+    FemSolver solver;
+    solver.init(vertices, tets, Material());
+    std::vector<Vector3d> positions = vertices;
+    for (Vector3d &p : positions) p.y() += 0.2;
+    std::vector<Vector3d> velocities(positions.size(), Vector3d::Zero());
+    std::vector<std::vector<Vector3d>> frames(CACHE_FRAMES);
+    for (auto &frame : frames) {
+        for (int s = 0; s < STEPS_PER_FRAME; s++) solver.step(positions, velocities, dt);
+        frame = positions;
+    }
+
+    const std::string input = "box_" + std::to_string(n);
+    const std::string path = (std::filesystem::temp_directory_path() / (input + ".femcache")).string();
+    const long long vertexFrames = static_cast<long long>(CACHE_FRAMES) * positions.size();
+    auto encode = [&]() {
+        AnimationCacheWriter writer;
+        writer.open(path, tets, faces, positions.size());
+        for (int f = 0; f < CACHE_FRAMES; f++) writer.writeFrame(frames[f], f * STEPS_PER_FRAME * dt);
+        writer.close();
+    };
+    // Written once up front so that decoding has a file even when encoding is filtered out
+    encode();
+    runner.run("cache_encode", input, vertexFrames, encode);
+    const double cachedBytes = std::filesystem::file_size(path);
+
+    AnimationCacheReader reader;
+    if (!reader.open(path)) {
+        std::cerr << "Failed to read back " << path << std::endl;
+        return;
+    }
+    std::vector<Vector3d> decoded;
+    double maxError = 0;
+    for (int f = 0; f < CACHE_FRAMES; f++) {
+        reader.readFrame(f, decoded);
+        for (size_t v = 0; v < decoded.size(); v++) {
+            maxError = std::max(maxError, (decoded[v] - frames[f][v]).cwiseAbs().maxCoeff());
+        }
+    }
+    runner.run("cache_decode", input, vertexFrames, [&]() {
+        for (int f = 0; f < CACHE_FRAMES; f++) reader.readFrame(f, decoded);
+    });
+
+    // Compared against dumping double positions every frame, as the interactive toggle reports
+    const double rawBytes = static_cast<double>(vertexFrames) * 3 * sizeof(double);
+    std::fprintf(stderr, "    %.2f MB cached, %.1fx smaller than raw doubles, max error %.2g m\n",
+                 cachedBytes / 1e6, rawBytes / cachedBytes, maxError);
+    for (const BenchmarkRunner::Result &result : runner.getResults()) {
+        if (result.input != input || (result.name != "cache_encode" && result.name != "cache_decode")) continue;
+        std::fprintf(stderr, "    %s at %.0f MB/s of raw doubles\n", result.name.c_str(),
+                     rawBytes / std::max(result.meanMs, 1e-9) / 1e3);
+    }
+}
+
+}
+
+int main(int argc, char *argv[])
+{
+    std::string meshDir = "example-meshes";
+    std::string filter;
+    std::string outputPath;
+    std::vector<int> grids = {8, 16, 32};
+    std::vector<int> obstacleCounts = {16, 256, 4096};
+    std::vector<double> timesteps = {0.1, 0.2, 0.5, 1, 2, 5};
+    std::vector<int> bodyCounts = {1, 10, 100};
+    std::vector<int> memberCounts = {4, 16, 64};
+    std::vector<int> renderVertexCounts = {100000, 1000000};
+    std::vector<int> faceCounts = {1000000};
+    MeshGenerator::Options generatorOptions;
+    int minIterations = 10;
+    double minSeconds = 0.5;
+
+    for (int i = 1; i < argc; i++) {
+        bool hasValue = i + 1 < argc;
+        if      (!std::strcmp(argv[i], "--mesh-dir")       && hasValue) meshDir       = argv[++i];
+        else if (!std::strcmp(argv[i], "--grid")           && hasValue) grids         = parseList(argv[++i]);
+        else if (!std::strcmp(argv[i], "--shuffle"))                    generatorOptions.shuffle = true;
+        else if (!std::strcmp(argv[i], "--obstacles")      && hasValue) obstacleCounts = parseList(argv[++i]);
+        else if (!std::strcmp(argv[i], "--timesteps")      && hasValue) timesteps = parseDoubleList(argv[++i]);
+        else if (!std::strcmp(argv[i], "--bodies")         && hasValue) bodyCounts = parseList(argv[++i]);
+        else if (!std::strcmp(argv[i], "--members")        && hasValue) memberCounts = parseList(argv[++i]);
+        else if (!std::strcmp(argv[i], "--render-vertices") && hasValue) renderVertexCounts = parseList(argv[++i]);
+        else if (!std::strcmp(argv[i], "--faces")          && hasValue) faceCounts    = parseList(argv[++i]);
+        else if (!std::strcmp(argv[i], "--filter")         && hasValue) filter        = argv[++i];
+        else if (!std::strcmp(argv[i], "--output")         && hasValue) outputPath    = argv[++i];
+        else if (!std::strcmp(argv[i], "--min-iterations") && hasValue) minIterations = std::atoi(argv[++i]);
+        else if (!std::strcmp(argv[i], "--min-time")       && hasValue) minSeconds    = std::atof(argv[++i]);
+        else {
+            std::cerr << "Unknown or incomplete option " << argv[i] << std::endl;
+            return 1;
+        }
+    }
+
+    std::vector<BenchInput> inputs;
+    for (const char *name : BUNDLED_MESHES) {
+        BenchInput input;
+        input.name = name;
+        input.path = meshDir + "/" + name + ".mesh";
+        if (!MeshLoader::loadTetMesh(input.path, input.vertices, input.tets) || input.tets.empty()) {
+            std::cerr << "Skipping " << input.path << std::endl;
+            continue;
+        }
+        inputs.push_back(std::move(input));
+    }
+    for (int n : grids) {
+        BenchInput input;
+        input.name = "box_" + std::to_string(n);
+        MeshGenerator::generateBox(n, n, n, Vector3d::Ones(), input.vertices, input.tets, generatorOptions);
+        std::string path = (std::filesystem::temp_directory_path() / (input.name + ".mesh")).string();
+        if (MeshGenerator::writeTetMesh(path, input.vertices, input.tets)) {
+            // The load case times what was written, so it has to read back as the same mesh
+            std::vector<Vector3d> vertices;
+            std::vector<Vector4i> tets;
+            MeshLoader::loadTetMesh(path, vertices, tets);
+            double error = 0;
+            for (size_t v = 0; v < std::min(vertices.size(), input.vertices.size()); v++) {
+                error = std::max(error, (vertices[v] - input.vertices[v]).cwiseAbs().maxCoeff());
+            }
+            if (vertices.size() != input.vertices.size() || tets != input.tets || error > 1e-8) {
+                std::cerr << path << " reads back as " << vertices.size() << " vertices and " << tets.size()
+                          << " tets, off by up to " << error << ", not the mesh written" << std::endl;
+            } else {
+                input.path = path;
+            }
+        }
+        inputs.push_back(std::move(input));
+    }
+
+    BenchmarkRunner runner(minIterations, minSeconds, filter);
+    for (const BenchInput &input : inputs) {
+        benchmarkInput(runner, input);
+    }
+    for (int count : obstacleCounts) {
+        benchmarkBroadphase(runner, count);
+    }
+    for (double milliseconds : timesteps) {
+        benchmarkTunneling(runner, milliseconds);
+    }
+    for (int count : bodyCounts) {
+        benchmarkMultiBody(runner, count);
+    }
+    bool agreed = true;
+    for (int count : memberCounts) {
+        agreed = benchmarkEnsemble(runner, count) && agreed;
+    }
+    for (int count : renderVertexCounts) {
+        benchmarkEmbedding(runner, count);
+    }
+    for (int count : faceCounts) {
+        benchmarkFlatNormals(runner, count);
+    }
+    for (int n : grids) {
+        benchmarkAnimationCache(runner, n);
+    }
+
+    if (outputPath.empty()) {
+        runner.writeJson(stdout);
+    } else {
+        FILE *file = std::fopen(outputPath.c_str(), "w");
+        if (file == nullptr) {
+            std::cerr << "Error opening file: " << outputPath << std::endl;
+            return 1;
+        }
+        runner.writeJson(file);
+        std::fclose(file);
+    }
+    return agreed ? 0 : 1;
+}
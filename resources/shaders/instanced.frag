@@ -0,0 +1,16 @@
+#version 330 core
+out vec4 fragColor;
+
+in vec4 position_worldSpace;
+in vec4 color;
+
+void main() {
+    // Flat face normal from the screen-space derivatives of the interpolated position
+    vec4 normal = vec4(normalize(cross(dFdx(position_worldSpace.xyz), dFdy(position_worldSpace.xyz))), 0);
+
+    vec4 lightPos   = vec4(-2.0, 2.0, -3.0 , 1.0);
+    vec4 lightDir   = normalize(-lightPos + position_worldSpace);
+    float c = clamp(dot(-normal, lightDir), 0, 1);
+
+    fragColor = vec4(color.rgb * c, 1);
+}
@@ -0,0 +1,28 @@
+#version 330 core
+
+// Per-instance attributes (see MultiBodyRenderer)
+layout(location = 2) in mat4 instanceModel; // Takes locations 2-5
+layout(location = 6) in vec4 instanceColor;
+
+// Shared by every program, written once per frame
+layout(std140) uniform Camera {
+    mat4 proj;
+    mat4 view;
+};
+
+// Positions of every body, packed back to back
+uniform samplerBuffer positions;
+uniform int regionBase;
+uniform int verticesPerBody;
+
+out vec4 position_worldSpace;
+out vec4 color;
+
+void main() {
+    vec3 position = texelFetch(positions, regionBase + gl_InstanceID * verticesPerBody + gl_VertexID).xyz;
+
+    position_worldSpace = instanceModel * vec4(position, 1.0);
+    color = instanceColor;
+
+    gl_Position = proj * view * position_worldSpace;
+}
@@ -5,21 +5,31 @@ out vec4 fragColor;
 in vec4 normal_worldSpace;
 in vec4 position_worldSpace;
 
-uniform int wire = 0;
-uniform float red = 1.0;
-uniform float green = 1.0;
-uniform float blue = 1.0;
-uniform float alpha = 1.0;
+// Written by each shape when its transform or draw mode changes
+layout(std140) uniform Object {
+    mat4 model;
+    mat3 inverseTransposeModel;
+    vec4 color;
+    int  wire;
+    int  gpuNormals;
+};
 
 void main() {
     if (wire == 1) {
         fragColor = vec4(0.0, 0.0, 0.0, 1);
         return;
     }
+
+    // Flat face normal from the screen-space derivatives of the interpolated position
+    vec4 normal = normal_worldSpace;
+    if (gpuNormals == 1) {
+        normal = vec4(normalize(cross(dFdx(position_worldSpace.xyz), dFdy(position_worldSpace.xyz))), 0);
+    }
+
     vec4 lightPos   = vec4(-2.0, 2.0, -3.0 , 1.0);
-    vec3 lightColor = vec3(1.0f, alpha, 0.0f);
+    vec3 lightColor = vec3(1.0f, color.a, 0.0f);
     vec4 lightDir   = normalize(-lightPos + position_worldSpace);
-    float c = clamp(dot(-normal_worldSpace, lightDir), 0, 1);
+    float c = clamp(dot(-normal, lightDir), 0, 1);
 
-    fragColor = vec4(red * c * lightColor[0], green * c * lightColor[0], blue * c * lightColor[0], 1);
+    fragColor = vec4(color.r * c * lightColor[0], color.g * c * lightColor[0], color.b * c * lightColor[0], 1);
 }
@@ -1,20 +1,29 @@
 #version 330 core
 
 layout(location = 0) in vec3 position; // Position of the vertex
-layout(location = 1) in vec3 normal;   // Normal of the vertex
+layout(location = 1) in vec3 normal;   // Normal of the vertex (unused when gpuNormals is set)
 
-uniform mat4 proj;
-uniform mat4 view;
-uniform mat4 model;
+// Shared by every program, written once per frame
+layout(std140) uniform Camera {
+    mat4 proj;
+    mat4 view;
+};
 
-uniform mat3 inverseTransposeModel;
+// Written by each shape when its transform or draw mode changes
+layout(std140) uniform Object {
+    mat4 model;
+    mat3 inverseTransposeModel;
+    vec4 color;
+    int  wire;
+    int  gpuNormals;
+};
 
 out vec4 normal_worldSpace;
 out vec4 position_worldSpace;
 
 void main() {
     normal_worldSpace   = vec4(normalize(inverseTransposeModel * normal), 0);
-    position_worldSpace = vec4(position, 1.0);
+    position_worldSpace = model * vec4(position, 1.0);
 
-    gl_Position = proj * view * model * vec4(position, 1.0);
+    gl_Position = proj * view * position_worldSpace;
 }
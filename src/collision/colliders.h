@@ -0,0 +1,16 @@
+#pragma once
+
+#include "Eigen/Dense"
+#include "Eigen/Geometry"
+
+// Static analytic obstacles, pushed against with the same penalty contact as the ground plane
+struct SphereCollider
+{
+    Eigen::Vector3d centre = Eigen::Vector3d::Zero();
+    double          radius = 1;
+
+    Eigen::AlignedBox3d getBounds() const
+    {
+        return Eigen::AlignedBox3d(centre.array() - radius, centre.array() + radius);
+    }
+};
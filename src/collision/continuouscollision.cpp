@@ -0,0 +1,191 @@
+#include "collision/continuouscollision.h"
+#include "collision/geometry.h"
+#include "collision/signeddistancefield.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace Eigen;
+
+namespace {
+
+double evaluateCubic(const double c[4], double t)
+{
+    return ((c[3] * t + c[2]) * t + c[1]) * t + c[0];
+}
+
+// Coefficients of det[e1(t), e2(t), e3(t)] for e_i(t) = u_i + t v_i, i.e. the signed volume of the moving
+// tetrahedron, which vanishes when its four points are coplanar
+void coplanarityCubic(const Vector3d &u1, const Vector3d &v1, const Vector3d &u2, const Vector3d &v2,
+                      const Vector3d &u3, const Vector3d &v3, double c[4])
+{
+    auto det = [](const Vector3d &a, const Vector3d &b, const Vector3d &d) { return a.cross(b).dot(d); };
+    c[0] = det(u1, u2, u3);
+    c[1] = det(v1, u2, u3) + det(u1, v2, u3) + det(u1, u2, v3);
+    c[2] = det(v1, v2, u3) + det(v1, u2, v3) + det(u1, v2, v3);
+    c[3] = det(v1, v2, v3);
+}
+
+}
+
+int cubicRootsInUnitInterval(const double coefficients[4], double roots[3])
+{
+    const double *c = coefficients;
+
+    // Split [0, 1] at the roots of the derivative 3 c3 t^2 + 2 c2 t + c1
+    double breaks[4] = {0};
+    int numBreaks = 1;
+    double a = 3 * c[3], b = 2 * c[2];
+    if (a != 0) {
+        double discriminant = b * b - 4 * a * c[1];
+        if (discriminant >= 0) {
+            // Numerically stable quadratic roots
+            double q = -0.5 * (b + std::copysign(std::sqrt(discriminant), b));
+            double r0 = q / a, r1 = q != 0 ? c[1] / q : r0;
+            if (r0 > r1) std::swap(r0, r1);
+            if (r0 > 0 && r0 < 1) breaks[numBreaks++] = r0;
+            if (r1 > 0 && r1 < 1 && r1 != r0) breaks[numBreaks++] = r1;
+        }
+    } else if (b != 0) {
+        double r = -c[1] / b;
+        if (r > 0 && r < 1) breaks[numBreaks++] = r;
+    }
+    breaks[numBreaks++] = 1;
+
+    int numRoots = 0;
+    auto addRoot = [&](double t) {
+        if (numRoots == 0 || t > roots[numRoots - 1]) roots[numRoots++] = t;
+    };
+    for (int i = 0; i + 1 < numBreaks; i++) {
+        double lo = breaks[i], hi = breaks[i + 1];
+        double fLo = evaluateCubic(c, lo), fHi = evaluateCubic(c, hi);
+        if (fLo == 0) { addRoot(lo); continue; }
+        if (fHi == 0) { if (i + 2 == numBreaks) addRoot(hi); continue; }
+        if ((fLo < 0) == (fHi < 0)) continue;
+
+        // Monotonic with a sign change: bisect until the interval stops shrinking
+        while (true) {
+            double mid = 0.5 * (lo + hi);
+            if (mid <= lo || mid >= hi) break;
+            double fMid = evaluateCubic(c, mid);
+            if (fMid == 0) { lo = hi = mid; break; }
+            if ((fMid < 0) == (fLo < 0)) { lo = mid; fLo = fMid; } else { hi = mid; }
+        }
+        addRoot(0.5 * (lo + hi));
+    }
+    return numRoots;
+}
+
+bool vertexPlaneImpact(const Eigen::Vector3d &x0, const Eigen::Vector3d &x1,
+                       const Eigen::Vector3d &normal, double offset, double &t)
+{
+    double d0 = normal.dot(x0) - offset;
+    double d1 = normal.dot(x1) - offset;
+    if (d0 < 0 || d1 >= 0) return false;
+    t = d0 / (d0 - d1);
+    return true;
+}
+
+bool vertexSphereImpact(const Eigen::Vector3d &x0, const Eigen::Vector3d &x1,
+                        const Eigen::Vector3d &centre, double radius, double &t)
+{
+    // |x0 + t d - centre|^2 = radius^2
+    Vector3d d = x1 - x0, m = x0 - centre;
+    double c = m.squaredNorm() - radius * radius;
+    if (c < 0) return false;
+    double a = d.squaredNorm(), b = m.dot(d);
+    if (a == 0 || b >= 0) return false;
+    double discriminant = b * b - a * c;
+    if (discriminant < 0) return false;
+    t = (-b - std::sqrt(discriminant)) / a;
+    return t <= 1;
+}
+
+bool vertexSdfImpact(const Eigen::Vector3d &x0, const Eigen::Vector3d &x1, const SignedDistanceField &sdf, double &t)
+{
+    const double length = (x1 - x0).norm();
+    if (length == 0) return false;
+
+    // Steps are never longer than the distance to the surface, which the field (or, outside it, the distance
+    // to its bounds) never overestimates by much
+    const AlignedBox3d bounds = sdf.getBounds();
+    const double minimumStep = 0.25 * sdf.getVoxelSize();
+    const double tolerance   = 1e-3 * sdf.getVoxelSize();
+    auto distanceAt = [&](double s) {
+        Vector3d point = x0 + s * (x1 - x0);
+        double distance;
+        Vector3d normal;
+        if (!sdf.sample(point, distance, normal)) distance = std::max(bounds.exteriorDistance(point), minimumStep);
+        return distance;
+    };
+
+    double outside = 0, s = 0;
+    while (true) {
+        double distance = distanceAt(s);
+        if (distance < tolerance) {
+            if (s == 0) return false;
+
+            // Minimum-length steps can overshoot the surface by up to a quarter voxel, so it is narrowed down
+            // between the last sample outside and this one
+            double inside = s;
+            while ((inside - outside) * length > tolerance) {
+                double middle = 0.5 * (outside + inside);
+                if (distanceAt(middle) < tolerance) {
+                    inside = middle;
+                } else {
+                    outside = middle;
+                }
+            }
+            t = outside;
+            return true;
+        }
+        if (s == 1) return false;
+        outside = s;
+        s = std::min(s + std::max(distance, minimumStep) / length, 1.0);
+    }
+}
+
+bool vertexTriangleImpact(const Eigen::Vector3d &p0, const Eigen::Vector3d &p1,
+                          const Eigen::Vector3d &a0, const Eigen::Vector3d &a1,
+                          const Eigen::Vector3d &b0, const Eigen::Vector3d &b1,
+                          const Eigen::Vector3d &c0, const Eigen::Vector3d &c1,
+                          double &t, double tolerance)
+{
+    double c[4], roots[3];
+    coplanarityCubic(b0 - a0, (b1 - a1) - (b0 - a0), c0 - a0, (c1 - a1) - (c0 - a0),
+                     p0 - a0, (p1 - a1) - (p0 - a0), c);
+    int numRoots = cubicRootsInUnitInterval(c, roots);
+    for (int i = 0; i < numRoots; i++) {
+        double s = roots[i];
+        Vector3d p = p0 + s * (p1 - p0);
+        TriangleFeature feature;
+        Vector3d closest = closestPointOnTriangle(p, a0 + s * (a1 - a0), b0 + s * (b1 - b0), c0 + s * (c1 - c0), feature);
+        if ((p - closest).squaredNorm() <= tolerance * tolerance) {
+            t = s;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool edgeEdgeImpact(const Eigen::Vector3d &p0, const Eigen::Vector3d &p1,
+                    const Eigen::Vector3d &q0, const Eigen::Vector3d &q1,
+                    const Eigen::Vector3d &r0, const Eigen::Vector3d &r1,
+                    const Eigen::Vector3d &s0, const Eigen::Vector3d &s1,
+                    double &t, double tolerance)
+{
+    double c[4], roots[3];
+    coplanarityCubic(q0 - p0, (q1 - p1) - (q0 - p0), r0 - p0, (r1 - p1) - (r0 - p0),
+                     s0 - p0, (s1 - p1) - (s0 - p0), c);
+    int numRoots = cubicRootsInUnitInterval(c, roots);
+    for (int i = 0; i < numRoots; i++) {
+        double u = roots[i], a, b;
+        double distanceSquared = segmentSegmentDistanceSquared(p0 + u * (p1 - p0), q0 + u * (q1 - q0),
+                                                               r0 + u * (r1 - r0), s0 + u * (s1 - s0), a, b);
+        if (distanceSquared <= tolerance * tolerance) {
+            t = u;
+            return true;
+        }
+    }
+    return false;
+}
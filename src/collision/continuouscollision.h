@@ -0,0 +1,40 @@
+#pragma once
+
+#include "Eigen/Dense"
+
+class SignedDistanceField;
+
+// Continuous collision detection: the earliest time of impact t in [0, 1] of primitives moving linearly
+// between their start-of-step (0) and end-of-step (1) positions. Each test returns false if there is no
+// impact within the step.
+//
+// The static obstacle tests only report entering the obstacle, so a vertex that starts the step inside
+// (resting in penalty contact) is left to the penalty forces. The deformable tests find the times at which
+// the four points become coplanar, as the roots of a cubic, and accept the first one at which the
+// primitives are actually within `tolerance` of each other.
+
+// Roots of c[0] + c[1] t + c[2] t^2 + c[3] t^3 in [0, 1], ascending. The interval is split at the critical
+// points so that each piece is monotonic, and every sign change is bisected to full double precision.
+int cubicRootsInUnitInterval(const double coefficients[4], double roots[3]);
+
+bool vertexPlaneImpact(const Eigen::Vector3d &x0, const Eigen::Vector3d &x1,
+                       const Eigen::Vector3d &normal, double offset, double &t);
+
+bool vertexSphereImpact(const Eigen::Vector3d &x0, const Eigen::Vector3d &x1,
+                        const Eigen::Vector3d &centre, double radius, double &t);
+
+// Sphere tracing along the segment, then bisection between the last sample outside the surface and the first
+// inside it; features thinner than about a voxel can be missed
+bool vertexSdfImpact(const Eigen::Vector3d &x0, const Eigen::Vector3d &x1, const SignedDistanceField &sdf, double &t);
+
+bool vertexTriangleImpact(const Eigen::Vector3d &p0, const Eigen::Vector3d &p1,
+                          const Eigen::Vector3d &a0, const Eigen::Vector3d &a1,
+                          const Eigen::Vector3d &b0, const Eigen::Vector3d &b1,
+                          const Eigen::Vector3d &c0, const Eigen::Vector3d &c1,
+                          double &t, double tolerance = 1e-6);
+
+bool edgeEdgeImpact(const Eigen::Vector3d &p0, const Eigen::Vector3d &p1,
+                    const Eigen::Vector3d &q0, const Eigen::Vector3d &q1,
+                    const Eigen::Vector3d &r0, const Eigen::Vector3d &r1,
+                    const Eigen::Vector3d &s0, const Eigen::Vector3d &s1,
+                    double &t, double tolerance = 1e-6);
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <algorithm>
+#include "Eigen/Dense"
+
+// Closest-point queries shared by the distance field and continuous collision detection
+
+// The closest feature of a triangle to a point: a vertex, an edge (opposite that vertex) or the face itself
+enum class TriangleFeature { Vertex0, Vertex1, Vertex2, Edge12, Edge20, Edge01, Face };
+
+// Ericson, Real-Time Collision Detection 5.1.5
+inline Eigen::Vector3d closestPointOnTriangle(const Eigen::Vector3d &p, const Eigen::Vector3d &a,
+                                              const Eigen::Vector3d &b, const Eigen::Vector3d &c,
+                                              TriangleFeature &feature)
+{
+    Eigen::Vector3d ab = b - a, ac = c - a, ap = p - a;
+    double d1 = ab.dot(ap), d2 = ac.dot(ap);
+    if (d1 <= 0 && d2 <= 0) { feature = TriangleFeature::Vertex0; return a; }
+
+    Eigen::Vector3d bp = p - b;
+    double d3 = ab.dot(bp), d4 = ac.dot(bp);
+    if (d3 >= 0 && d4 <= d3) { feature = TriangleFeature::Vertex1; return b; }
+
+    double vc = d1 * d4 - d3 * d2;
+    if (vc <= 0 && d1 >= 0 && d3 <= 0) { feature = TriangleFeature::Edge01; return a + d1 / (d1 - d3) * ab; }
+
+    Eigen::Vector3d cp = p - c;
+    double d5 = ab.dot(cp), d6 = ac.dot(cp);
+    if (d6 >= 0 && d5 <= d6) { feature = TriangleFeature::Vertex2; return c; }
+
+    double vb = d5 * d2 - d1 * d6;
+    if (vb <= 0 && d2 >= 0 && d6 <= 0) { feature = TriangleFeature::Edge20; return a + d2 / (d2 - d6) * ac; }
+
+    double va = d3 * d6 - d5 * d4;
+    if (va <= 0 && d4 - d3 >= 0 && d5 - d6 >= 0) {
+        feature = TriangleFeature::Edge12;
+        return b + (d4 - d3) / ((d4 - d3) + (d5 - d6)) * (c - b);
+    }
+
+    feature = TriangleFeature::Face;
+    double denominator = 1 / (va + vb + vc);
+    return a + ab * (vb * denominator) + ac * (vc * denominator);
+}
+
+// Barycentric weights of a point q in the plane of triangle abc
+inline Eigen::Vector3d barycentricCoordinates(const Eigen::Vector3d &q, const Eigen::Vector3d &a,
+                                              const Eigen::Vector3d &b, const Eigen::Vector3d &c)
+{
+    Eigen::Vector3d v0 = b - a, v1 = c - a, v2 = q - a;
+    double d00 = v0.dot(v0), d01 = v0.dot(v1), d11 = v1.dot(v1), d20 = v2.dot(v0), d21 = v2.dot(v1);
+    double denominator = d00 * d11 - d01 * d01;
+    if (denominator <= 0) return Eigen::Vector3d(1, 0, 0);
+    double v = (d11 * d20 - d01 * d21) / denominator;
+    double w = (d00 * d21 - d01 * d20) / denominator;
+    return Eigen::Vector3d(1 - v - w, v, w);
+}
+
+// Squared distance between segments p0-p1 and q0-q1, with the closest points at parameters s and t (Ericson 5.1.9)
+inline double segmentSegmentDistanceSquared(const Eigen::Vector3d &p0, const Eigen::Vector3d &p1,
+                                            const Eigen::Vector3d &q0, const Eigen::Vector3d &q1,
+                                            double &s, double &t)
+{
+    Eigen::Vector3d d1 = p1 - p0, d2 = q1 - q0, r = p0 - q0;
+    double a = d1.squaredNorm(), e = d2.squaredNorm(), f = d2.dot(r);
+    const double epsilon = 1e-30;
+
+    if (a <= epsilon && e <= epsilon) {
+        s = t = 0;
+    } else if (a <= epsilon) {
+        s = 0;
+        t = std::clamp(f / e, 0.0, 1.0);
+    } else {
+        double c = d1.dot(r);
+        if (e <= epsilon) {
+            t = 0;
+            s = std::clamp(-c / a, 0.0, 1.0);
+        } else {
+            double b = d1.dot(d2);
+            double denominator = a * e - b * b;
+            s = denominator > 0 ? std::clamp((b * f - c * e) / denominator, 0.0, 1.0) : 0;
+            t = (b * s + f) / e;
+            if (t < 0) {
+                t = 0;
+                s = std::clamp(-c / a, 0.0, 1.0);
+            } else if (t > 1) {
+                t = 1;
+                s = std::clamp((b - c) / a, 0.0, 1.0);
+            }
+        }
+    }
+    return (p0 + s * d1 - (q0 + t * d2)).squaredNorm();
+}
@@ -0,0 +1,397 @@
+#include "collision/selfcollision.h"
+#include "collision/continuouscollision.h"
+#include "collision/geometry.h"
+#include "profiling/profiler.h"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+
+using namespace Eigen;
+
+namespace {
+
+double secondsSince(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+}
+
+SelfCollision::SelfCollision()
+    : m_sameBodyContacts(true),
+      m_thickness(0),
+      m_contactAcceleration(1000)
+{
+}
+
+void SelfCollision::init(const std::vector<Eigen::Vector3i> &faces, const std::vector<Eigen::Vector3d> &positions,
+                         const std::vector<int> &vertexBodies)
+{
+    m_faces = faces;
+    m_vertexBodies = vertexBodies;
+    if (m_vertexBodies.empty()) m_vertexBodies.assign(positions.size(), 0);
+
+    std::vector<char> onSurface(positions.size(), 0);
+    double edgeLength = 0;
+    for (const Vector3i &face : faces) {
+        for (int i = 0; i < 3; i++) {
+            onSurface[face[i]] = 1;
+            edgeLength += (positions[face[(i + 1) % 3]] - positions[face[i]]).norm();
+        }
+    }
+    m_surfaceVertices.clear();
+    std::vector<int> surfaceIndex(positions.size(), -1);
+    for (size_t v = 0; v < positions.size(); v++) {
+        if (!onSurface[v]) continue;
+        surfaceIndex[v] = m_surfaceVertices.size();
+        m_surfaceVertices.push_back(v);
+    }
+
+    // One-ring CSR over the surface edges; every edge is seen from both of its faces, so duplicates are dropped
+    const int numSurface = m_surfaceVertices.size();
+    m_neighbourStart.assign(numSurface + 1, 0);
+    for (const Vector3i &face : faces) {
+        for (int i = 0; i < 3; i++) m_neighbourStart[surfaceIndex[face[i]] + 1] += 2;
+    }
+    for (int i = 0; i < numSurface; i++) m_neighbourStart[i + 1] += m_neighbourStart[i];
+    m_neighbours.resize(m_neighbourStart[numSurface]);
+    std::vector<int> next(m_neighbourStart.begin(), m_neighbourStart.end() - 1);
+    for (const Vector3i &face : faces) {
+        for (int i = 0; i < 3; i++) {
+            int &slot = next[surfaceIndex[face[i]]];
+            m_neighbours[slot++] = face[(i + 1) % 3];
+            m_neighbours[slot++] = face[(i + 2) % 3];
+        }
+    }
+    int compacted = 0;
+    for (int i = 0; i < numSurface; i++) {
+        auto begin = m_neighbours.begin() + m_neighbourStart[i], end = m_neighbours.begin() + m_neighbourStart[i + 1];
+        std::sort(begin, end);
+        end = std::unique(begin, end);
+        m_neighbourStart[i] = compacted;
+        for (auto it = begin; it != end; ++it) m_neighbours[compacted++] = *it;
+    }
+    m_neighbourStart[numSurface] = compacted;
+    m_neighbours.resize(compacted);
+
+    // Unique surface edges, from the faces' edges sorted by their end vertices; then each vertex's edges
+    std::vector<std::array<int, 4>> faceEdges; // Lower vertex, upper vertex, face, corner
+    faceEdges.reserve(faces.size() * 3);
+    for (size_t f = 0; f < faces.size(); f++) {
+        for (int k = 0; k < 3; k++) {
+            const int a = faces[f][k], b = faces[f][(k + 1) % 3];
+            faceEdges.push_back({std::min(a, b), std::max(a, b), static_cast<int>(f), k});
+        }
+    }
+    std::sort(faceEdges.begin(), faceEdges.end());
+    m_edges.clear();
+    m_faceEdges.resize(faces.size());
+    for (size_t h = 0; h < faceEdges.size(); h++) {
+        const auto &[a, b, f, k] = faceEdges[h];
+        if (h == 0 || a != faceEdges[h - 1][0] || b != faceEdges[h - 1][1]) m_edges.emplace_back(a, b);
+        m_faceEdges[f][k] = m_edges.size() - 1;
+    }
+    m_vertexEdgeStart.assign(numSurface + 1, 0);
+    for (const Vector2i &edge : m_edges) {
+        for (int k = 0; k < 2; k++) m_vertexEdgeStart[surfaceIndex[edge[k]] + 1]++;
+    }
+    for (int i = 0; i < numSurface; i++) m_vertexEdgeStart[i + 1] += m_vertexEdgeStart[i];
+    m_vertexEdges.resize(m_vertexEdgeStart[numSurface]);
+    next.assign(m_vertexEdgeStart.begin(), m_vertexEdgeStart.end() - 1);
+    for (size_t e = 0; e < m_edges.size(); e++) {
+        for (int k = 0; k < 2; k++) m_vertexEdges[next[surfaceIndex[m_edges[e][k]]]++] = e;
+    }
+    m_thickness = faces.empty() ? 0 : 0.25 * edgeLength / (3 * faces.size());
+
+    m_bvh.build(positions, faces);
+    m_contactCounts.assign(m_surfaceVertices.size(), 0);
+    m_cornerStart.assign(positions.size() + 1, 0);
+}
+
+bool SelfCollision::isSkipped(const Eigen::Vector3i &face, int surfaceIndex) const
+{
+    const int v = m_surfaceVertices[surfaceIndex];
+    if (!m_sameBodyContacts && m_vertexBodies[face[0]] == m_vertexBodies[v]) return true;
+    for (int k = 0; k < 3; k++) {
+        if (face[k] == v) return true;
+        for (int e = m_neighbourStart[surfaceIndex]; e < m_neighbourStart[surfaceIndex + 1]; e++) {
+            if (m_neighbours[e] == face[k]) return true;
+        }
+    }
+    return false;
+}
+
+void SelfCollision::addForces(const std::vector<Eigen::Vector3d> &positions,
+                              const std::vector<Eigen::Vector3d> &velocities,
+                              const std::vector<double>          &masses,
+                              std::vector<Eigen::Vector3d>       &forces)
+{
+    PROFILE_SCOPE("SelfCollision::addForces");
+    const int numSurface = m_surfaceVertices.size();
+    if (numSurface == 0) return;
+    m_timings.evaluations++;
+
+    auto start = std::chrono::steady_clock::now();
+    m_timings.rebuilds += m_bvh.update(positions);
+    m_timings.bvhSeconds += secondsSince(start);
+
+    start = std::chrono::steady_clock::now();
+    m_surfacePositions.resize(numSurface);
+    #pragma omp parallel for schedule(static)
+    for (int i = 0; i < numSurface; i++) {
+        m_surfacePositions[i] = positions[m_surfaceVertices[i]];
+    }
+    m_bvh.queryPoints(m_surfacePositions, m_thickness, m_candidateStart, m_candidates);
+    m_timings.candidates += m_candidates.size();
+    m_timings.broadphaseSeconds += secondsSince(start);
+
+    // Each vertex compacts its contacts into the front of its own candidate slots
+    start = std::chrono::steady_clock::now();
+    m_contactWeights.resize(m_candidates.size());
+    m_contactForces.resize(m_candidates.size());
+    const double stiffness = m_contactAcceleration / m_thickness;
+    const double damping   = 2 * std::sqrt(stiffness);
+    long long contacts = 0;
+    #pragma omp parallel for schedule(dynamic, 64) reduction(+ : contacts)
+    for (int i = 0; i < numSurface; i++) {
+        const int v = m_surfaceVertices[i];
+        const Vector3d &p = positions[v];
+        int slot = m_candidateStart[i];
+        for (int c = m_candidateStart[i]; c < m_candidateStart[i + 1]; c++) {
+            const int triangle = m_candidates[c];
+            const Vector3i &face = m_faces[triangle];
+            if (isSkipped(face, i)) continue;
+
+            const Vector3d &a = positions[face[0]], &b = positions[face[1]], &d = positions[face[2]];
+            TriangleFeature feature;
+            Vector3d closest = closestPointOnTriangle(p, a, b, d, feature);
+            Vector3d offset = p - closest;
+            double distance = offset.norm();
+            if (distance >= m_thickness) continue;
+
+            // Push out along the closest-point direction, flipped to the triangle's outside if the vertex has
+            // already passed behind it
+            Vector3d faceNormal = (b - a).cross(d - a).normalized();
+            Vector3d normal = distance > 1e-12 ? Vector3d(offset / distance) : faceNormal;
+            double depth = m_thickness - distance;
+            if (offset.dot(faceNormal) < 0) {
+                normal = -normal;
+                depth  = m_thickness;
+            }
+
+            Vector3d weights = barycentricCoordinates(closest, a, b, d);
+            Vector3d relativeVelocity = velocities[v] - (weights[0] * velocities[face[0]] +
+                                                         weights[1] * velocities[face[1]] +
+                                                         weights[2] * velocities[face[2]]);
+            double acceleration = stiffness * depth - damping * std::min(relativeVelocity.dot(normal), 0.0);
+
+            // Scaled by the effective mass of the pair, so that a heavy vertex can't fling a triangle with light
+            // corners
+            double inverseMass = 1 / masses[v];
+            for (int k = 0; k < 3; k++) inverseMass += weights[k] * weights[k] / masses[face[k]];
+
+            m_candidates[slot]     = triangle;
+            m_contactWeights[slot] = weights;
+            m_contactForces[slot]  = acceleration / inverseMass * normal;
+            slot++;
+        }
+        m_contactCounts[i] = slot - m_candidateStart[i];
+        contacts += m_contactCounts[i];
+
+        // A vertex near a shared edge or corner sees several triangles at once; averaging keeps the response
+        // as stiff as a single contact, which the explicit integrators need to stay stable
+        for (int c = m_candidateStart[i]; c < slot; c++) m_contactForces[c] /= m_contactCounts[i];
+    }
+    m_timings.contacts += contacts;
+    m_timings.narrowphaseSeconds += secondsSince(start);
+
+    start = std::chrono::steady_clock::now();
+    if (contacts > 0) {
+        // Counting sort of the triangle corners by vertex, in contact order
+        const int numVertices = positions.size();
+        std::fill(m_cornerStart.begin(), m_cornerStart.end(), 0);
+        for (int i = 0; i < numSurface; i++) {
+            for (int slot = m_candidateStart[i]; slot < m_candidateStart[i] + m_contactCounts[i]; slot++) {
+                for (int k = 0; k < 3; k++) m_cornerStart[m_faces[m_candidates[slot]][k] + 1]++;
+            }
+        }
+        for (int v = 0; v < numVertices; v++) m_cornerStart[v + 1] += m_cornerStart[v];
+        m_cornerContacts.resize(m_cornerStart[numVertices]);
+        std::vector<int> next(m_cornerStart.begin(), m_cornerStart.end() - 1);
+        for (int i = 0; i < numSurface; i++) {
+            for (int slot = m_candidateStart[i]; slot < m_candidateStart[i] + m_contactCounts[i]; slot++) {
+                for (int k = 0; k < 3; k++) m_cornerContacts[next[m_faces[m_candidates[slot]][k]]++] = slot * 3 + k;
+            }
+        }
+
+        #pragma omp parallel for schedule(static)
+        for (int v = 0; v < numVertices; v++) {
+            for (int e = m_cornerStart[v]; e < m_cornerStart[v + 1]; e++) {
+                const int slot = m_cornerContacts[e] / 3, corner = m_cornerContacts[e] % 3;
+                forces[v] -= m_contactWeights[slot][corner] * m_contactForces[slot];
+            }
+        }
+        #pragma omp parallel for schedule(static)
+        for (int i = 0; i < numSurface; i++) {
+            for (int slot = m_candidateStart[i]; slot < m_candidateStart[i] + m_contactCounts[i]; slot++) {
+                forces[m_surfaceVertices[i]] += m_contactForces[slot];
+            }
+        }
+    }
+    m_timings.responseSeconds += secondsSince(start);
+}
+
+int SelfCollision::resolveCrossings(const std::vector<Eigen::Vector3d> &start,
+                                    std::vector<Eigen::Vector3d>       &positions,
+                                    std::vector<Eigen::Vector3d>       &velocities)
+{
+    PROFILE_SCOPE("SelfCollision::resolveCrossings");
+    const int numSurface = m_surfaceVertices.size();
+    if (numSurface == 0) return 0;
+    auto startTime = std::chrono::steady_clock::now();
+
+    m_bvh.refit(start, positions);
+    m_crossingPositions.resize(numSurface);
+    m_crossingVelocities.resize(numSurface);
+    m_crossed.assign(numSurface, 0);
+
+    // Found against the unmodified positions first, then applied, so that no vertex reads another's update
+    int crossings = 0;
+    #pragma omp parallel for schedule(dynamic, 64) reduction(+ : crossings)
+    for (int i = 0; i < numSurface; i++) {
+        const int v = m_surfaceVertices[i];
+        const Vector3d &p0 = start[v], &p1 = positions[v];
+        double earliest = 2;
+        int    hit = -1;
+        m_bvh.query(AlignedBox3d(p0.cwiseMin(p1), p0.cwiseMax(p1)), [&](int triangle) {
+            const Vector3i &face = m_faces[triangle];
+            if (isSkipped(face, i)) return;
+            double t;
+            if (vertexTriangleImpact(p0, p1, start[face[0]], positions[face[0]], start[face[1]], positions[face[1]],
+                                     start[face[2]], positions[face[2]], t, 1e-9) &&
+                (t < earliest || (t == earliest && triangle < hit))) {
+                earliest = t;
+                hit      = triangle;
+            }
+        });
+        if (hit < 0) continue;
+
+        // Onto the side of the triangle it started on, a thickness above the triangle's end position, moving
+        // with it along the normal
+        const Vector3i &face = m_faces[hit];
+        const Vector3d &a = positions[face[0]], &b = positions[face[1]], &d = positions[face[2]];
+        Vector3d normal = (b - a).cross(d - a).normalized();
+        if ((p0 - start[face[0]]).dot((start[face[1]] - start[face[0]]).cross(start[face[2]] - start[face[0]])) < 0) {
+            normal = -normal;
+        }
+        TriangleFeature feature;
+        Vector3d closest = closestPointOnTriangle(p1, a, b, d, feature);
+        Vector3d weights = barycentricCoordinates(closest, a, b, d);
+        Vector3d triangleVelocity = weights[0] * velocities[face[0]] + weights[1] * velocities[face[1]] +
+                                    weights[2] * velocities[face[2]];
+        Vector3d relativeVelocity = velocities[v] - triangleVelocity;
+
+        m_crossingPositions[i]  = closest + m_thickness * normal;
+        m_crossingVelocities[i] = velocities[v] - std::min(relativeVelocity.dot(normal), 0.0) * normal;
+        m_crossed[i] = 1;
+        crossings++;
+    }
+
+    #pragma omp parallel for schedule(static)
+    for (int i = 0; i < numSurface; i++) {
+        if (!m_crossed[i]) continue;
+        positions[m_surfaceVertices[i]]  = m_crossingPositions[i];
+        velocities[m_surfaceVertices[i]] = m_crossingVelocities[i];
+    }
+
+    // The edges' swept boxes have to cover the vertices that were just moved
+    if (crossings > 0) m_bvh.refit(start, positions);
+    const int edgeCrossings = resolveEdgeCrossings(start, positions, velocities);
+
+    m_timings.crossings     += crossings;
+    m_timings.edgeCrossings += edgeCrossings;
+    m_timings.crossingSeconds += secondsSince(startTime);
+    return crossings + edgeCrossings;
+}
+
+int SelfCollision::resolveEdgeCrossings(const std::vector<Eigen::Vector3d> &start,
+                                        std::vector<Eigen::Vector3d>       &positions,
+                                        std::vector<Eigen::Vector3d>       &velocities)
+{
+    const int numEdges   = m_edges.size();
+    const int numSurface = m_surfaceVertices.size();
+    m_edgeShifts.resize(numEdges);
+    m_edgeVelocityChanges.resize(numEdges);
+    m_edgeCrossed.assign(numEdges, 0);
+
+    // Every edge finds its earliest crossing among the edges of the triangles its swept box meets. Both edges of
+    // a pair see the same crossing, so each only moves itself, by half.
+    int crossings = 0;
+    #pragma omp parallel for schedule(dynamic, 64) reduction(+ : crossings)
+    for (int e = 0; e < numEdges; e++) {
+        const int a = m_edges[e][0], b = m_edges[e][1];
+        const Vector3d &a0 = start[a], &a1 = positions[a], &b0 = start[b], &b1 = positions[b];
+        const AlignedBox3d swept(a0.cwiseMin(a1).cwiseMin(b0).cwiseMin(b1), a0.cwiseMax(a1).cwiseMax(b0).cwiseMax(b1));
+        double earliest = 2;
+        int    hit = -1;
+        m_bvh.query(swept, [&](int triangle) {
+            for (int k = 0; k < 3; k++) {
+                const int other = m_faceEdges[triangle][k];
+                const int c = m_edges[other][0], d = m_edges[other][1];
+                if (c == a || c == b || d == a || d == b) continue;
+                if (!m_sameBodyContacts && m_vertexBodies[c] == m_vertexBodies[a]) continue;
+                const AlignedBox3d otherSwept(start[c].cwiseMin(positions[c]).cwiseMin(start[d]).cwiseMin(positions[d]),
+                                              start[c].cwiseMax(positions[c]).cwiseMax(start[d]).cwiseMax(positions[d]));
+                if (!swept.intersects(otherSwept)) continue;
+                double t;
+                if (edgeEdgeImpact(a0, a1, b0, b1, start[c], positions[c], start[d], positions[d], t, 1e-9) &&
+                    (t < earliest || (t == earliest && other < hit))) {
+                    earliest = t;
+                    hit      = other;
+                }
+            }
+        });
+        if (hit < 0) continue;
+
+        // Along the edges' common normal, turned to the side this edge started on; parallel edges, and edges
+        // that started in one plane, have no side to go back to and are left to the penalty forces
+        const int c = m_edges[hit][0], d = m_edges[hit][1];
+        Vector3d normal = (b1 - a1).cross(positions[d] - positions[c]);
+        const double side = (a0 - start[c]).dot((b0 - a0).cross(start[d] - start[c]));
+        if (normal.squaredNorm() <= 1e-24 || side == 0) continue;
+        normal.normalize();
+        if (side < 0) normal = -normal;
+
+        double s, u;
+        segmentSegmentDistanceSquared(a1, b1, positions[c], positions[d], s, u);
+        const double separation = (a1 + s * (b1 - a1) - positions[c] - u * (positions[d] - positions[c])).dot(normal);
+        const Vector3d relativeVelocity = (1 - s) * velocities[a] + s * velocities[b] -
+                                          (1 - u) * velocities[c] - u * velocities[d];
+
+        m_edgeShifts[e]          = 0.5 * std::max(m_thickness - separation, 0.0) * normal;
+        m_edgeVelocityChanges[e] = -0.5 * std::min(relativeVelocity.dot(normal), 0.0) * normal;
+        m_edgeCrossed[e] = 1;
+        crossings++;
+    }
+    if (crossings == 0) return 0;
+
+    // A vertex on several crossed edges takes the mean of their corrections
+    #pragma omp parallel for schedule(static)
+    for (int i = 0; i < numSurface; i++) {
+        Vector3d shift = Vector3d::Zero(), velocityChange = Vector3d::Zero();
+        int count = 0;
+        for (int k = m_vertexEdgeStart[i]; k < m_vertexEdgeStart[i + 1]; k++) {
+            const int e = m_vertexEdges[k];
+            if (!m_edgeCrossed[e]) continue;
+            shift          += m_edgeShifts[e];
+            velocityChange += m_edgeVelocityChanges[e];
+            count++;
+        }
+        if (count == 0) continue;
+        positions[m_surfaceVertices[i]]  += shift / count;
+        velocities[m_surfaceVertices[i]] += velocityChange / count;
+    }
+    return crossings;
+}
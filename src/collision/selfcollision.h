@@ -0,0 +1,123 @@
+#pragma once
+
+#include <vector>
+#include "Eigen/Dense"
+
+#include "collision/trianglebvh.h"
+
+// Self-collision between the surface vertices and surface triangles of one deformable body, or contact between
+// several bodies sharing one surface array (see Scene), which is the same problem with pairs within a body
+// optionally left out.
+//
+// Every evaluation runs four phases:
+//   bvh          refit the surface BVH (rebuilding it once refitting has degraded it too far)
+//   broadphase   batched BVH query for the triangles within `thickness` of each surface vertex
+//   narrowphase  exact closest points, in parallel per vertex, skipping the triangles that touch the vertex or
+//                its one-ring; those can only meet through inverted elements, and pushing on them tears the
+//                mesh apart further
+//   response     penalty forces pushing each vertex out to `thickness`, averaged over its contacts and scaled
+//                by each pair's effective mass, with equal and opposite forces spread over the triangle's corners
+//                by barycentric weight
+// A vertex only writes its own contacts and its own force; the triangle-side forces are gathered per vertex
+// through a CSR built in contact order, so the result is free of races and the same for any thread count.
+//
+// Penalty forces only see the end of each step, so resolveCrossings() additionally finds vertices whose path
+// over a step passed through a triangle, and puts them back on the side they came from. It then does the same
+// for pairs of surface edges that passed through each other, which no vertex-triangle test sees (two boxes
+// meeting edge to edge), pushing each edge of the pair half the way back. The layer is too thin for the
+// penalty alone to stop a fast impact, so falling bodies need both.
+class SelfCollision
+{
+public:
+    struct Timings {
+        double bvhSeconds         = 0;
+        double broadphaseSeconds  = 0;
+        double narrowphaseSeconds = 0;
+        double responseSeconds    = 0;
+        double crossingSeconds    = 0;
+        int       evaluations = 0;
+        int       rebuilds    = 0;
+        long long candidates  = 0;
+        long long contacts    = 0;
+        long long crossings   = 0; // Vertices put back through a triangle
+        long long edgeCrossings = 0; // Edges put back through another edge
+    };
+
+    SelfCollision();
+
+    // `faces` is the outward-facing surface and `vertexBodies` the body of every vertex, or empty for a single
+    // body. The thickness defaults to a quarter of the surface's mean edge length.
+    void init(const std::vector<Eigen::Vector3i> &faces, const std::vector<Eigen::Vector3d> &positions,
+              const std::vector<int> &vertexBodies = {});
+
+    // With this off only vertices and triangles of different bodies are tested
+    void setSameBodyContacts(bool enabled) { m_sameBodyContacts = enabled; }
+    bool getSameBodyContacts() const { return m_sameBodyContacts; }
+
+    void setThickness(double thickness) { m_thickness = thickness; }
+    double getThickness() const { return m_thickness; }
+
+    void addForces(const std::vector<Eigen::Vector3d> &positions,
+                   const std::vector<Eigen::Vector3d> &velocities,
+                   const std::vector<double>          &masses,
+                   std::vector<Eigen::Vector3d>       &forces);
+
+    // Returns the number of vertices and edges that were put back
+    int resolveCrossings(const std::vector<Eigen::Vector3d> &start,
+                         std::vector<Eigen::Vector3d>       &positions,
+                         std::vector<Eigen::Vector3d>       &velocities);
+
+    const Timings &getTimings() const { return m_timings; }
+    void resetTimings() { m_timings = Timings(); }
+
+private:
+    // Whether `face` touches surface vertex `surfaceIndex` or one of its neighbours, or is on the vertex's own
+    // body while same-body contacts are off
+    bool isSkipped(const Eigen::Vector3i &face, int surfaceIndex) const;
+    int  resolveEdgeCrossings(const std::vector<Eigen::Vector3d> &start,
+                              std::vector<Eigen::Vector3d>       &positions,
+                              std::vector<Eigen::Vector3d>       &velocities);
+
+    std::vector<Eigen::Vector3i> m_faces;
+    std::vector<int>             m_vertexBodies;
+    std::vector<int>             m_surfaceVertices;
+    // One-ring of surface vertex i: m_neighbours[m_neighbourStart[i] .. m_neighbourStart[i + 1])
+    std::vector<int>             m_neighbourStart;
+    std::vector<int>             m_neighbours;
+    // Unique surface edges, the edges of each face (edge k runs from corner k to k + 1), and the edges of surface
+    // vertex i: m_vertexEdges[m_vertexEdgeStart[i] .. m_vertexEdgeStart[i + 1])
+    std::vector<Eigen::Vector2i> m_edges;
+    std::vector<Eigen::Vector3i> m_faceEdges;
+    std::vector<int>             m_vertexEdgeStart;
+    std::vector<int>             m_vertexEdges;
+    TriangleBvh                  m_bvh;
+
+    bool   m_sameBodyContacts;
+    double m_thickness;
+    // Penalty acceleration with the vertex right on the triangle. The layer is thin, so it has to be far stiffer
+    // than the ground to carry a body's weight; damping is set to critical for the resulting stiffness.
+    double m_contactAcceleration;
+
+    // Per-evaluation scratch. Contacts are stored in the candidate CSR slots of their vertex, the first
+    // m_contactCounts[i] slots of surface vertex i being used.
+    std::vector<Eigen::Vector3d> m_surfacePositions;
+    std::vector<int>             m_candidateStart;
+    std::vector<int>             m_candidates;
+    std::vector<int>             m_contactCounts;
+    std::vector<Eigen::Vector3d> m_contactWeights; // Barycentric weights of the closest point
+    std::vector<Eigen::Vector3d> m_contactForces;  // Force on the vertex
+    // Triangle-corner CSR: the contact slots pushing on vertex v, as slot * 3 + corner, are
+    // m_cornerContacts[m_cornerStart[v] .. m_cornerStart[v + 1])
+    std::vector<int>             m_cornerStart;
+    std::vector<int>             m_cornerContacts;
+
+    std::vector<Eigen::Vector3d> m_crossingPositions;
+    std::vector<Eigen::Vector3d> m_crossingVelocities;
+    std::vector<char>            m_crossed;
+    // Per edge: how far to move both its ends, and the velocity change of both, when m_edgeCrossed
+    std::vector<Eigen::Vector3d> m_edgeShifts;
+    std::vector<Eigen::Vector3d> m_edgeVelocityChanges;
+    std::vector<char>            m_edgeCrossed;
+
+    Timings m_timings;
+};
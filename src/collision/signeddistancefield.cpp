@@ -0,0 +1,235 @@
+#include "collision/signeddistancefield.h"
+#include "collision/geometry.h"
+#include "collision/spatialhash.h"
+#include "io/checkpoint.h"
+#include "profiling/profiler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <filesystem>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <utility>
+
+using namespace Eigen;
+
+namespace {
+
+uint64_t fnv1a(uint64_t hash, const void *data, size_t size)
+{
+    const unsigned char *bytes = static_cast<const unsigned char *>(data);
+    for (size_t i = 0; i < size; i++) {
+        hash = (hash ^ bytes[i]) * 0x100000001b3ull;
+    }
+    return hash;
+}
+
+}
+
+SignedDistanceField::SignedDistanceField()
+    : m_origin(Vector3d::Zero()),
+      m_resolution(Vector3i::Zero()),
+      m_voxelSize(1),
+      m_bandWidth(0)
+{
+}
+
+void SignedDistanceField::build(const std::vector<Eigen::Vector3d> &vertices, const std::vector<Eigen::Vector3i> &faces,
+                                double voxelSize, double bandWidth)
+{
+    PROFILE_SCOPE("SignedDistanceField::build");
+    const int numFaces = faces.size();
+    m_voxelSize = voxelSize;
+    m_bandWidth = bandWidth;
+
+    // Pad by the band plus a voxel so that the border is always outside and far from the surface
+    AlignedBox3d bounds;
+    for (const Vector3d &v : vertices) bounds.extend(v);
+    const double padding = bandWidth + voxelSize;
+    m_origin     = bounds.min().array() - padding;
+    m_resolution = ((bounds.sizes().array() + 2 * padding) / voxelSize).ceil().cast<int>() + 1;
+    m_distances.assign(static_cast<size_t>(m_resolution.x()) * m_resolution.y() * m_resolution.z(), 0);
+
+    // Angle-weighted pseudonormals of the faces, vertices and edges (Baerentzen and Aanaes 2005)
+    std::vector<Vector3d> faceNormals(numFaces);
+    std::vector<Vector3d> vertexNormals(vertices.size(), Vector3d::Zero());
+    std::map<std::pair<int, int>, Vector3d> edgeNormalSums;
+    for (int f = 0; f < numFaces; f++) {
+        const Vector3i &face = faces[f];
+        faceNormals[f] = (vertices[face[1]] - vertices[face[0]]).cross(vertices[face[2]] - vertices[face[0]]).normalized();
+        for (int i = 0; i < 3; i++) {
+            int a = face[i], b = face[(i + 1) % 3], c = face[(i + 2) % 3];
+            double angle = std::acos(std::clamp((vertices[b] - vertices[a]).normalized().dot((vertices[c] - vertices[a]).normalized()), -1.0, 1.0));
+            vertexNormals[a] += angle * faceNormals[f];
+            edgeNormalSums[std::minmax(a, b)] += faceNormals[f];
+        }
+    }
+    // Per face, the normals of its edges opposite vertex 0, 1 and 2, matching TriangleFeature's order
+    std::vector<Vector3d> faceEdgeNormals(3 * numFaces);
+    for (int f = 0; f < numFaces; f++) {
+        for (int i = 0; i < 3; i++) {
+            faceEdgeNormals[3 * f + i] = edgeNormalSums[std::minmax(faces[f][(i + 1) % 3], faces[f][(i + 2) % 3])];
+        }
+    }
+
+    // Every voxel only measures the triangles whose band-inflated bounds contain it
+    std::vector<AlignedBox3d> bandBounds(numFaces);
+    for (int f = 0; f < numFaces; f++) {
+        bandBounds[f] = AlignedBox3d(vertices[faces[f][0]]);
+        bandBounds[f].extend(vertices[faces[f][1]]);
+        bandBounds[f].extend(vertices[faces[f][2]]);
+        bandBounds[f] = AlignedBox3d(bandBounds[f].min().array() - bandWidth, bandBounds[f].max().array() + bandWidth);
+    }
+    SpatialHash hash;
+    hash.build(bandBounds);
+
+    const float farAway = std::numeric_limits<float>::infinity();
+    const int rows = m_resolution.y() * m_resolution.z();
+    #pragma omp parallel for schedule(dynamic, 4)
+    for (int row = 0; row < rows; row++) {
+        const int y = row % m_resolution.y();
+        const int z = row / m_resolution.y();
+        float *distances = m_distances.data() + static_cast<size_t>(row) * m_resolution.x();
+        for (int x = 0; x < m_resolution.x(); x++) {
+            Vector3d point = m_origin + voxelSize * Vector3d(x, y, z);
+            double best = bandWidth;
+            double sign = 0;
+            hash.query(point, 0, [&](int f) {
+                const Vector3i &face = faces[f];
+                TriangleFeature feature;
+                Vector3d closest = closestPointOnTriangle(point, vertices[face[0]], vertices[face[1]], vertices[face[2]], feature);
+                double distance = (point - closest).norm();
+                if (distance >= best) return;
+
+                Vector3d pseudonormal = faceNormals[f];
+                switch (feature) {
+                case TriangleFeature::Vertex0: pseudonormal = vertexNormals[face[0]]; break;
+                case TriangleFeature::Vertex1: pseudonormal = vertexNormals[face[1]]; break;
+                case TriangleFeature::Vertex2: pseudonormal = vertexNormals[face[2]]; break;
+                case TriangleFeature::Edge12:  pseudonormal = faceEdgeNormals[3 * f];     break;
+                case TriangleFeature::Edge20:  pseudonormal = faceEdgeNormals[3 * f + 1]; break;
+                case TriangleFeature::Edge01:  pseudonormal = faceEdgeNormals[3 * f + 2]; break;
+                case TriangleFeature::Face:    pseudonormal = faceNormals[f]; break;
+                }
+                best = distance;
+                sign = (point - closest).dot(pseudonormal) < 0 ? -1 : 1;
+            });
+            distances[x] = sign == 0 ? farAway : sign * best;
+        }
+
+        // Outside the band, take the side of the last voxel before it along the row; the first voxel of every
+        // row lies in the padding, which is outside
+        float side = 1;
+        for (int x = 0; x < m_resolution.x(); x++) {
+            if (distances[x] == farAway) {
+                distances[x] = side * bandWidth;
+            } else {
+                side = distances[x] < 0 ? -1 : 1;
+            }
+        }
+    }
+}
+
+bool SignedDistanceField::sample(const Eigen::Vector3d &point, double &distance, Eigen::Vector3d &normal) const
+{
+    if (m_distances.empty()) return false;
+
+    Vector3d grid = (point - m_origin) / m_voxelSize;
+    Vector3i cell = grid.array().floor().cast<int>();
+    if ((cell.array() < 0).any() || (cell.array() >= m_resolution.array() - 1).any()) return false;
+    Vector3d t = grid - cell.cast<double>();
+
+    double c[2][2][2];
+    for (int k = 0; k < 2; k++) {
+        for (int j = 0; j < 2; j++) {
+            for (int i = 0; i < 2; i++) c[i][j][k] = voxel(cell.x() + i, cell.y() + j, cell.z() + k);
+        }
+    }
+
+    // Trilinear interpolation, and its exact gradient
+    double c00 = c[0][0][0] + t.x() * (c[1][0][0] - c[0][0][0]);
+    double c10 = c[0][1][0] + t.x() * (c[1][1][0] - c[0][1][0]);
+    double c01 = c[0][0][1] + t.x() * (c[1][0][1] - c[0][0][1]);
+    double c11 = c[0][1][1] + t.x() * (c[1][1][1] - c[0][1][1]);
+    double c0  = c00 + t.y() * (c10 - c00);
+    double c1  = c01 + t.y() * (c11 - c01);
+    distance = c0 + t.z() * (c1 - c0);
+
+    auto lerp = [](double a, double b, double s) { return a + s * (b - a); };
+    double dx00 = c[1][0][0] - c[0][0][0], dx10 = c[1][1][0] - c[0][1][0];
+    double dx01 = c[1][0][1] - c[0][0][1], dx11 = c[1][1][1] - c[0][1][1];
+    Vector3d gradient(lerp(lerp(dx00, dx10, t.y()), lerp(dx01, dx11, t.y()), t.z()),
+                      lerp(c10 - c00, c11 - c01, t.z()),
+                      c1 - c0);
+    double length = gradient.norm();
+    normal = length > 0 ? Vector3d(gradient / length) : Vector3d::UnitY();
+    return true;
+}
+
+// ================== Cache files
+
+bool SignedDistanceField::save(const std::string &path, uint64_t sourceKey) const
+{
+    CheckpointWriter writer;
+    if (!writer.open(path, CACHE_VERSION)) return false;
+    double grid[5] = {m_origin.x(), m_origin.y(), m_origin.z(), m_voxelSize, m_bandWidth};
+    int32_t resolution[3] = {m_resolution.x(), m_resolution.y(), m_resolution.z()};
+    writer.write(checkpointTag("SRC "), sourceKey);
+    writer.write(checkpointTag("GRID"), grid);
+    writer.write(checkpointTag("RES "), resolution);
+    writer.write(checkpointTag("DIST"), m_distances);
+    if (!writer.close()) {
+        std::cerr << "Failed to write " << path << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool SignedDistanceField::load(const std::string &path, uint64_t sourceKey)
+{
+    if (!std::filesystem::exists(path)) return false;
+
+    CheckpointReader reader;
+    if (!reader.open(path) || reader.getVersion() != CACHE_VERSION) return false;
+
+    uint64_t key;
+    double grid[5];
+    int32_t resolution[3];
+    std::vector<float> distances;
+    if (!reader.read(checkpointTag("SRC "), key) || key != sourceKey) {
+        std::cout << path << " is out of date" << std::endl;
+        return false;
+    }
+    if (!reader.read(checkpointTag("GRID"), grid) ||
+        !reader.read(checkpointTag("RES "), resolution) ||
+        !reader.read(checkpointTag("DIST"), distances)) {
+        return false;
+    }
+    if (distances.size() != static_cast<size_t>(resolution[0]) * resolution[1] * resolution[2]) {
+        std::cerr << path << " has " << distances.size() << " voxels, expected "
+                  << resolution[0] << " x " << resolution[1] << " x " << resolution[2] << std::endl;
+        return false;
+    }
+
+    m_origin     = Vector3d(grid[0], grid[1], grid[2]);
+    m_voxelSize  = grid[3];
+    m_bandWidth  = grid[4];
+    m_resolution = Vector3i(resolution[0], resolution[1], resolution[2]);
+    m_distances  = std::move(distances);
+    return true;
+}
+
+uint64_t SignedDistanceField::makeSourceKey(const std::string &meshPath, double voxelSize, double bandWidth)
+{
+    std::error_code error;
+    uint64_t size = std::filesystem::file_size(meshPath, error);
+    int64_t modified = std::filesystem::last_write_time(meshPath, error).time_since_epoch().count();
+
+    uint64_t hash = 0xcbf29ce484222325ull;
+    hash = fnv1a(hash, &size, sizeof(size));
+    hash = fnv1a(hash, &modified, sizeof(modified));
+    hash = fnv1a(hash, &voxelSize, sizeof(voxelSize));
+    hash = fnv1a(hash, &bandWidth, sizeof(bandWidth));
+    return hash;
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "Eigen/Dense"
+#include "Eigen/Geometry"
+
+// A static collider sampled once into a voxel grid of signed distances (negative inside).
+//
+// Voxels within `bandWidth` of the surface hold the exact distance to the nearest triangle, signed with
+// angle-weighted pseudonormals so that the result is reliable near edges and vertices. Voxels further out are
+// only classified as inside or outside (by sweeping along x from the grid's outside border) and hold
+// +-bandWidth. The mesh must be closed and consistently wound with outward normals.
+//
+// Once built, a lookup is a trilinear interpolation of eight voxels, so the cost of colliding against the
+// field doesn't depend on how many triangles it was built from. Building is expensive, so grids are meant to
+// be cached on disk with save()/load().
+class SignedDistanceField
+{
+public:
+    SignedDistanceField();
+
+    void build(const std::vector<Eigen::Vector3d> &vertices, const std::vector<Eigen::Vector3i> &faces,
+               double voxelSize, double bandWidth);
+
+    // Distance at `point` and the direction it increases in. Returns false outside the grid.
+    bool sample(const Eigen::Vector3d &point, double &distance, Eigen::Vector3d &normal) const;
+
+    // A cache file only loads if it was saved with the same `sourceKey`; see makeSourceKey()
+    bool save(const std::string &path, uint64_t sourceKey) const;
+    bool load(const std::string &path, uint64_t sourceKey);
+
+    // Identifies a mesh file (by size and modification time) together with the settings a grid was built with
+    static uint64_t makeSourceKey(const std::string &meshPath, double voxelSize, double bandWidth);
+
+    const Eigen::Vector3i &getResolution() const { return m_resolution; }
+    double getVoxelSize() const { return m_voxelSize; }
+    double getBandWidth() const { return m_bandWidth; }
+
+    // The region sample() covers, between the centres of the outermost voxels
+    Eigen::AlignedBox3d getBounds() const
+    {
+        return Eigen::AlignedBox3d(m_origin, m_origin + m_voxelSize * (m_resolution.array() - 1).matrix().cast<double>());
+    }
+
+private:
+    static const uint32_t CACHE_VERSION = 1;
+
+    float voxel(int x, int y, int z) const
+    {
+        return m_distances[x + static_cast<size_t>(m_resolution.x()) * (y + static_cast<size_t>(m_resolution.y()) * z)];
+    }
+
+    Eigen::Vector3d    m_origin;     // Centre of voxel (0, 0, 0)
+    Eigen::Vector3i    m_resolution;
+    double             m_voxelSize;
+    double             m_bandWidth;
+    std::vector<float> m_distances;  // x fastest
+};
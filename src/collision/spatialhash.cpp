@@ -0,0 +1,136 @@
+#include "collision/spatialhash.h"
+#include "profiling/profiler.h"
+
+#include <algorithm>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+using namespace Eigen;
+
+namespace {
+
+int threadCount()
+{
+#ifdef _OPENMP
+    return omp_get_num_threads();
+#else
+    return 1;
+#endif
+}
+
+int threadIndex()
+{
+#ifdef _OPENMP
+    return omp_get_thread_num();
+#else
+    return 0;
+#endif
+}
+
+}
+
+SpatialHash::SpatialHash()
+    : m_cellSize(1),
+      m_inverseCellSize(1),
+      m_bucketMask(0)
+{
+}
+
+void SpatialHash::build(const std::vector<Eigen::AlignedBox3d> &boxes, double cellSize)
+{
+    PROFILE_SCOPE("SpatialHash::build");
+    m_boxes = boxes;
+    m_entries.clear();
+    m_bucketStart.assign(1, 0);
+    const int numBoxes = boxes.size();
+    if (numBoxes == 0) return;
+
+    if (cellSize <= 0) {
+        double extentSum = 0;
+        #pragma omp parallel for reduction(+ : extentSum)
+        for (int b = 0; b < numBoxes; b++) {
+            extentSum += boxes[b].sizes().maxCoeff();
+        }
+        cellSize = extentSum / numBoxes;
+        // Degenerate (point) boxes still need a finite grid
+        if (!(cellSize > 0)) cellSize = 1;
+    }
+    m_cellSize        = cellSize;
+    m_inverseCellSize = 1 / cellSize;
+
+    auto cellCount = [&](int b) {
+        Vector3i extent = cellOf(boxes[b].max()) - cellOf(boxes[b].min()) + Vector3i::Ones();
+        return extent.x() * extent.y() * extent.z();
+    };
+    auto forEachBucket = [&](int b, auto &&f) {
+        Vector3i lo = cellOf(boxes[b].min());
+        Vector3i hi = cellOf(boxes[b].max());
+        for (int z = lo.z(); z <= hi.z(); z++) {
+            for (int y = lo.y(); y <= hi.y(); y++) {
+                for (int x = lo.x(); x <= hi.x(); x++) {
+                    f(bucketOf(Vector3i(x, y, z)));
+                }
+            }
+        }
+    };
+
+    int numEntries = 0;
+    #pragma omp parallel for reduction(+ : numEntries)
+    for (int b = 0; b < numBoxes; b++) {
+        numEntries += cellCount(b);
+    }
+
+    // About two buckets per entry keeps chains short
+    uint32_t numBuckets = 1;
+    while (numBuckets < 2 * static_cast<uint32_t>(numEntries)) numBuckets <<= 1;
+    m_bucketMask = numBuckets - 1;
+    m_bucketStart.assign(numBuckets + 1, 0);
+    m_entries.resize(numEntries);
+
+    #pragma omp parallel
+    {
+        const int numThreads = threadCount();
+        const int thread     = threadIndex();
+        const int begin      = static_cast<long long>(numBoxes) * thread / numThreads;
+        const int end        = static_cast<long long>(numBoxes) * (thread + 1) / numThreads;
+
+        #pragma omp single
+        m_threadCounts.assign(static_cast<size_t>(numThreads) * numBuckets, 0);
+
+        int *counts = m_threadCounts.data() + static_cast<size_t>(thread) * numBuckets;
+        for (int b = begin; b < end; b++) {
+            forEachBucket(b, [&](uint32_t bucket) { counts[bucket]++; });
+        }
+        #pragma omp barrier
+
+        #pragma omp for
+        for (int bucket = 0; bucket < static_cast<int>(numBuckets); bucket++) {
+            int total = 0;
+            for (int t = 0; t < numThreads; t++) total += m_threadCounts[static_cast<size_t>(t) * numBuckets + bucket];
+            m_bucketStart[bucket + 1] = total;
+        }
+
+        #pragma omp single
+        for (uint32_t bucket = 0; bucket < numBuckets; bucket++) {
+            m_bucketStart[bucket + 1] += m_bucketStart[bucket];
+        }
+
+        // Turn the histograms into each thread's write position within every bucket
+        #pragma omp for
+        for (int bucket = 0; bucket < static_cast<int>(numBuckets); bucket++) {
+            int offset = m_bucketStart[bucket];
+            for (int t = 0; t < numThreads; t++) {
+                int &count = m_threadCounts[static_cast<size_t>(t) * numBuckets + bucket];
+                int next = offset + count;
+                count  = offset;
+                offset = next;
+            }
+        }
+
+        for (int b = begin; b < end; b++) {
+            forEachBucket(b, [&](uint32_t bucket) { m_entries[counts[bucket]++] = b; });
+        }
+    }
+}
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include "Eigen/Dense"
+#include "Eigen/Geometry"
+
+// Uniform-grid broadphase over axis-aligned boxes (sphere bounds, triangle bounds, ...).
+//
+// Every box is entered into each grid cell it overlaps, and cells are hashed into a power-of-two bucket table.
+// The table is a CSR built from scratch by a parallel counting sort: each thread histograms a contiguous
+// range of boxes, and after a prefix sum scatters them back in the same order, so entries within a bucket are
+// in ascending box order for any thread count. There is no per-cell allocation, and rebuilding every step is
+// cheap enough for moving obstacles.
+//
+// The cell size should be comparable to the boxes being inserted: a box spanning many cells costs one entry
+// per cell.
+class SpatialHash
+{
+public:
+    SpatialHash();
+
+    // Replaces the contents with `boxes`. A cell size <= 0 uses the mean of the boxes' largest extents.
+    void build(const std::vector<Eigen::AlignedBox3d> &boxes, double cellSize = 0);
+
+    // Calls visit(boxIndex) once for every inserted box that overlaps `box`
+    template <typename Visit>
+    void query(const Eigen::AlignedBox3d &box, Visit &&visit) const;
+
+    // Inserted boxes within `radius` of `point`, as a box test
+    template <typename Visit>
+    void query(const Eigen::Vector3d &point, double radius, Visit &&visit) const
+    {
+        query(Eigen::AlignedBox3d(point.array() - radius, point.array() + radius), visit);
+    }
+
+    double getCellSize()    const { return m_cellSize; }
+    int    getBoxCount()    const { return m_boxes.size(); }
+    int    getBucketCount() const { return m_bucketStart.empty() ? 0 : m_bucketStart.size() - 1; }
+    int    getEntryCount()  const { return m_entries.size(); }
+
+private:
+    Eigen::Vector3i cellOf(const Eigen::Vector3d &point) const
+    {
+        return (point * m_inverseCellSize).array().floor().cast<int>();
+    }
+
+    uint32_t bucketOf(const Eigen::Vector3i &cell) const
+    {
+        return (static_cast<uint32_t>(cell.x()) * 73856093u ^
+                static_cast<uint32_t>(cell.y()) * 19349663u ^
+                static_cast<uint32_t>(cell.z()) * 83492791u) & m_bucketMask;
+    }
+
+    std::vector<Eigen::AlignedBox3d> m_boxes;
+    double   m_cellSize;
+    double   m_inverseCellSize;
+    uint32_t m_bucketMask;
+
+    // The boxes in bucket b are m_entries[m_bucketStart[b] .. m_bucketStart[b + 1])
+    std::vector<int> m_bucketStart;
+    std::vector<int> m_entries;
+
+    // Build scratch: per-thread bucket histograms, reused between builds
+    std::vector<int> m_threadCounts;
+};
+
+template <typename Visit>
+void SpatialHash::query(const Eigen::AlignedBox3d &box, Visit &&visit) const
+{
+    if (m_boxes.empty()) return;
+
+    const Eigen::Vector3i lo = cellOf(box.min());
+    const Eigen::Vector3i hi = cellOf(box.max());
+    for (int z = lo.z(); z <= hi.z(); z++) {
+        for (int y = lo.y(); y <= hi.y(); y++) {
+            for (int x = lo.x(); x <= hi.x(); x++) {
+                const Eigen::Vector3i cell(x, y, z);
+                const uint32_t bucket = bucketOf(cell);
+                int previous = -1;
+                for (int e = m_bucketStart[bucket]; e < m_bucketStart[bucket + 1]; e++) {
+                    // A box whose cells collide in the same bucket has adjacent entries there
+                    const int index = m_entries[e];
+                    if (index == previous) continue;
+                    previous = index;
+
+                    const Eigen::AlignedBox3d &other = m_boxes[index];
+                    if (!other.intersects(box)) continue;
+                    // Overlapping boxes share a range of cells; only report the pair from the first of them
+                    if (cellOf(other.min()).cwiseMax(lo) != cell) continue;
+                    visit(index);
+                }
+            }
+        }
+    }
+}
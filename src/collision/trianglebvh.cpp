@@ -0,0 +1,235 @@
+#include "collision/trianglebvh.h"
+#include "profiling/profiler.h"
+
+#include <algorithm>
+#include <cstdint>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+using namespace Eigen;
+
+namespace {
+
+// Spreads the low 10 bits of v out to every third bit
+uint32_t expandBits(uint32_t v)
+{
+    v = (v * 0x00010001u) & 0xFF0000FFu;
+    v = (v * 0x00000101u) & 0x0F00F00Fu;
+    v = (v * 0x00000011u) & 0xC30C30C3u;
+    v = (v * 0x00000005u) & 0x49249249u;
+    return v;
+}
+
+// `unit` in [0, 1]^3
+uint32_t mortonCode(const Vector3d &unit)
+{
+    Vector3d scaled = (unit * 1024).cwiseMax(0.0).cwiseMin(1023.0);
+    return expandBits(static_cast<uint32_t>(scaled.x())) * 4 +
+           expandBits(static_cast<uint32_t>(scaled.y())) * 2 +
+           expandBits(static_cast<uint32_t>(scaled.z()));
+}
+
+AlignedBox3d triangleBox(const std::vector<Vector3d> &positions, const Vector3i &face)
+{
+    AlignedBox3d box(positions[face[0]]);
+    box.extend(positions[face[1]]);
+    box.extend(positions[face[2]]);
+    return box;
+}
+
+double surfaceArea(const AlignedBox3d &box)
+{
+    Vector3d size = box.sizes();
+    return 2 * (size.x() * size.y() + size.y() * size.z() + size.z() * size.x());
+}
+
+}
+
+TriangleBvh::TriangleBvh()
+    : m_buildCost(0),
+      m_rebuildThreshold(1.5)
+{
+}
+
+void TriangleBvh::build(const std::vector<Eigen::Vector3d> &positions, const std::vector<Eigen::Vector3i> &faces)
+{
+    PROFILE_SCOPE("TriangleBvh::build");
+    const int numTriangles = faces.size();
+    m_faces = faces;
+    m_nodes.clear();
+    m_levelStart.clear();
+    m_leafTriangles.resize(numTriangles);
+    m_leafBoxes.resize(numTriangles);
+    m_buildCost = 0;
+    if (numTriangles == 0) return;
+
+    // Morton codes of the triangle centroids, normalized to their bounds. Each key carries the triangle index
+    // in its low half, which makes every key unique and the sort deterministic.
+    AlignedBox3d bounds;
+    for (const Vector3i &face : faces) {
+        bounds.extend((positions[face[0]] + positions[face[1]] + positions[face[2]]) / 3);
+    }
+    Vector3d inverseSize = bounds.sizes().cwiseMax(1e-12).cwiseInverse();
+    std::vector<uint64_t> keys(numTriangles);
+    #pragma omp parallel for schedule(static)
+    for (int t = 0; t < numTriangles; t++) {
+        Vector3d centroid = (positions[faces[t][0]] + positions[faces[t][1]] + positions[faces[t][2]]) / 3;
+        uint32_t code = mortonCode((centroid - bounds.min()).cwiseProduct(inverseSize));
+        keys[t] = static_cast<uint64_t>(code) << 32 | static_cast<uint32_t>(t);
+    }
+    std::sort(keys.begin(), keys.end());
+    for (int i = 0; i < numTriangles; i++) {
+        m_leafTriangles[i] = static_cast<uint32_t>(keys[i]);
+    }
+
+    if (numTriangles > 1) {
+        // Binary radix tree over the sorted keys: internal node i covers a key range with i at one end, and
+        // splits it where the highest differing bit changes
+        const int numInternal = numTriangles - 1;
+        auto commonPrefix = [&](int i, int j) {
+            if (j < 0 || j >= numTriangles) return -1;
+            return __builtin_clzll(keys[i] ^ keys[j]);
+        };
+        std::vector<Node> radixNodes(numInternal);
+        #pragma omp parallel for schedule(static)
+        for (int i = 0; i < numInternal; i++) {
+            const int direction = commonPrefix(i, i + 1) > commonPrefix(i, i - 1) ? 1 : -1;
+            const int minPrefix = commonPrefix(i, i - direction);
+
+            // Find the other end of the range by exponential then binary search
+            int maxLength = 2;
+            while (commonPrefix(i, i + maxLength * direction) > minPrefix) maxLength *= 2;
+            int length = 0;
+            for (int step = maxLength / 2; step >= 1; step /= 2) {
+                if (commonPrefix(i, i + (length + step) * direction) > minPrefix) length += step;
+            }
+            const int j = i + length * direction;
+
+            // Then the split position within it
+            const int nodePrefix = commonPrefix(i, j);
+            int split = 0;
+            int step = length;
+            do {
+                step = (step + 1) / 2;
+                if (commonPrefix(i, i + (split + step) * direction) > nodePrefix) split += step;
+            } while (step > 1);
+            const int gamma = i + split * direction + std::min(direction, 0);
+
+            radixNodes[i].left  = std::min(i, j) == gamma     ? ~gamma       : gamma;
+            radixNodes[i].right = std::max(i, j) == gamma + 1 ? ~(gamma + 1) : gamma + 1;
+        }
+
+        // Renumber breadth first, recording where each level starts
+        std::vector<int> order;
+        std::vector<int> newIndex(numInternal);
+        order.reserve(numInternal);
+        order.push_back(0);
+        for (size_t levelBegin = 0; levelBegin < order.size(); ) {
+            size_t levelEnd = order.size();
+            m_levelStart.push_back(levelBegin);
+            for (size_t k = levelBegin; k < levelEnd; k++) {
+                newIndex[order[k]] = k;
+                for (int child : {radixNodes[order[k]].left, radixNodes[order[k]].right}) {
+                    if (child >= 0) order.push_back(child);
+                }
+            }
+            levelBegin = levelEnd;
+        }
+        m_levelStart.push_back(numInternal);
+
+        m_nodes.resize(numInternal);
+        for (int k = 0; k < numInternal; k++) {
+            const Node &node = radixNodes[order[k]];
+            m_nodes[k].left  = node.left  >= 0 ? newIndex[node.left]  : node.left;
+            m_nodes[k].right = node.right >= 0 ? newIndex[node.right] : node.right;
+        }
+    }
+
+    refit(positions);
+    m_buildCost = computeCost();
+}
+
+void TriangleBvh::refit(const std::vector<Eigen::Vector3d> &positions)
+{
+    PROFILE_SCOPE("TriangleBvh::refit");
+    const int numLeaves = m_leafTriangles.size();
+    #pragma omp parallel for schedule(static)
+    for (int i = 0; i < numLeaves; i++) {
+        m_leafBoxes[i] = triangleBox(positions, m_faces[m_leafTriangles[i]]);
+    }
+    refitNodes();
+}
+
+void TriangleBvh::refit(const std::vector<Eigen::Vector3d> &start, const std::vector<Eigen::Vector3d> &end)
+{
+    PROFILE_SCOPE("TriangleBvh::refit");
+    const int numLeaves = m_leafTriangles.size();
+    #pragma omp parallel for schedule(static)
+    for (int i = 0; i < numLeaves; i++) {
+        const Vector3i &face = m_faces[m_leafTriangles[i]];
+        m_leafBoxes[i] = triangleBox(start, face).merged(triangleBox(end, face));
+    }
+    refitNodes();
+}
+
+void TriangleBvh::refitNodes()
+{
+    // Deepest level first, so that every child is up to date before its parent
+    #pragma omp parallel
+    for (int level = static_cast<int>(m_levelStart.size()) - 2; level >= 0; level--) {
+        #pragma omp for schedule(static)
+        for (int n = m_levelStart[level]; n < m_levelStart[level + 1]; n++) {
+            Node &node = m_nodes[n];
+            node.box = childBox(node.left).merged(childBox(node.right));
+        }
+    }
+}
+
+bool TriangleBvh::update(const std::vector<Eigen::Vector3d> &positions)
+{
+    refit(positions);
+    if (getQuality() <= m_rebuildThreshold) return false;
+    build(positions, m_faces);
+    return true;
+}
+
+double TriangleBvh::computeCost() const
+{
+    if (m_nodes.empty()) return 0;
+    double area = 0;
+    const int numNodes = m_nodes.size();
+    #pragma omp parallel for reduction(+ : area)
+    for (int n = 0; n < numNodes; n++) {
+        area += surfaceArea(m_nodes[n].box);
+    }
+    return area / std::max(surfaceArea(m_nodes[0].box), 1e-300);
+}
+
+void TriangleBvh::queryPoints(const std::vector<Eigen::Vector3d> &points, double radius,
+                              std::vector<int> &start, std::vector<int> &triangles) const
+{
+    PROFILE_SCOPE("TriangleBvh::queryPoints");
+    const int numPoints = points.size();
+    start.assign(numPoints + 1, 0);
+
+    // Count, prefix sum, then fill, which keeps the output in point order without per-thread lists
+    #pragma omp parallel for schedule(dynamic, 64)
+    for (int p = 0; p < numPoints; p++) {
+        int count = 0;
+        query(points[p], radius, [&](int) { count++; });
+        start[p + 1] = count;
+    }
+    for (int p = 0; p < numPoints; p++) {
+        start[p + 1] += start[p];
+    }
+    triangles.resize(start[numPoints]);
+
+    #pragma omp parallel for schedule(dynamic, 64)
+    for (int p = 0; p < numPoints; p++) {
+        int next = start[p];
+        query(points[p], radius, [&](int t) { triangles[next++] = t; });
+        std::sort(triangles.begin() + start[p], triangles.begin() + next);
+    }
+}
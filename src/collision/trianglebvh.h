@@ -0,0 +1,104 @@
+#pragma once
+
+#include <vector>
+#include "Eigen/Dense"
+#include "Eigen/Geometry"
+
+// Bounding volume hierarchy over the triangles of a deforming surface.
+//
+// build() sorts the triangles along a 30-bit Morton curve and builds the binary radix tree over the codes
+// (Karras 2012), with every internal node found independently. Nodes are then renumbered breadth first, so
+// children always come after their parent and each tree level is a contiguous range. refit() recomputes the
+// boxes bottom-up one level at a time, in parallel within a level, without touching the topology.
+//
+// Refitting keeps the tree valid however far the vertices move, but its boxes grow looser as the surface
+// deforms away from the shape it was built on. update() refits and rebuilds once the surface-area cost of the
+// tree has grown past the rebuild threshold relative to the last build.
+class TriangleBvh
+{
+public:
+    TriangleBvh();
+
+    void build(const std::vector<Eigen::Vector3d> &positions, const std::vector<Eigen::Vector3i> &faces);
+    void refit(const std::vector<Eigen::Vector3d> &positions);
+    // Refits to the boxes swept by the triangles moving from `start` to `end`, for continuous queries
+    void refit(const std::vector<Eigen::Vector3d> &start, const std::vector<Eigen::Vector3d> &end);
+
+    // Refits, then rebuilds if the quality has degraded too far; returns whether it rebuilt
+    bool update(const std::vector<Eigen::Vector3d> &positions);
+
+    // Surface-area cost of the current boxes relative to the last build; 1 just after building
+    double getQuality() const { return m_buildCost > 0 ? computeCost() / m_buildCost : 1; }
+    void   setRebuildThreshold(double threshold) { m_rebuildThreshold = threshold; }
+
+    // Calls visit(triangle) for every triangle whose box overlaps `box`
+    template <typename Visit>
+    void query(const Eigen::AlignedBox3d &box, Visit &&visit) const;
+
+    template <typename Visit>
+    void query(const Eigen::Vector3d &point, double radius, Visit &&visit) const
+    {
+        query(Eigen::AlignedBox3d(point.array() - radius, point.array() + radius), visit);
+    }
+
+    // Batched, parallel proximity query: the candidate triangles of points[i] (boxes within `radius`) are
+    // triangles[start[i] .. start[i + 1]), in ascending order so that what is built from them doesn't depend on
+    // the shape of the tree
+    void queryPoints(const std::vector<Eigen::Vector3d> &points, double radius,
+                     std::vector<int> &start, std::vector<int> &triangles) const;
+
+    int getTriangleCount() const { return m_leafTriangles.size(); }
+    int getNodeCount()     const { return m_nodes.size(); }
+    int getDepth()         const { return m_levelStart.empty() ? 0 : m_levelStart.size() - 1; }
+
+private:
+    // A child index c >= 0 is the internal node c; c < 0 is the leaf ~c
+    struct Node {
+        Eigen::AlignedBox3d box;
+        int left;
+        int right;
+    };
+
+    void   refitNodes();
+    double computeCost() const;
+
+    const Eigen::AlignedBox3d &childBox(int child) const
+    {
+        return child >= 0 ? m_nodes[child].box : m_leafBoxes[~child];
+    }
+
+    std::vector<Eigen::Vector3i> m_faces;
+    std::vector<Node>            m_nodes;         // Breadth-first; the root is node 0
+    std::vector<int>             m_levelStart;    // Level d is nodes [m_levelStart[d], m_levelStart[d + 1])
+    std::vector<int>             m_leafTriangles; // Triangle of each leaf, in Morton order
+    std::vector<Eigen::AlignedBox3d> m_leafBoxes;
+
+    double m_buildCost;
+    double m_rebuildThreshold;
+};
+
+template <typename Visit>
+void TriangleBvh::query(const Eigen::AlignedBox3d &box, Visit &&visit) const
+{
+    if (m_leafBoxes.size() == 1) {
+        if (m_leafBoxes[0].intersects(box)) visit(m_leafTriangles[0]);
+        return;
+    }
+    if (m_nodes.empty() || !m_nodes[0].box.intersects(box)) return;
+
+    // The depth of a Morton tree is bounded by the 30 code bits plus the bits of the tie-breaking index
+    int stack[64];
+    int size = 0;
+    stack[size++] = 0;
+    while (size > 0) {
+        const Node &node = m_nodes[stack[--size]];
+        for (int child : {node.left, node.right}) {
+            if (!childBox(child).intersects(box)) continue;
+            if (child < 0) {
+                visit(m_leafTriangles[~child]);
+            } else {
+                stack[size++] = child;
+            }
+        }
+    }
+}
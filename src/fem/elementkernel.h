@@ -0,0 +1,139 @@
+#pragma once
+
+#include <algorithm>
+#include <vector>
+#include "Eigen/Dense"
+
+// The explicit solver's arithmetic, written once for any scalar type: FemSolver runs it on doubles, and
+// Ensemble's lockstep batches on Eigen arrays holding one value per member. Both therefore take the same
+// St. Venant-Kirchhoff and Kelvin-Voigt element forces, ground contact and midpoint step, in the same order.
+//
+// Anything that branches per value is written as a mask, so that it works the same way on every lane.
+namespace ElementKernel {
+
+// Lamé parameters and viscosity of one element's material
+template <typename Scalar>
+struct Parameters {
+    Scalar lambda;
+    Scalar mu;
+    Scalar viscosity;
+};
+
+struct Ground {
+    double height;
+    double stiffness; // Penalty acceleration per metre of penetration
+    double damping;
+    double friction;  // Tangential velocity damping while in contact
+};
+
+inline double contactMask(double depth) { return depth > 0 ? 1.0 : 0.0; }
+inline double minZero(double value) { return std::min(value, 0.0); }
+
+template <typename Derived>
+auto contactMask(const Eigen::ArrayBase<Derived> &depth) { return (depth > 0).template cast<double>().eval(); }
+template <typename Derived>
+auto minZero(const Eigen::ArrayBase<Derived> &value) { return value.min(0.0).eval(); }
+
+// Elastic and viscous forces on the four corners of a tet, written to corners[corner * 3 + component].
+// position(corner, component) and velocity(corner, component) read its corners' current state.
+template <typename Scalar, typename Positions, typename Velocities>
+void computeElementForces(const Eigen::Matrix3d &restInverse, double restVolume, const Parameters<Scalar> &material,
+                          const Positions &position, const Velocities &velocity, Scalar *corners)
+{
+    // Deformation gradient and its rate: the edge matrices (column j is corner j + 1 minus corner 0) times the
+    // rest-shape inverse
+    Scalar edges[3][3], edgeVelocities[3][3];
+    for (int j = 0; j < 3; j++) {
+        for (int i = 0; i < 3; i++) {
+            edges[i][j]          = position(j + 1, i) - position(0, i);
+            edgeVelocities[i][j] = velocity(j + 1, i) - velocity(0, i);
+        }
+    }
+    Scalar F[3][3], Fdot[3][3];
+    for (int i = 0; i < 3; i++) {
+        for (int j = 0; j < 3; j++) {
+            F[i][j]    = edges[i][0] * restInverse(0, j) + edges[i][1] * restInverse(1, j) +
+                         edges[i][2] * restInverse(2, j);
+            Fdot[i][j] = edgeVelocities[i][0] * restInverse(0, j) + edgeVelocities[i][1] * restInverse(1, j) +
+                         edgeVelocities[i][2] * restInverse(2, j);
+        }
+    }
+
+    // Green strain and its rate, both symmetric
+    Scalar strain[3][3], strainRate[3][3];
+    for (int i = 0; i < 3; i++) {
+        for (int j = i; j < 3; j++) {
+            strain[i][j] = 0.5 * (F[0][i] * F[0][j] + F[1][i] * F[1][j] + F[2][i] * F[2][j] - (i == j ? 1.0 : 0.0));
+            strainRate[i][j] = 0.5 * (F[0][i] * Fdot[0][j] + F[1][i] * Fdot[1][j] + F[2][i] * Fdot[2][j] +
+                                      Fdot[0][i] * F[0][j] + Fdot[1][i] * F[1][j] + Fdot[2][i] * F[2][j]);
+            strain[j][i]     = strain[i][j];
+            strainRate[j][i] = strainRate[i][j];
+        }
+    }
+
+    // Second Piola-Kirchhoff stress, elastic plus viscous
+    const Scalar trace = strain[0][0] + strain[1][1] + strain[2][2];
+    Scalar stress[3][3];
+    for (int i = 0; i < 3; i++) {
+        for (int j = 0; j < 3; j++) {
+            stress[i][j] = 2 * material.mu * strain[i][j] + 2 * material.viscosity * strainRate[i][j];
+        }
+        stress[i][i] += material.lambda * trace;
+    }
+
+    // H = -V F S R^-T; its columns are the forces on corners 1-3, and corner 0 balances them
+    Scalar FS[3][3];
+    for (int i = 0; i < 3; i++) {
+        for (int j = 0; j < 3; j++) {
+            FS[i][j] = F[i][0] * stress[0][j] + F[i][1] * stress[1][j] + F[i][2] * stress[2][j];
+        }
+    }
+    for (int i = 0; i < 3; i++) {
+        for (int j = 0; j < 3; j++) {
+            corners[(j + 1) * 3 + i] = -restVolume * (FS[i][0] * restInverse(j, 0) + FS[i][1] * restInverse(j, 1) +
+                                                      FS[i][2] * restInverse(j, 2));
+        }
+        corners[i] = -(corners[3 + i] + corners[6 + i] + corners[9 + i]);
+    }
+}
+
+// Adds the penalty ground's acceleration on a vertex at `height` moving at `velocity`: a spring and damper
+// along +y while below the ground, with friction on the tangential velocity
+template <typename Scalar>
+void addGroundAcceleration(const Ground &ground, const Scalar &height, const Scalar velocity[3],
+                           Scalar acceleration[3])
+{
+    const Scalar depth   = ground.height - height;
+    const Scalar contact = contactMask(depth);
+    acceleration[0] -= contact * ground.friction * velocity[0];
+    acceleration[1] += contact * (ground.stiffness * depth - ground.damping * minZero(velocity[1]));
+    acceleration[2] -= contact * ground.friction * velocity[2];
+}
+
+// One explicit midpoint step. computeForces(positions, velocities, forces) evaluates the forces of a state;
+// inverseMasses is indexed like the values it scales.
+template <typename Value, typename InverseMass, typename ComputeForces>
+void stepMidpoint(std::vector<Value> &positions, std::vector<Value> &velocities, std::vector<Value> &midPositions,
+                  std::vector<Value> &midVelocities, std::vector<Value> &forces,
+                  const std::vector<InverseMass> &inverseMasses, double dt, ComputeForces &&computeForces)
+{
+    const int numValues = positions.size();
+
+    computeForces(positions, velocities, forces);
+
+    #pragma omp parallel for schedule(static)
+    for (int i = 0; i < numValues; i++) {
+        midPositions[i]  = positions[i]  + 0.5 * dt * velocities[i];
+        midVelocities[i] = velocities[i] + 0.5 * dt * forces[i] * inverseMasses[i];
+    }
+
+    computeForces(midPositions, midVelocities, forces);
+
+    #pragma omp parallel for schedule(static)
+    for (int i = 0; i < numValues; i++) {
+        positions[i]  += dt * midVelocities[i];
+        velocities[i] += dt * forces[i] * inverseMasses[i];
+    }
+}
+
+}
@@ -0,0 +1,159 @@
+#include "fem/embeddedmesh.h"
+#include "collision/geometry.h"
+#include "collision/spatialhash.h"
+#include "profiling/profiler.h"
+
+#include <iostream>
+#include <limits>
+
+using namespace Eigen;
+
+namespace {
+
+// Distance from a point to a tet, zero inside it
+double distanceToTet(const Vector3d &point, const Vector3d corners[4])
+{
+    static const int FACES[4][3] = {{1, 2, 3}, {0, 3, 2}, {0, 1, 3}, {0, 2, 1}};
+    double best = std::numeric_limits<double>::infinity();
+    for (const auto &face : FACES) {
+        TriangleFeature feature;
+        Vector3d closest = closestPointOnTriangle(point, corners[face[0]], corners[face[1]], corners[face[2]], feature);
+        best = std::min(best, (point - closest).norm());
+    }
+    return best;
+}
+
+}
+
+EmbeddedMesh::EmbeddedMesh()
+    : m_firstPosition(0),
+      m_positionCount(0),
+      m_outside(0),
+      m_maxOutsideDistance(0)
+{
+}
+
+bool EmbeddedMesh::bind(const std::vector<Eigen::Vector3d> &restPositions, const std::vector<Eigen::Vector4i> &tets,
+                        const std::vector<Eigen::Vector3d> &vertices)
+{
+    PROFILE_SCOPE("EmbeddedMesh::bind");
+    const int numTets     = tets.size();
+    const int numVertices = vertices.size();
+    if (numTets == 0) {
+        std::cerr << "Can't embed a mesh in no tets" << std::endl;
+        return false;
+    }
+
+    // Maps from a point to its barycentric coordinates in b, c and d; degenerate tets never match
+    std::vector<AlignedBox3d> bounds(numTets);
+    std::vector<Matrix3d>     toBarycentric(numTets);
+    std::vector<bool>         degenerate(numTets);
+    for (int t = 0; t < numTets; t++) {
+        const Vector3d &a = restPositions[tets[t][0]];
+        Matrix3d edges;
+        bounds[t] = AlignedBox3d(a);
+        for (int i = 1; i < 4; i++) {
+            edges.col(i - 1) = restPositions[tets[t][i]] - a;
+            bounds[t].extend(restPositions[tets[t][i]]);
+        }
+        degenerate[t] = std::abs(edges.determinant()) <= 1e-12 * edges.colwise().norm().prod();
+        if (!degenerate[t]) toBarycentric[t] = edges.inverse();
+    }
+    SpatialHash hash;
+    hash.build(bounds);
+
+    std::vector<Vector4i> corners(numVertices);
+    std::vector<Vector4f> weights(numVertices);
+    std::vector<double>   outsideDistances(numVertices);
+    int unbound = 0;
+
+    #pragma omp parallel for schedule(dynamic, 256) reduction(+ : unbound)
+    for (int v = 0; v < numVertices; v++) {
+        const Vector3d &point = vertices[v];
+        int      bestTet      = -1;
+        double   bestDistance = std::numeric_limits<double>::infinity();
+        Vector4d bestWeights;
+
+        // A tet within the search radius is always found, so the closest one is certain once it is that near
+        for (double radius = 0; bestDistance > radius && radius <= MAX_SEARCH_CELLS * hash.getCellSize();
+             radius = radius == 0 ? hash.getCellSize() : 2 * radius) {
+            hash.query(point, radius, [&](int t) {
+                if (degenerate[t]) return;
+                const Vector4i &tet = tets[t];
+                Vector3d lambda = toBarycentric[t] * (point - restPositions[tet[0]]);
+                Vector4d candidate(1 - lambda.sum(), lambda.x(), lambda.y(), lambda.z());
+
+                // Inside, prefer the tet the point is deepest in, which a negative distance ranks first
+                double distance = -candidate.minCoeff();
+                if (distance > 0) {
+                    const Vector3d tetCorners[4] = {restPositions[tet[0]], restPositions[tet[1]],
+                                                    restPositions[tet[2]], restPositions[tet[3]]};
+                    distance = distanceToTet(point, tetCorners);
+                }
+                if (distance < bestDistance || (distance == bestDistance && t < bestTet)) {
+                    bestTet      = t;
+                    bestDistance = distance;
+                    bestWeights  = candidate;
+                }
+            });
+        }
+        if (bestTet < 0) {
+            unbound++;
+            continue;
+        }
+        corners[v]          = tets[bestTet];
+        weights[v]          = bestWeights.cast<float>();
+        outsideDistances[v] = std::max(bestDistance, 0.0);
+    }
+    if (unbound > 0) {
+        std::cerr << unbound << " of " << numVertices << " render vertices are too far from every tet to embed"
+                  << std::endl;
+        return false;
+    }
+
+    // Rebase the corners onto the span of positions the tets use, which update() then reads alone
+    int first = std::numeric_limits<int>::max(), last = -1;
+    for (const Vector4i &tet : tets) {
+        first = std::min(first, tet.minCoeff());
+        last  = std::max(last, tet.maxCoeff());
+    }
+    for (Vector4i &tet : corners) tet.array() -= first;
+
+    m_firstPosition = first;
+    m_positionCount = last - first + 1;
+    m_corners = std::move(corners);
+    m_weights = std::move(weights);
+    m_outside = 0;
+    m_maxOutsideDistance = 0;
+    for (double distance : outsideDistances) {
+        m_outside += distance > 0;
+        m_maxOutsideDistance = std::max(m_maxOutsideDistance, distance);
+    }
+    return true;
+}
+
+void EmbeddedMesh::update(const std::vector<Eigen::Vector3d> &positions, std::vector<Eigen::Vector3d> &vertices)
+{
+    PROFILE_SCOPE("EmbeddedMesh::update");
+    const int numPositions = m_positionCount;
+    const int numVertices  = m_corners.size();
+    const Vector3d *source = positions.data() + m_firstPosition;
+    m_padded.resize(numPositions);
+    vertices.resize(numVertices);
+
+    #pragma omp parallel
+    {
+        #pragma omp for schedule(static)
+        for (int p = 0; p < numPositions; p++) {
+            m_padded[p] << source[p], 0;
+        }
+        #pragma omp for schedule(static)
+        for (int v = 0; v < numVertices; v++) {
+            const Vector4i &tet = m_corners[v];
+            const Vector4d  w   = m_weights[v].cast<double>();
+            Vector4d position = w[0] * m_padded[tet[0]] + w[1] * m_padded[tet[1]] +
+                                w[2] * m_padded[tet[2]] + w[3] * m_padded[tet[3]];
+            vertices[v] = position.head<3>();
+        }
+    }
+}
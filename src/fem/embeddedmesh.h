@@ -0,0 +1,54 @@
+#pragma once
+
+#include <vector>
+#include "Eigen/Dense"
+
+// A detailed render mesh carried along by a coarse tet mesh it sits in, so that what is drawn no longer has
+// to be what is simulated.
+//
+// bind() ties every render vertex to one tet of the rest shape, at fixed barycentric weights, through a
+// SpatialHash over the tets' bounds. A vertex on faces shared by several tets takes the one it is deepest in.
+// A vertex outside the tet mesh, which render surfaces slightly off the simulated one always have, takes the
+// closest tet and extrapolates from it.
+//
+// update() is then a weighted gather of four positions per render vertex. The positions the bound tets span
+// (one body's, in a multi-body scene) are first padded into Vector4d, so that each corner is one aligned vector
+// load and multiply-add, and the weights are kept in single precision, since they only place what is drawn.
+// The loop is bound by memory traffic, which is what both of these cut; its vertices are split over threads in
+// contiguous blocks.
+class EmbeddedMesh
+{
+public:
+    EmbeddedMesh();
+
+    // `tets` index into `restPositions`, and may be a subset of the tets over them (e.g. one body's). Returns
+    // false, binding nothing, if some vertex has no tet within MAX_SEARCH_CELLS hash cells of it.
+    bool bind(const std::vector<Eigen::Vector3d> &restPositions, const std::vector<Eigen::Vector4i> &tets,
+              const std::vector<Eigen::Vector3d> &vertices);
+
+    // Places the bound vertices in `vertices`, from the current positions of the tet vertices; only the span
+    // of `positions` the bound tets index is read
+    void update(const std::vector<Eigen::Vector3d> &positions, std::vector<Eigen::Vector3d> &vertices);
+
+    int getVertexCount()  const { return m_corners.size(); }
+    // Vertices that lie outside the tet they were bound to
+    int getOutsideCount() const { return m_outside; }
+    // Furthest any vertex lies outside its tet, in rest-shape units
+    double getMaxOutsideDistance() const { return m_maxOutsideDistance; }
+
+private:
+    // Vertices outside every tet search up to this many hash cells (about a tet each) away
+    static const int MAX_SEARCH_CELLS = 8;
+
+    // Span of the positions the bound tets use; m_corners index into it
+    int m_firstPosition;
+    int m_positionCount;
+
+    std::vector<Eigen::Vector4i> m_corners;
+    std::vector<Eigen::Vector4f> m_weights;
+    int    m_outside;
+    double m_maxOutsideDistance;
+
+    // update() scratch: the span's positions padded to four components
+    std::vector<Eigen::Vector4d> m_padded;
+};
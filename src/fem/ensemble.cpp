@@ -0,0 +1,311 @@
+#include "fem/ensemble.h"
+#include "fem/elementkernel.h"
+#include "profiling/profiler.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <limits>
+
+using namespace Eigen;
+
+namespace {
+
+double secondsSince(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// One value per member of a lockstep batch. Eigen vectorises fixed-size arrays, so every operation on these is
+// a few SIMD instructions (two AVX or one AVX-512 for LANES = 8) rather than a loop.
+using Lanes = Eigen::Array<double, Ensemble::LANES, 1>;
+
+struct LockstepParameters {
+    ElementKernel::Parameters<Lanes> material;
+    ElementKernel::Ground            ground;
+    Vector3d                         gravity;
+};
+
+// State of one lockstep batch; vertex values (and inverse masses) are indexed vertex * 3 + component, corner
+// forces (tet * 4 + corner) * 3 + component
+struct LockstepState {
+    std::vector<Lanes> positions;
+    std::vector<Lanes> velocities;
+    std::vector<Lanes> midPositions;
+    std::vector<Lanes> midVelocities;
+    std::vector<Lanes> forces;
+    std::vector<Lanes> cornerForces;
+    std::vector<Lanes> masses;
+    std::vector<Lanes> inverseMasses;
+};
+
+// FemSolver::computeForces for a whole batch at once: the same element kernel, gathered through the
+// vertex -> corner CSR, plus gravity and the ground. Every index and every rest-shape value is loaded once for
+// all lanes.
+void computeLockstepForces(const FemMesh &mesh, const LockstepParameters &parameters,
+                           const std::vector<Lanes> &positions, const std::vector<Lanes> &velocities,
+                           std::vector<Lanes> &forces, LockstepState &state)
+{
+    const int numTets = mesh.tets.size();
+    for (int t = 0; t < numTets; t++) {
+        const Vector4i &tet = mesh.tets[t];
+        ElementKernel::computeElementForces(mesh.restInverse[t], mesh.restVolume[t], parameters.material,
+                                            [&](int corner, int c) -> const Lanes & {
+                                                return positions[tet[corner] * 3 + c];
+                                            },
+                                            [&](int corner, int c) -> const Lanes & {
+                                                return velocities[tet[corner] * 3 + c];
+                                            },
+                                            &state.cornerForces[t * 12]);
+    }
+
+    const int numVertices = mesh.vertexCount;
+    for (int v = 0; v < numVertices; v++) {
+        Lanes force[3] = {Lanes::Zero(), Lanes::Zero(), Lanes::Zero()};
+        for (int k = mesh.vertexCornerStart[v]; k < mesh.vertexCornerStart[v + 1]; k++) {
+            const Lanes *corner = &state.cornerForces[mesh.vertexCorners[k] * 3];
+            force[0] += corner[0];
+            force[1] += corner[1];
+            force[2] += corner[2];
+        }
+
+        Lanes acceleration[3] = {Lanes::Constant(parameters.gravity.x()), Lanes::Constant(parameters.gravity.y()),
+                                 Lanes::Constant(parameters.gravity.z())};
+        ElementKernel::addGroundAcceleration(parameters.ground, positions[v * 3 + 1], &velocities[v * 3],
+                                             acceleration);
+        for (int c = 0; c < 3; c++) {
+            forces[v * 3 + c] = force[c] + state.masses[v] * acceleration[c];
+        }
+    }
+}
+}
+
+Ensemble::Ensemble()
+    : m_seconds(0)
+{
+}
+
+void Ensemble::init(const Scene &scene, const std::vector<std::vector<Material>> &memberMaterials)
+{
+    PROFILE_SCOPE("Ensemble::init");
+
+    m_mesh          = std::make_shared<const FemMesh>(scene);
+    m_restPositions = scene.getRestPositions();
+    m_members.clear();
+    m_members.resize(memberMaterials.size());
+    m_memberMaterials.clear();
+    for (size_t m = 0; m < m_members.size(); m++) {
+        m_members[m].solver = std::make_unique<FemSolver>();
+        m_members[m].solver->init(m_mesh, memberMaterials[m]);
+        m_memberMaterials.push_back(memberMaterials[m].empty() ? Material() : memberMaterials[m][0]);
+    }
+    reset();
+}
+
+void Ensemble::reset()
+{
+    for (Member &member : m_members) {
+        member.positions = m_restPositions;
+        member.velocities.assign(m_restPositions.size(), Vector3d::Zero());
+        member.result = Result();
+    }
+}
+
+bool Ensemble::supportsLockstep() const
+{
+    if (m_members.empty() || m_mesh->bodyCount != 1) return false;
+
+    const FemSolver &first = *m_members[0].solver;
+    for (const Member &member : m_members) {
+        const FemSolver &solver = *member.solver;
+        if (solver.hasColliders() || solver.getContinuousCollision() || solver.getSelfCollision() ||
+            solver.getIntegrator() != FemSolver::Integrator::Midpoint) {
+            return false;
+        }
+        // The kernel takes these from the first member, so every member must agree
+        if (solver.getGravity() != first.getGravity() || solver.getGroundHeight() != first.getGroundHeight()) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void Ensemble::run(int steps, double dt, Schedule schedule)
+{
+    PROFILE_SCOPE("Ensemble::run");
+    auto start = std::chrono::steady_clock::now();
+    const int numMembers = m_members.size();
+
+    if (schedule == Schedule::Lockstep && !supportsLockstep()) {
+        std::cerr << "Ensemble: scene needs more than gravity and the ground, running members concurrently instead "
+                     "of in lockstep" << std::endl;
+        schedule = Schedule::Concurrent;
+    }
+
+    switch (schedule) {
+    case Schedule::Concurrent:
+        // The solvers' own parallel loops are nested in this one, so each runs on the thread that owns it.
+        // Members can take very different times (stiffer ones, or ones in contact), hence dynamic scheduling.
+        #pragma omp parallel for schedule(dynamic, 1)
+        for (int m = 0; m < numMembers; m++) {
+            runMember(m_members[m], steps, dt);
+        }
+        break;
+    case Schedule::Sequential:
+        for (int m = 0; m < numMembers; m++) {
+            runMember(m_members[m], steps, dt);
+        }
+        break;
+    case Schedule::Lockstep: {
+        const int numBatches = (numMembers + LANES - 1) / LANES;
+        #pragma omp parallel for schedule(dynamic, 1)
+        for (int b = 0; b < numBatches; b++) {
+            runBatch(b * LANES, steps, dt);
+        }
+        break;
+    }
+    }
+
+    m_seconds = secondsSince(start);
+}
+
+void Ensemble::runMember(Member &member, int steps, double dt)
+{
+    auto start = std::chrono::steady_clock::now();
+    Result &result = member.result;
+
+    for (int s = 0; s < steps && result.stable; s++) {
+        member.solver->step(member.positions, member.velocities, dt);
+        result.steps++;
+        if (result.steps % STABILITY_CHECK_STEPS == 0) {
+            result.stable = isFinite(member.positions) && isFinite(member.velocities);
+        }
+    }
+    result.stable = result.stable && isFinite(member.positions) && isFinite(member.velocities);
+    result.seconds += secondsSince(start);
+
+    computeMetrics(member);
+}
+
+void Ensemble::runBatch(int first, int steps, double dt)
+{
+    auto start = std::chrono::steady_clock::now();
+    const int count = std::min<int>(LANES, m_members.size() - first);
+    const int numVertices = m_mesh->vertexCount;
+    const int numValues   = numVertices * 3;
+
+    // A short last batch repeats its last member in the spare lanes, whose results are then dropped
+    auto member = [&](int lane) -> Member & { return m_members[first + std::min(lane, count - 1)]; };
+
+    LockstepParameters parameters;
+    for (int l = 0; l < LANES; l++) {
+        const Material &material = m_memberMaterials[first + std::min(l, count - 1)];
+        parameters.material.lambda[l]    = material.getLambda();
+        parameters.material.mu[l]        = material.getMu();
+        parameters.material.viscosity[l] = material.viscosity;
+    }
+    const FemSolver &solver = *member(0).solver;
+    parameters.gravity = solver.getGravity();
+    parameters.ground  = {solver.getGroundHeight(), solver.getGroundStiffness(), solver.getGroundDamping(),
+                          solver.getGroundFriction()};
+
+    LockstepState state;
+    state.positions.resize(numValues);
+    state.velocities.resize(numValues);
+    state.midPositions.resize(numValues);
+    state.midVelocities.resize(numValues);
+    state.forces.resize(numValues);
+    state.cornerForces.resize(m_mesh->tets.size() * 12);
+    state.masses.resize(numVertices);
+    state.inverseMasses.resize(numValues);
+    for (int l = 0; l < LANES; l++) {
+        const Member &source = member(l);
+        const std::vector<double> &masses = source.solver->getMasses();
+        for (int v = 0; v < numVertices; v++) {
+            for (int c = 0; c < 3; c++) {
+                state.positions[v * 3 + c][l]     = source.positions[v][c];
+                state.velocities[v * 3 + c][l]    = source.velocities[v][c];
+                state.inverseMasses[v * 3 + c][l] = masses[v] > 0 ? 1 / masses[v] : 0;
+            }
+            state.masses[v][l] = masses[v];
+        }
+    }
+
+    // Every lane steps for the whole run, but a lane that has blown up stops counting steps
+    std::vector<bool> stable(LANES);
+    for (int l = 0; l < LANES; l++) {
+        stable[l] = member(l).result.stable;
+    }
+    std::vector<int> stepsTaken(LANES, 0);
+
+    for (int s = 0; s < steps; s++) {
+        ElementKernel::stepMidpoint(state.positions, state.velocities, state.midPositions, state.midVelocities,
+                                    state.forces, state.inverseMasses, dt,
+                                    [&](const std::vector<Lanes> &positions, const std::vector<Lanes> &velocities,
+                                        std::vector<Lanes> &forces) {
+                                        computeLockstepForces(*m_mesh, parameters, positions, velocities, forces,
+                                                              state);
+                                    });
+
+        for (int l = 0; l < LANES; l++) {
+            if (stable[l]) stepsTaken[l]++;
+        }
+        if ((s + 1) % STABILITY_CHECK_STEPS == 0) {
+            // Anything non-finite turns its lane's sum NaN, while finite values all add 0
+            Lanes probe = Lanes::Zero();
+            for (int i = 0; i < numValues; i++) {
+                probe += 0.0 * state.positions[i] + 0.0 * state.velocities[i];
+            }
+            for (int l = 0; l < LANES; l++) {
+                stable[l] = stable[l] && probe[l] == 0.0;
+            }
+        }
+    }
+
+    const double seconds = secondsSince(start);
+    for (int l = 0; l < count; l++) {
+        Member &target = m_members[first + l];
+        for (int v = 0; v < numVertices; v++) {
+            for (int c = 0; c < 3; c++) {
+                target.positions[v][c]  = state.positions[v * 3 + c][l];
+                target.velocities[v][c] = state.velocities[v * 3 + c][l];
+            }
+        }
+        Result &result = target.result;
+        result.steps  += stepsTaken[l];
+        result.stable  = stable[l] && isFinite(target.positions) && isFinite(target.velocities);
+        result.seconds += seconds;
+        computeMetrics(target);
+    }
+}
+
+void Ensemble::computeMetrics(Member &member)
+{
+    Result &result = member.result;
+    if (!result.stable) {
+        result.kineticEnergy = result.maxSpeed = result.centroidHeight = result.lowestPoint = std::nan("");
+        return;
+    }
+
+    const std::vector<double> &masses = member.solver->getMasses();
+    const int numVertices = member.positions.size();
+    result.kineticEnergy  = 0;
+    result.maxSpeed       = 0;
+    result.centroidHeight = 0;
+    result.lowestPoint    = numVertices > 0 ? std::numeric_limits<double>::infinity() : 0;
+    for (int v = 0; v < numVertices; v++) {
+        result.kineticEnergy  += 0.5 * masses[v] * member.velocities[v].squaredNorm();
+        result.maxSpeed        = std::max(result.maxSpeed, member.velocities[v].norm());
+        result.centroidHeight += member.positions[v].y() / numVertices;
+        result.lowestPoint     = std::min(result.lowestPoint, member.positions[v].y());
+    }
+}
+
+bool Ensemble::isFinite(const std::vector<Eigen::Vector3d> &values)
+{
+    for (const Vector3d &value : values) {
+        if (!value.allFinite()) return false;
+    }
+    return true;
+}
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+#include "Eigen/Dense"
+
+#include "fem/femmesh.h"
+#include "fem/femsolver.h"
+#include "fem/material.h"
+#include "fem/scene.h"
+
+// Many independent runs of one scene that differ only in their materials, e.g. a sweep over Young's modulus,
+// Poisson ratio and viscosity.
+//
+// The rest shape and topology (FemMesh) are precomputed once and shared read-only by every member's solver;
+// a member only owns what depends on its material or state: masses, positions, velocities and solver scratch.
+//
+// How members are spread over the hardware is the Schedule:
+//   Concurrent  each thread takes whole members, stepping each to the end on its own, so threads never wait
+//               on each other between steps and no mutable data is shared
+//   Sequential  one member after another with every thread on each; the baseline the others are measured
+//               against, and the worst choice for small meshes whose loops are too short to split well
+//   Lockstep    LANES members at a time advance together, their state laid out [vertex][component][member]
+//               so that one SIMD instruction does the same arithmetic for every member of the batch. The
+//               members share every index and rest-shape load, and threads take whole batches. The
+//               arithmetic is FemSolver's own (ElementKernel), so members end where the other schedules put
+//               them. Only gravity and the ground are supported, so scenes with other obstacles, several
+//               bodies or self-collision fall back to Concurrent.
+class Ensemble
+{
+public:
+    enum class Schedule { Concurrent, Sequential, Lockstep };
+
+    // Members per lockstep batch: one AVX-512 register of doubles, or two AVX ones
+    static const int LANES = 8;
+
+    struct Result {
+        int    steps   = 0;    // Taken before finishing or blowing up
+        bool   stable  = true; // Every position stayed finite
+        double seconds = 0;    // Wall time of this member's run; for lockstep, its batch's
+        // At the end of the run; NaN for unstable runs
+        double kineticEnergy  = 0;
+        double maxSpeed       = 0;
+        double centroidHeight = 0; // Of all vertices, unweighted
+        double lowestPoint    = 0;
+    };
+
+    Ensemble();
+
+    // One member per entry of `memberMaterials`, each holding a material per scene body
+    void init(const Scene &scene, const std::vector<std::vector<Material>> &memberMaterials);
+
+    int getMemberCount() const { return m_members.size(); }
+    // For applying settings (gravity, colliders, reduction, ...) before run()
+    FemSolver &getSolver(int member) { return *m_members[member].solver; }
+    const std::shared_ptr<const FemMesh> &getMesh() const { return m_mesh; }
+
+    // Whether the scene and every member's settings fit the lockstep kernel
+    bool supportsLockstep() const;
+
+    // Steps every member from its current state. A member whose state stops being finite is stopped early
+    // (in lockstep, it keeps stepping with its batch but its results stop counting).
+    void run(int steps, double dt, Schedule schedule = Schedule::Concurrent);
+
+    // Puts every member back at the rest shape with zero velocity
+    void reset();
+
+    const Result &getResult(int member) const { return m_members[member].result; }
+    const std::vector<Eigen::Vector3d> &getPositions(int member) const { return m_members[member].positions; }
+    double getSeconds() const { return m_seconds; } // Wall time of the last run()
+
+private:
+    // How often a running member checks for a blow-up
+    static const int STABILITY_CHECK_STEPS = 100;
+
+    struct Member {
+        std::unique_ptr<FemSolver>   solver;
+        std::vector<Eigen::Vector3d> positions;
+        std::vector<Eigen::Vector3d> velocities;
+        Result                       result;
+    };
+
+    void runMember(Member &member, int steps, double dt);
+    void runBatch(int first, int steps, double dt);
+    static void computeMetrics(Member &member);
+    static bool isFinite(const std::vector<Eigen::Vector3d> &values);
+
+    std::shared_ptr<const FemMesh> m_mesh;
+    std::vector<Eigen::Vector3d>   m_restPositions;
+    std::vector<Member>            m_members;
+    std::vector<Material>          m_memberMaterials; // Body 0's material of each member, for the lockstep kernel
+    double                         m_seconds;
+};
@@ -0,0 +1,65 @@
+#include "fem/femmesh.h"
+#include "fem/systemmatrix.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+using namespace Eigen;
+
+FemMesh::FemMesh(const Scene &scene)
+    : vertexCount(scene.getVertexCount()),
+      bodyCount(scene.getBodyCount()),
+      restPositions(scene.getRestPositions()),
+      tets(scene.getTets()),
+      faces(scene.getFaces()),
+      vertexBodies(scene.getVertexBodies())
+{
+    tetBodies.resize(tets.size());
+    for (int b = 0; b < bodyCount; b++) {
+        const Scene::Body &body = scene.getBody(b);
+        std::fill(tetBodies.begin() + body.tetStart, tetBodies.begin() + body.tetStart + body.tetCount, b);
+    }
+
+    restInverse.resize(tets.size());
+    restVolume.resize(tets.size());
+    for (size_t t = 0; t < tets.size(); t++) {
+        const Vector4i &tet = tets[t];
+        Matrix3d edges;
+        edges << restPositions[tet[1]] - restPositions[tet[0]],
+                 restPositions[tet[2]] - restPositions[tet[0]],
+                 restPositions[tet[3]] - restPositions[tet[0]];
+        double volume = edges.determinant() / 6;
+        if (volume <= 0) {
+            std::cerr << "Tet " << t << " is inverted or degenerate in the rest pose" << std::endl;
+        }
+        restInverse[t] = edges.inverse();
+        restVolume[t]  = std::abs(volume);
+    }
+
+    // Counting sort of corners by vertex; filling in corner order keeps each vertex's list ascending
+    vertexCornerStart.assign(vertexCount + 1, 0);
+    for (const Vector4i &tet : tets) {
+        for (int i = 0; i < 4; i++) vertexCornerStart[tet[i] + 1]++;
+    }
+    for (int v = 0; v < vertexCount; v++) {
+        vertexCornerStart[v + 1] += vertexCornerStart[v];
+    }
+    vertexCorners.resize(tets.size() * 4);
+    std::vector<int> next(vertexCornerStart.begin(), vertexCornerStart.end() - 1);
+    for (size_t t = 0; t < tets.size(); t++) {
+        for (int i = 0; i < 4; i++) {
+            vertexCorners[next[tets[t][i]]++] = t * 4 + i;
+        }
+    }
+}
+
+FemMesh::~FemMesh()
+{
+}
+
+const SystemPattern &FemMesh::getSystemPattern() const
+{
+    std::call_once(m_systemPatternOnce, [this]() { m_systemPattern = std::make_unique<SystemPattern>(*this); });
+    return *m_systemPattern;
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "Eigen/Dense"
+
+#include "fem/scene.h"
+
+struct SystemPattern;
+
+// What a FemSolver precomputes from a scene's rest shape and topology: everything that depends neither on the
+// bodies' materials nor on the state. Solvers hold it through a shared pointer to const, so any number of runs
+// over the same scene (see Ensemble) share one copy and only duplicate their own state.
+struct FemMesh
+{
+    explicit FemMesh(const Scene &scene);
+    ~FemMesh();
+
+    int vertexCount;
+    int bodyCount;
+
+    std::vector<Eigen::Vector3d> restPositions;
+    std::vector<Eigen::Vector4i> tets;
+    std::vector<Eigen::Matrix3d> restInverse; // Inverse of the rest-shape edge matrix of each tet
+    std::vector<double>          restVolume;
+    std::vector<int>             tetBodies;
+
+    // Vertex -> corner CSR: the corners (tet * 4 + i) touching vertex v are
+    // vertexCorners[vertexCornerStart[v] .. vertexCornerStart[v + 1]), in ascending order
+    std::vector<int> vertexCornerStart;
+    std::vector<int> vertexCorners;
+
+    // Every body's surface, and the body of every vertex, for contact
+    std::vector<Eigen::Vector3i> faces;
+    std::vector<int>             vertexBodies;
+
+    // The implicit system's sparsity pattern, built by whichever solver needs it first and shared by all of them
+    const SystemPattern &getSystemPattern() const;
+
+private:
+    mutable std::once_flag                 m_systemPatternOnce;
+    mutable std::unique_ptr<SystemPattern> m_systemPattern;
+};
@@ -0,0 +1,520 @@
+#include "fem/femsolver.h"
+#include "collision/continuouscollision.h"
+#include "profiling/profiler.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+using namespace Eigen;
+
+namespace {
+
+double secondsSince(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+}
+
+FemSolver::FemSolver()
+    : m_mesh(std::make_shared<const FemMesh>(Scene())),
+      m_gravity(0, -9.81, 0),
+      m_groundHeight(0),
+      m_groundStiffness(1e4),
+      m_groundDamping(50),
+      m_groundFriction(10),
+      m_selfCollisionEnabled(false),
+      m_selfCollisionReady(false),
+      m_continuousCollision(false),
+      m_ccdSeparation(1e-4),
+      m_reduction(Reduction::Deterministic),
+      m_integrator(Integrator::Midpoint),
+      m_assembly(Assembly::Cached),
+      m_systemReady(false),
+      m_forceSeconds(0),
+      m_forceEvaluations(0),
+      m_threadTiming(false),
+      m_threadBusySeconds(0),
+      m_threadAvailableSeconds(0),
+      m_ccdSeconds(0),
+      m_ccdImpacts(0),
+      m_assemblySeconds(0),
+      m_linearSolveSeconds(0),
+      m_linearSolveIterations(0),
+      m_implicitFallbacks(0)
+{
+    m_linearSolver.setTolerance(1e-8);
+}
+
+int FemSolver::getThreadCount()
+{
+#ifdef _OPENMP
+    return omp_get_max_threads();
+#else
+    return 1;
+#endif
+}
+
+void FemSolver::setThreadCount(int threads)
+{
+#ifdef _OPENMP
+    static const int defaultThreads = omp_get_max_threads();
+    omp_set_num_threads(threads > 0 ? threads : defaultThreads);
+#endif
+}
+
+void FemSolver::init(const std::vector<Eigen::Vector3d> &restPositions,
+                     const std::vector<Eigen::Vector4i> &tets,
+                     const Material &material)
+{
+    Scene scene;
+    scene.addBody(restPositions, tets, material);
+    init(scene);
+}
+
+void FemSolver::init(const Scene &scene)
+{
+    std::vector<Material> materials(scene.getBodyCount());
+    for (int b = 0; b < scene.getBodyCount(); b++) materials[b] = scene.getBody(b).material;
+    init(std::make_shared<const FemMesh>(scene), materials);
+}
+
+void FemSolver::init(std::shared_ptr<const FemMesh> mesh, const std::vector<Material> &bodyMaterials)
+{
+    m_mesh = std::move(mesh);
+    const int numVertices = m_mesh->vertexCount;
+    const std::vector<Vector4i> &tets = m_mesh->tets;
+
+    m_bodyMaterials.resize(m_mesh->bodyCount);
+    for (int b = 0; b < m_mesh->bodyCount; b++) {
+        const Material &material = bodyMaterials[b];
+        m_bodyMaterials[b] = {material.getLambda(), material.getMu(), material.viscosity};
+    }
+
+    m_masses.assign(numVertices, 0);
+    for (size_t t = 0; t < tets.size(); t++) {
+        double mass = bodyMaterials[m_mesh->tetBodies[t]].density * m_mesh->restVolume[t] / 4;
+        for (int i = 0; i < 4; i++) m_masses[tets[t][i]] += mass;
+    }
+
+    // Vertices that belong to no tet stay where they are
+    m_inverseMasses.resize(numVertices);
+    for (int v = 0; v < numVertices; v++) {
+        m_inverseMasses[v] = m_masses[v] > 0 ? 1 / m_masses[v] : 0;
+    }
+
+    m_cornerForces.resize(tets.size() * 4);
+    m_forces.resize(numVertices);
+    m_midPositions.resize(numVertices);
+    m_midVelocities.resize(numVertices);
+    m_stiffnessVelocities.resize(numVertices);
+    m_selfCollisionReady = false;
+    m_systemReady        = false;
+    resetTimings();
+}
+
+// ================== Forces
+
+void FemSolver::computeForces(const std::vector<Eigen::Vector3d> &positions,
+                              const std::vector<Eigen::Vector3d> &velocities,
+                              std::vector<Eigen::Vector3d>       &forces)
+{
+    PROFILE_SCOPE("FemSolver::computeForces");
+    auto start = std::chrono::steady_clock::now();
+
+    const int numVertices = positions.size();
+    const int numTets     = m_mesh->tets.size();
+    forces.resize(numVertices);
+
+    const bool deterministic = m_reduction == Reduction::Deterministic;
+    if (!deterministic) {
+        #pragma omp parallel for schedule(static)
+        for (int v = 0; v < numVertices; v++) {
+            forces[v].setZero();
+        }
+    }
+
+    // With thread timing on, each thread times its share of the element loop, so load imbalance shows up as
+    // idle time
+    const bool threadTiming = m_threadTiming;
+    std::chrono::steady_clock::time_point elementStart;
+    if (threadTiming) elementStart = std::chrono::steady_clock::now();
+    #pragma omp parallel
+    {
+        std::chrono::steady_clock::time_point threadStart;
+        if (threadTiming) threadStart = std::chrono::steady_clock::now();
+        if (deterministic) {
+            #pragma omp for schedule(static) nowait
+            for (int t = 0; t < numTets; t++) {
+                computeElementForces(positions, velocities, t, &m_cornerForces[4 * t]);
+            }
+        } else {
+            #pragma omp for schedule(static) nowait
+            for (int t = 0; t < numTets; t++) {
+                Vector3d corners[4];
+                computeElementForces(positions, velocities, t, corners);
+                for (int i = 0; i < 4; i++) {
+                    Vector3d &f = forces[m_mesh->tets[t][i]];
+                    for (int c = 0; c < 3; c++) {
+                        #pragma omp atomic
+                        f[c] += corners[i][c];
+                    }
+                }
+            }
+        }
+        if (threadTiming) {
+            double busy = secondsSince(threadStart);
+            #pragma omp atomic
+            m_threadBusySeconds += busy;
+        }
+    }
+    if (threadTiming) m_threadAvailableSeconds += secondsSince(elementStart) * getThreadCount();
+
+    if (deterministic) {
+        const std::vector<int> &cornerStart = m_mesh->vertexCornerStart;
+        const std::vector<int> &corners     = m_mesh->vertexCorners;
+        #pragma omp parallel for schedule(static)
+        for (int v = 0; v < numVertices; v++) {
+            Vector3d sum = Vector3d::Zero();
+            for (int i = cornerStart[v]; i < cornerStart[v + 1]; i++) {
+                sum += m_cornerForces[corners[i]];
+            }
+            forces[v] = sum;
+        }
+    }
+
+    addExternalForces(positions, velocities, forces);
+
+    if (needsContacts()) {
+        if (!m_selfCollisionReady) {
+            m_selfCollision.init(m_mesh->faces, m_mesh->restPositions, m_mesh->vertexBodies);
+            m_selfCollisionReady = true;
+        }
+        m_selfCollision.setSameBodyContacts(m_selfCollisionEnabled);
+        m_selfCollision.addForces(positions, velocities, m_masses, forces);
+    }
+
+    m_forceSeconds += secondsSince(start);
+    m_forceEvaluations++;
+}
+
+void FemSolver::computeElementForces(const std::vector<Eigen::Vector3d> &positions,
+                                     const std::vector<Eigen::Vector3d> &velocities,
+                                     int tet, Eigen::Vector3d corners[4]) const
+{
+    const Vector4i &indices = m_mesh->tets[tet];
+    double forces[12];
+    ElementKernel::computeElementForces(m_mesh->restInverse[tet], m_mesh->restVolume[tet],
+                                        m_bodyMaterials[m_mesh->tetBodies[tet]],
+                                        [&](int corner, int c) { return positions[indices[corner]][c]; },
+                                        [&](int corner, int c) { return velocities[indices[corner]][c]; }, forces);
+    for (int i = 0; i < 4; i++) corners[i] = Map<const Vector3d>(&forces[i * 3]);
+}
+
+void FemSolver::addExternalForces(const std::vector<Eigen::Vector3d> &positions,
+                                  const std::vector<Eigen::Vector3d> &velocities,
+                                  std::vector<Eigen::Vector3d>       &forces) const
+{
+    PROFILE_SCOPE("FemSolver::addExternalForces");
+    const int numVertices = positions.size();
+
+    // Penalty response along the contact normal, with friction on the tangential velocity
+    auto addContact = [&](Vector3d &acceleration, const Vector3d &velocity, const Vector3d &normal, double depth) {
+        double normalSpeed = velocity.dot(normal);
+        acceleration += (m_groundStiffness * depth - m_groundDamping * std::min(normalSpeed, 0.0)) * normal;
+        acceleration -= m_groundFriction * (velocity - normalSpeed * normal);
+    };
+
+    const ElementKernel::Ground ground = {m_groundHeight, m_groundStiffness, m_groundDamping, m_groundFriction};
+    #pragma omp parallel for schedule(static)
+    for (int v = 0; v < numVertices; v++) {
+        Vector3d acceleration = m_gravity;
+        ElementKernel::addGroundAcceleration(ground, positions[v].y(), velocities[v].data(), acceleration.data());
+
+        m_sphereHash.query(positions[v], 0, [&](int s) {
+            Vector3d offset   = positions[v] - m_spheres[s].centre;
+            double   distance = offset.norm();
+            if (distance >= m_spheres[s].radius || distance == 0) return;
+            addContact(acceleration, velocities[v], offset / distance, m_spheres[s].radius - distance);
+        });
+
+        for (const SignedDistanceField *sdf : m_sdfs) {
+            double   distance;
+            Vector3d normal;
+            if (sdf->sample(positions[v], distance, normal) && distance < 0) {
+                addContact(acceleration, velocities[v], normal, -distance);
+            }
+        }
+        forces[v] += m_masses[v] * acceleration;
+    }
+}
+
+void FemSolver::setSphereColliders(const std::vector<SphereCollider> &spheres)
+{
+    m_spheres = spheres;
+    std::vector<AlignedBox3d> bounds(spheres.size());
+    for (size_t s = 0; s < spheres.size(); s++) bounds[s] = spheres[s].getBounds();
+    m_sphereHash.build(bounds);
+}
+
+// ================== Integration
+
+void FemSolver::step(std::vector<Eigen::Vector3d> &positions, std::vector<Eigen::Vector3d> &velocities, double dt)
+{
+    PROFILE_SCOPE("FemSolver::step");
+    if (m_continuousCollision) m_stepStart = positions;
+
+    switch (m_integrator) {
+    case Integrator::Midpoint:      stepMidpoint(positions, velocities, dt);      break;
+    case Integrator::ImplicitEuler: stepImplicitEuler(positions, velocities, dt); break;
+    }
+
+    if (m_continuousCollision) resolveContinuousCollisions(positions, velocities);
+}
+
+void FemSolver::stepMidpoint(std::vector<Eigen::Vector3d> &positions, std::vector<Eigen::Vector3d> &velocities,
+                             double dt)
+{
+    ElementKernel::stepMidpoint(positions, velocities, m_midPositions, m_midVelocities, m_forces, m_inverseMasses, dt,
+                                [&](const std::vector<Vector3d> &statePositions,
+                                    const std::vector<Vector3d> &stateVelocities,
+                                    std::vector<Vector3d>       &forces) {
+                                    computeForces(statePositions, stateVelocities, forces);
+                                });
+}
+
+void FemSolver::stepImplicitEuler(std::vector<Eigen::Vector3d> &positions, std::vector<Eigen::Vector3d> &velocities,
+                                  double dt)
+{
+    const int numVertices = positions.size();
+
+    computeForces(positions, velocities, m_forces);
+    assembleSystem(positions, velocities, dt);
+
+    m_rhs.resize(3 * numVertices);
+    #pragma omp parallel for schedule(static)
+    for (int v = 0; v < numVertices; v++) {
+        m_rhs.segment<3>(3 * v) = dt * (m_forces[v] + dt * m_stiffnessVelocities[v]);
+    }
+
+    {
+        PROFILE_SCOPE("FemSolver::stepImplicitEuler/solve");
+        auto start = std::chrono::steady_clock::now();
+        m_linearSolver.compute(m_system.getMatrix());
+        m_velocityChange = m_linearSolver.solve(m_rhs);
+        m_linearSolveSeconds    += secondsSince(start);
+        m_linearSolveIterations += m_linearSolver.iterations();
+    }
+
+    // Positions and velocities are untouched so far, so an unsolved system costs one explicit step instead
+    if (m_linearSolver.info() != Eigen::Success) {
+        if (m_implicitFallbacks++ == 0) {
+            std::cerr << "Conjugate gradients failed after " << m_linearSolver.iterations()
+                      << " iterations (error " << m_linearSolver.error() << "); taking explicit midpoint steps "
+                      << "where that happens" << std::endl;
+        }
+        stepMidpoint(positions, velocities, dt);
+        return;
+    }
+
+    #pragma omp parallel for schedule(static)
+    for (int v = 0; v < numVertices; v++) {
+        velocities[v] += m_velocityChange.segment<3>(3 * v);
+        positions[v]  += dt * velocities[v];
+    }
+}
+
+void FemSolver::assembleSystem(const std::vector<Eigen::Vector3d> &positions,
+                               const std::vector<Eigen::Vector3d> &velocities, double dt)
+{
+    PROFILE_SCOPE("FemSolver::assembleSystem");
+    auto start = std::chrono::steady_clock::now();
+    const int numVertices = positions.size();
+
+    if (!m_systemReady) {
+        m_system.init(m_mesh->getSystemPattern());
+        m_systemReady = true;
+    }
+
+    // Each tet leaves its share of K v in its own corners, so these can be written concurrently
+    auto element = [&](int tet, SystemMatrix::ElementMatrix &matrix) {
+        computeElementJacobian(positions, velocities, tet, dt, matrix, &m_cornerForces[4 * tet]);
+    };
+    if (m_assembly == Assembly::Cached) {
+        m_system.assemble(element);
+    } else {
+        m_system.assembleFromTriplets(*m_mesh, element);
+    }
+
+    // Mass and ground contact are per vertex, so only touch the diagonal
+    const std::vector<int> &cornerStart = m_mesh->vertexCornerStart;
+    const std::vector<int> &corners     = m_mesh->vertexCorners;
+    #pragma omp parallel for schedule(static)
+    for (int v = 0; v < numVertices; v++) {
+        Vector3d stiffnessVelocity = Vector3d::Zero();
+        for (int i = cornerStart[v]; i < cornerStart[v + 1]; i++) {
+            stiffnessVelocity += m_cornerForces[corners[i]];
+        }
+
+        // A vertex outside every tet gets an identity row and a zero right-hand side, so it stays put
+        const double mass = m_masses[v];
+        Vector3d diagonal = Vector3d::Constant(mass > 0 ? mass : 1);
+
+        // The ground's acceleration is k depth - d min(v_y, 0) up, and -friction v sideways
+        double depth = m_groundHeight - positions[v].y();
+        if (depth > 0 && mass > 0) {
+            diagonal.y() += dt * dt * mass * m_groundStiffness;
+            if (velocities[v].y() < 0) diagonal.y() += dt * mass * m_groundDamping;
+            diagonal.x() += dt * mass * m_groundFriction;
+            diagonal.z() += dt * mass * m_groundFriction;
+            stiffnessVelocity.y() -= mass * m_groundStiffness * velocities[v].y();
+        }
+
+        m_stiffnessVelocities[v] = stiffnessVelocity;
+        for (int i = 0; i < 3; i++) m_system.addDiagonal(3 * v + i, diagonal[i]);
+    }
+
+    m_assemblySeconds += secondsSince(start);
+}
+
+void FemSolver::computeElementJacobian(const std::vector<Eigen::Vector3d> &positions,
+                                       const std::vector<Eigen::Vector3d> &velocities,
+                                       int tet, double dt, SystemMatrix::ElementMatrix &matrix,
+                                       Eigen::Vector3d stiffnessVelocity[4]) const
+{
+    const Vector4i &indices = m_mesh->tets[tet];
+    const Matrix3d &restInverse = m_mesh->restInverse[tet];
+
+    Matrix3d edges, edgeVelocities;
+    edges << positions[indices[1]] - positions[indices[0]],
+             positions[indices[2]] - positions[indices[0]],
+             positions[indices[3]] - positions[indices[0]];
+    edgeVelocities << velocities[indices[1]] - velocities[indices[0]],
+                      velocities[indices[2]] - velocities[indices[0]],
+                      velocities[indices[3]] - velocities[indices[0]];
+    Matrix3d F    = edges * restInverse;
+    Matrix3d Fdot = edgeVelocities * restInverse;
+
+    const ElementMaterial &material = m_bodyMaterials[m_mesh->tetBodies[tet]];
+    Matrix3d strain = 0.5 * (F.transpose() * F - Matrix3d::Identity());
+    Matrix3d stress = 2 * material.mu * strain + material.lambda * strain.trace() * Matrix3d::Identity();
+
+    // F moves with corner a's position as dF = dx g_a^T, and corner a's force is -V P g_a
+    Vector3d gradients[4];
+    for (int a = 1; a < 4; a++) gradients[a] = restInverse.row(a - 1).transpose();
+    gradients[0] = -(gradients[1] + gradients[2] + gradients[3]);
+
+    // Change in the first Piola-Kirchhoff stress for a change in F (elastic) or in its rate (viscous). The
+    // viscous stress's own dependence on F is left out of K.
+    auto elasticDifferential = [&](const Matrix3d &dF) -> Matrix3d {
+        Matrix3d dStrain = 0.5 * (dF.transpose() * F + F.transpose() * dF);
+        return dF * stress + F * (2 * material.mu * dStrain + material.lambda * dStrain.trace() * Matrix3d::Identity());
+    };
+    auto viscousDifferential = [&](const Matrix3d &dFdot) -> Matrix3d {
+        return F * (material.viscosity * (F.transpose() * dFdot + dFdot.transpose() * F));
+    };
+
+    // Column (b, j) is the change in every corner's force, scaled into -dt D - dt^2 K, for a unit move of
+    // corner b along axis j
+    const double volume = m_mesh->restVolume[tet];
+    for (int b = 0; b < 4; b++) {
+        for (int j = 0; j < 3; j++) {
+            Matrix3d dF = Matrix3d::Zero();
+            dF.row(j) = gradients[b].transpose();
+            Matrix3d dP = dt * dt * elasticDifferential(dF) + dt * viscousDifferential(dF);
+            for (int a = 0; a < 4; a++) {
+                matrix.block<3, 1>(3 * a, 3 * b + j) = volume * dP * gradients[a];
+            }
+        }
+    }
+
+    // Every term is positive semi-definite but dF S, which is indefinite where the stress S compresses, and
+    // conjugate gradients needs the assembled system positive definite. Such elements have their negative
+    // eigenvalues clamped to zero.
+    Eigen::SelfAdjointEigenSolver<Matrix3d> stressEigen;
+    stressEigen.computeDirect(stress, Eigen::EigenvaluesOnly);
+    if (stressEigen.eigenvalues()[0] < 0) {
+        Eigen::SelfAdjointEigenSolver<SystemMatrix::ElementMatrix> eigen(0.5 * (matrix + matrix.transpose()));
+        matrix = eigen.eigenvectors() * eigen.eigenvalues().cwiseMax(0).asDiagonal() *
+                 eigen.eigenvectors().transpose();
+    }
+
+    // K v is the elastic force's change along the velocities, i.e. with dF = Fdot
+    Matrix3d dP = elasticDifferential(Fdot);
+    for (int a = 0; a < 4; a++) {
+        stiffnessVelocity[a] = -volume * dP * gradients[a];
+    }
+}
+
+void FemSolver::resolveContinuousCollisions(std::vector<Eigen::Vector3d> &positions, std::vector<Eigen::Vector3d> &velocities)
+{
+    PROFILE_SCOPE("FemSolver::resolveContinuousCollisions");
+    auto start = std::chrono::steady_clock::now();
+    const int numVertices = positions.size();
+
+    int impacts = 0;
+    #pragma omp parallel for schedule(static) reduction(+ : impacts)
+    for (int v = 0; v < numVertices; v++) {
+        const Vector3d x0 = m_stepStart[v];
+        const Vector3d x1 = positions[v];
+        if (x0 == x1) continue;
+
+        // The earliest impact over every obstacle, and the surface normal there
+        double   earliest = 2;
+        Vector3d normal;
+        double   t;
+        if (vertexPlaneImpact(x0, x1, Vector3d::UnitY(), m_groundHeight, t) && t < earliest) {
+            earliest = t;
+            normal   = Vector3d::UnitY();
+        }
+        m_sphereHash.query(AlignedBox3d(x0.cwiseMin(x1), x0.cwiseMax(x1)), [&](int s) {
+            if (vertexSphereImpact(x0, x1, m_spheres[s].centre, m_spheres[s].radius, t) && t < earliest) {
+                earliest = t;
+                normal   = (x0 + t * (x1 - x0) - m_spheres[s].centre).normalized();
+            }
+        });
+        for (const SignedDistanceField *sdf : m_sdfs) {
+            double distance;
+            Vector3d gradient;
+            if (vertexSdfImpact(x0, x1, *sdf, t) && t < earliest && sdf->sample(x0 + t * (x1 - x0), distance, gradient)) {
+                earliest = t;
+                normal   = gradient;
+            }
+        }
+        if (earliest > 1) continue;
+
+        positions[v]   = x0 + earliest * (x1 - x0) + m_ccdSeparation * normal;
+        velocities[v] -= std::min(velocities[v].dot(normal), 0.0) * normal;
+        impacts++;
+    }
+    if (needsContacts() && m_selfCollisionReady) {
+        impacts += m_selfCollision.resolveCrossings(m_stepStart, positions, velocities);
+    }
+
+    m_ccdImpacts += impacts;
+    m_ccdSeconds += secondsSince(start);
+}
+
+void FemSolver::resetTimings()
+{
+    m_forceSeconds     = 0;
+    m_forceEvaluations = 0;
+    m_assemblySeconds       = 0;
+    m_linearSolveSeconds    = 0;
+    m_linearSolveIterations = 0;
+    m_implicitFallbacks     = 0;
+    resetCollisionTimings();
+}
+
+void FemSolver::resetCollisionTimings()
+{
+    m_ccdSeconds = 0;
+    m_ccdImpacts = 0;
+    m_selfCollision.resetTimings();
+}
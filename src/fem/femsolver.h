@@ -0,0 +1,229 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+#include "Eigen/Dense"
+
+#include "collision/colliders.h"
+#include "collision/selfcollision.h"
+#include "collision/signeddistancefield.h"
+#include "collision/spatialhash.h"
+#include "fem/elementkernel.h"
+#include "fem/femmesh.h"
+#include "fem/material.h"
+#include "fem/scene.h"
+#include "fem/systemmatrix.h"
+
+// Finite element solver for one or more tetrahedral bodies.
+//
+// A Scene is simulated as a single mesh: its bodies' vertices and tets sit in shared arrays, each tet looking
+// up its own body's material, so every loop covers all bodies in one parallel pass and cost follows the total
+// tet count. Surface contact between different bodies always goes through SelfCollision, whose one BVH over
+// every body's surface serves as the shared broadphase. Everything precomputed from the rest shape lives in a
+// FemMesh that several solvers can share, each with its own materials and state.
+//
+// Elasticity is St. Venant-Kirchhoff on the Green strain, with Kelvin-Voigt damping on the strain rate.
+// Gravity, a penalty ground plane at y = groundHeight and penalty contact with any sphere and signed-distance
+// colliders are applied per vertex, and the state is advanced by the Integrator. Spheres are
+// looked up through a spatial hash, so contact cost grows with the number of nearby spheres rather than all of
+// them; distance fields cost one grid lookup each.
+//
+// Penalty contact only sees end-of-step positions, so a vertex that crosses a thin obstacle within one step
+// tunnels through it. With continuous collision enabled, each vertex's path over the step is also tested
+// against the ground, spheres and distance fields; a vertex that enters one is put back at the time of impact
+// (just outside the surface) and loses its velocity into it, keeping the tangential part.
+//
+// Self-collision, when enabled, adds the same contact between each body's own surface vertices and triangles.
+// With continuous collision on, surface vertices are also stopped from passing through any surface.
+//
+// Forces are computed in two passes: every tet computes its four corner forces independently, then those
+// are summed into the vertices. How that sum is formed is the Reduction mode:
+//   Deterministic  each vertex gathers its corner forces through a vertex -> corner CSR sorted by corner
+//                  index, so every sum is taken in the same order for any number of threads
+//   Atomic         each tet scatters straight into the vertices with atomic adds; faster, but the summation
+//                  order (and so the last bits of the result) depends on thread scheduling
+//
+// Integrators:
+//   Midpoint       explicit midpoint; two force evaluations per step, and stable only for steps well below the
+//                  stiffest element's period
+//   ImplicitEuler  one linearised backward Euler step (Baraff and Witkin):
+//                    (M - dt D - dt^2 K) dv = dt (f + dt K v)
+//                  with K and D the elastic stiffness and viscous damping Jacobians, plus the ground's penalty
+//                  stiffness, damping and friction on the diagonal. Sphere, distance-field and surface contacts
+//                  only enter through f. Each element's share is projected to be positive semi-definite, and
+//                  assembled into a SystemMatrix whose pattern the mesh builds on the first implicit step of any
+//                  solver over it. It is solved by conjugate gradients; a step whose solve fails is taken with
+//                  the midpoint integrator instead.
+class FemSolver
+{
+public:
+    enum class Reduction { Deterministic, Atomic };
+    enum class Integrator { Midpoint, ImplicitEuler };
+    // How the implicit system is assembled: into the cached pattern, or rebuilt from triplets every step, the
+    // reference the cached path is measured against
+    enum class Assembly { Cached, Triplets };
+
+    FemSolver();
+
+    void init(const Scene &scene);
+    // A scene of one body
+    void init(const std::vector<Eigen::Vector3d> &restPositions,
+              const std::vector<Eigen::Vector4i> &tets,
+              const Material &material);
+    // Simulates an already prepared mesh, which may be shared with other solvers, with one material per body
+    void init(std::shared_ptr<const FemMesh> mesh, const std::vector<Material> &bodyMaterials);
+
+    // Total force on every vertex
+    void computeForces(const std::vector<Eigen::Vector3d> &positions,
+                       const std::vector<Eigen::Vector3d> &velocities,
+                       std::vector<Eigen::Vector3d>       &forces);
+
+    // Advances positions and velocities by one step of the current integrator
+    void step(std::vector<Eigen::Vector3d> &positions, std::vector<Eigen::Vector3d> &velocities, double dt);
+
+    // Fills the implicit Euler matrix for this state (step() does this itself)
+    void assembleSystem(const std::vector<Eigen::Vector3d> &positions,
+                        const std::vector<Eigen::Vector3d> &velocities, double dt);
+    const SystemMatrix &getSystem() const { return m_system; }
+
+    void      setReduction(Reduction reduction) { m_reduction = reduction; }
+    Reduction getReduction() const { return m_reduction; }
+
+    void       setIntegrator(Integrator integrator) { m_integrator = integrator; }
+    Integrator getIntegrator() const { return m_integrator; }
+
+    void     setAssembly(Assembly assembly) { m_assembly = assembly; }
+    Assembly getAssembly() const { return m_assembly; }
+
+    void setGravity(const Eigen::Vector3d &gravity) { m_gravity = gravity; }
+    void setGroundHeight(double height) { m_groundHeight = height; }
+    const Eigen::Vector3d &getGravity() const { return m_gravity; }
+    double getGroundHeight()    const { return m_groundHeight; }
+    double getGroundStiffness() const { return m_groundStiffness; }
+    double getGroundDamping()   const { return m_groundDamping; }
+    double getGroundFriction()  const { return m_groundFriction; }
+    // Whether any sphere or distance-field obstacles are set
+    bool   hasColliders()       const { return !m_spheres.empty() || !m_sdfs.empty(); }
+    void setSphereColliders(const std::vector<SphereCollider> &spheres);
+    // The fields are not owned, and must outlive the solver or be replaced
+    void setSdfColliders(const std::vector<const SignedDistanceField *> &sdfs) { m_sdfs = sdfs; }
+
+    void setContinuousCollision(bool enabled) { m_continuousCollision = enabled; }
+    bool getContinuousCollision() const { return m_continuousCollision; }
+    // Accumulated time spent in continuous collision, and the impacts it resolved, since the last reset
+    double getCcdSeconds() const { return m_ccdSeconds; }
+    int    getCcdImpacts() const { return m_ccdImpacts; }
+
+    // Contacts within each body; contacts between bodies are always on. Contact is set up from the rest shape on
+    // the first evaluation that needs it, so its thickness doesn't depend on when that was.
+    void setSelfCollision(bool enabled) { m_selfCollisionEnabled = enabled; }
+    bool getSelfCollision() const { return m_selfCollisionEnabled; }
+    // Covers contacts between bodies as well
+    const SelfCollision::Timings &getSelfCollisionTimings() const { return m_selfCollision.getTimings(); }
+
+    int getBodyCount()   const { return m_mesh->bodyCount; }
+    int getVertexCount() const { return m_mesh->vertexCount; }
+    int getTetCount()    const { return m_mesh->tets.size(); }
+    const std::vector<double> &getMasses() const { return m_masses; }
+    const std::shared_ptr<const FemMesh> &getMesh() const { return m_mesh; }
+
+    // Accumulated time spent in computeForces() since the last reset
+    double getForceSeconds()      const { return m_forceSeconds; }
+    int    getForceEvaluations()  const { return m_forceEvaluations; }
+    // Implicit steps only: time assembling the system and solving it, and the solver's total iterations
+    double getAssemblySeconds()       const { return m_assemblySeconds; }
+    double getLinearSolveSeconds()    const { return m_linearSolveSeconds; }
+    long   getLinearSolveIterations() const { return m_linearSolveIterations; }
+    // Implicit steps whose linear solve failed, and which took an explicit midpoint step instead
+    int    getImplicitFallbacks()     const { return m_implicitFallbacks; }
+    void   resetTimings();
+    // Only the continuous collision and contact counters, leaving the force and implicit ones running
+    void   resetCollisionTimings();
+
+    // Thread time spent working in the element loop, and the thread time that was available to it
+    // (wall time times thread count); their ratio is the loop's thread utilization. These only ever grow, and
+    // only while thread timing is on: it costs every thread a clock read and an atomic add per evaluation.
+    void   setThreadTiming(bool enabled) { m_threadTiming = enabled; }
+    double getThreadBusySeconds()      const { return m_threadBusySeconds; }
+    double getThreadAvailableSeconds() const { return m_threadAvailableSeconds; }
+
+    static int getThreadCount();
+    // Threads used by every parallel loop from now on; 0 or less restores the OpenMP default
+    static void setThreadCount(int threads);
+
+private:
+    void computeElementForces(const std::vector<Eigen::Vector3d> &positions,
+                              const std::vector<Eigen::Vector3d> &velocities,
+                              int tet, Eigen::Vector3d corners[4]) const;
+    // The tet's share of -dt D - dt^2 K, projected to be positive semi-definite, and of K v
+    void computeElementJacobian(const std::vector<Eigen::Vector3d> &positions,
+                                const std::vector<Eigen::Vector3d> &velocities,
+                                int tet, double dt, SystemMatrix::ElementMatrix &matrix,
+                                Eigen::Vector3d stiffnessVelocity[4]) const;
+    bool needsContacts() const { return m_selfCollisionEnabled || m_mesh->bodyCount > 1; }
+    void addExternalForces(const std::vector<Eigen::Vector3d> &positions,
+                           const std::vector<Eigen::Vector3d> &velocities,
+                           std::vector<Eigen::Vector3d>       &forces) const;
+    void stepMidpoint(std::vector<Eigen::Vector3d> &positions, std::vector<Eigen::Vector3d> &velocities, double dt);
+    void stepImplicitEuler(std::vector<Eigen::Vector3d> &positions, std::vector<Eigen::Vector3d> &velocities,
+                           double dt);
+    void resolveContinuousCollisions(std::vector<Eigen::Vector3d> &positions, std::vector<Eigen::Vector3d> &velocities);
+
+    // Rest shape and topology, possibly shared with other solvers
+    std::shared_ptr<const FemMesh> m_mesh;
+
+    std::vector<double>          m_masses;      // Lumped per vertex
+    std::vector<double>          m_inverseMasses;
+    std::vector<Eigen::Vector3d> m_cornerForces; // Also each corner's K v while assembling
+
+    // Material parameters per body
+    using ElementMaterial = ElementKernel::Parameters<double>;
+    std::vector<ElementMaterial> m_bodyMaterials;
+
+    Eigen::Vector3d m_gravity;
+    double m_groundHeight;
+    double m_groundStiffness; // Penalty acceleration per metre of penetration
+    double m_groundDamping;
+    double m_groundFriction;  // Tangential velocity damping while in contact
+
+    std::vector<SphereCollider> m_spheres;
+    SpatialHash                 m_sphereHash;
+    std::vector<const SignedDistanceField *> m_sdfs;
+
+    bool          m_selfCollisionEnabled;
+    bool          m_selfCollisionReady; // m_selfCollision has been initialised for the current scene
+    SelfCollision m_selfCollision;
+
+    bool   m_continuousCollision;
+    double m_ccdSeparation; // How far outside the surface a vertex is put back
+
+    Reduction  m_reduction;
+    Integrator m_integrator;
+    Assembly   m_assembly;
+
+    // Scratch state for the midpoint step
+    std::vector<Eigen::Vector3d> m_forces;
+    std::vector<Eigen::Vector3d> m_midPositions;
+    std::vector<Eigen::Vector3d> m_midVelocities;
+    std::vector<Eigen::Vector3d> m_stepStart;
+
+    // Implicit Euler system, built on first use
+    bool         m_systemReady;
+    SystemMatrix m_system;
+    std::vector<Eigen::Vector3d> m_stiffnessVelocities; // K v per vertex
+    Eigen::VectorXd m_rhs;
+    Eigen::VectorXd m_velocityChange;
+    Eigen::ConjugateGradient<SystemMatrix::Matrix, Eigen::Lower | Eigen::Upper> m_linearSolver;
+
+    double m_forceSeconds;
+    int    m_forceEvaluations;
+    bool   m_threadTiming;
+    double m_threadBusySeconds;
+    double m_threadAvailableSeconds;
+    double m_ccdSeconds;
+    int    m_ccdImpacts;
+    double m_assemblySeconds;
+    double m_linearSolveSeconds;
+    long   m_linearSolveIterations;
+    int    m_implicitFallbacks;
+};
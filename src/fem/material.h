@@ -0,0 +1,14 @@
+#pragma once
+
+// Elastic and viscous properties of a simulated body, in SI units
+struct Material
+{
+    double density       = 1000;  // kg/m^3
+    double youngsModulus = 2e4;   // Pa
+    double poissonRatio  = 0.3;
+    double viscosity     = 20;    // Pa*s, scales the strain-rate damping stress
+
+    // Lamé parameters
+    double getLambda() const { return youngsModulus * poissonRatio / ((1 + poissonRatio) * (1 - 2 * poissonRatio)); }
+    double getMu()     const { return youngsModulus / (2 * (1 + poissonRatio)); }
+};
@@ -0,0 +1,65 @@
+#include "fem/scene.h"
+#include "fem/surface.h"
+
+using namespace Eigen;
+
+Scene::Scene()
+{
+
+}
+
+int Scene::addBody(const std::vector<Eigen::Vector3d> &vertices, const std::vector<Eigen::Vector4i> &tets,
+                   const Material &material, const Eigen::Affine3d &transform)
+{
+    Body body;
+    body.vertexStart = m_restPositions.size();
+    body.vertexCount = vertices.size();
+    body.tetStart    = m_tets.size();
+    body.tetCount    = tets.size();
+    body.faceStart   = m_faces.size();
+    body.material    = material;
+
+    std::vector<Vector3i> faces;
+    extractSurface(vertices, tets, faces);
+    body.faceCount = faces.size();
+
+    const Vector4i tetOffset  = Vector4i::Constant(body.vertexStart);
+    const Vector3i faceOffset = Vector3i::Constant(body.vertexStart);
+    for (const Vector3d &v : vertices) m_restPositions.push_back(transform * v);
+    for (const Vector4i &tet : tets) m_tets.push_back(tet + tetOffset);
+    for (const Vector3i &face : faces) m_faces.push_back(face + faceOffset);
+    m_vertexBodies.insert(m_vertexBodies.end(), vertices.size(), static_cast<int>(m_bodies.size()));
+
+    m_bodies.push_back(body);
+    return m_bodies.size() - 1;
+}
+
+void Scene::clear()
+{
+    m_bodies.clear();
+    m_restPositions.clear();
+    m_tets.clear();
+    m_faces.clear();
+    m_vertexBodies.clear();
+}
+
+bool Scene::sharesTopology() const
+{
+    if (m_bodies.empty()) return true;
+    const Body &first = m_bodies[0];
+    for (const Body &body : m_bodies) {
+        if (body.vertexCount != first.vertexCount || body.tetCount != first.tetCount ||
+            body.faceCount != first.faceCount) {
+            return false;
+        }
+        const Vector4i tetOffset  = Vector4i::Constant(body.vertexStart - first.vertexStart);
+        const Vector3i faceOffset = Vector3i::Constant(body.vertexStart - first.vertexStart);
+        for (int t = 0; t < body.tetCount; t++) {
+            if (m_tets[body.tetStart + t] != m_tets[first.tetStart + t] + tetOffset) return false;
+        }
+        for (int f = 0; f < body.faceCount; f++) {
+            if (m_faces[body.faceStart + f] != m_faces[first.faceStart + f] + faceOffset) return false;
+        }
+    }
+    return true;
+}
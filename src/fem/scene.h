@@ -0,0 +1,57 @@
+#pragma once
+
+#include <vector>
+#include "Eigen/Dense"
+
+#include "fem/material.h"
+
+// Any number of independent tetrahedral bodies, packed back to back into shared arrays.
+//
+// Body b owns vertices [vertexStart, vertexStart + vertexCount) of the global arrays, and likewise a range of
+// tets and surface faces; those index the global vertex array directly, so a solver can treat the whole scene
+// as one mesh and still tell the bodies apart through getVertexBodies().
+class Scene
+{
+public:
+    struct Body {
+        int vertexStart = 0;
+        int vertexCount = 0;
+        int tetStart    = 0;
+        int tetCount    = 0;
+        int faceStart   = 0;
+        int faceCount   = 0;
+        Material material;
+    };
+
+    Scene();
+
+    // Appends a body given in its own frame, placed in the scene by `transform` (rigid or uniformly scaled, so
+    // that tets keep their orientation). Returns its index.
+    int addBody(const std::vector<Eigen::Vector3d> &vertices, const std::vector<Eigen::Vector4i> &tets,
+                const Material &material, const Eigen::Affine3d &transform = Eigen::Affine3d::Identity());
+
+    void clear();
+
+    int getBodyCount()   const { return m_bodies.size(); }
+    int getVertexCount() const { return m_restPositions.size(); }
+    int getTetCount()    const { return m_tets.size(); }
+    const Body &getBody(int body) const { return m_bodies[body]; }
+
+    // In scene space
+    const std::vector<Eigen::Vector3d> &getRestPositions() const { return m_restPositions; }
+    const std::vector<Eigen::Vector4i> &getTets()          const { return m_tets; }
+    // Outward-facing surface of every body
+    const std::vector<Eigen::Vector3i> &getFaces()         const { return m_faces; }
+    const std::vector<int>             &getVertexBodies()  const { return m_vertexBodies; }
+
+    // Whether every body has the same tets and surface as the first, relative to its own vertices, so that
+    // all of them can be drawn as instances of one mesh
+    bool sharesTopology() const;
+
+private:
+    std::vector<Body>            m_bodies;
+    std::vector<Eigen::Vector3d> m_restPositions;
+    std::vector<Eigen::Vector4i> m_tets;
+    std::vector<Eigen::Vector3i> m_faces;
+    std::vector<int>             m_vertexBodies;
+};
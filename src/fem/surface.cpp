@@ -0,0 +1,62 @@
+#include "fem/surface.h"
+#include "profiling/profiler.h"
+
+#include <algorithm>
+#include <array>
+
+using namespace Eigen;
+
+namespace {
+
+struct TetFace {
+    std::array<int, 3> key; // Sorted vertex indices, equal for both tets sharing the face
+    int tet;
+    int opposite;           // Local index (0-3) of the tet vertex not on this face
+
+    bool operator<(const TetFace &other) const { return key < other.key; }
+};
+
+}
+
+void extractSurface(const std::vector<Eigen::Vector3d> &vertices,
+                    const std::vector<Eigen::Vector4i> &tets,
+                    std::vector<Eigen::Vector3i>       &faces)
+{
+    PROFILE_SCOPE("extractSurface");
+
+    // Gather every tet face and sort them, so that interior faces end up next to their twin
+    std::vector<TetFace> tetFaces(tets.size() * 4);
+    for (size_t t = 0; t < tets.size(); t++) {
+        for (int opposite = 0; opposite < 4; opposite++) {
+            TetFace &face = tetFaces[4 * t + opposite];
+            int k = 0;
+            for (int i = 0; i < 4; i++) {
+                if (i != opposite) face.key[k++] = tets[t][i];
+            }
+            std::sort(face.key.begin(), face.key.end());
+            face.tet      = t;
+            face.opposite = opposite;
+        }
+    }
+    std::sort(tetFaces.begin(), tetFaces.end());
+
+    faces.clear();
+    for (size_t i = 0; i < tetFaces.size(); ) {
+        size_t j = i + 1;
+        while (j < tetFaces.size() && tetFaces[j].key == tetFaces[i].key) j++;
+
+        if (j - i == 1) {
+            const TetFace &face = tetFaces[i];
+            Vector3i f(face.key[0], face.key[1], face.key[2]);
+
+            // Flip the winding if the normal points towards the rest of the tet
+            const Vector3d &a = vertices[f[0]];
+            const Vector3d &d = vertices[tets[face.tet][face.opposite]];
+            Vector3d n = (vertices[f[1]] - a).cross(vertices[f[2]] - a);
+            if (n.dot(d - a) > 0) std::swap(f[1], f[2]);
+
+            faces.push_back(f);
+        }
+        i = j;
+    }
+}
@@ -0,0 +1,10 @@
+#pragma once
+
+#include <vector>
+#include "Eigen/Dense"
+
+// Finds the tet faces that belong to exactly one tetrahedron, i.e. the boundary of the mesh. Faces are
+// wound counter-clockwise when seen from outside, so (b - a) x (c - a) points out of the mesh.
+void extractSurface(const std::vector<Eigen::Vector3d> &vertices,
+                    const std::vector<Eigen::Vector4i> &tets,
+                    std::vector<Eigen::Vector3i>       &faces);
@@ -0,0 +1,112 @@
+#include "fem/systemmatrix.h"
+#include "profiling/profiler.h"
+
+using namespace Eigen;
+
+SystemPattern::SystemPattern(const FemMesh &mesh)
+{
+    PROFILE_SCOPE("SystemPattern::SystemPattern");
+    const int numVertices = mesh.vertexCount;
+    const int numTets     = mesh.tets.size();
+
+    // Each vertex's neighbours (itself included), ascending: the block columns of its three rows
+    std::vector<int> neighbourStart(numVertices + 1, 0);
+    std::vector<int> neighbours;
+    for (int v = 0; v < numVertices; v++) {
+        const size_t first = neighbours.size();
+        neighbours.push_back(v);
+        for (int k = mesh.vertexCornerStart[v]; k < mesh.vertexCornerStart[v + 1]; k++) {
+            const Vector4i &tet = mesh.tets[mesh.vertexCorners[k] / 4];
+            neighbours.insert(neighbours.end(), tet.data(), tet.data() + 4);
+        }
+        std::sort(neighbours.begin() + first, neighbours.end());
+        neighbours.erase(std::unique(neighbours.begin() + first, neighbours.end()), neighbours.end());
+        neighbourStart[v + 1] = neighbours.size();
+    }
+    auto neighbourIndex = [&](int v, int u) {
+        auto begin = neighbours.begin() + neighbourStart[v];
+        return std::lower_bound(begin, neighbours.begin() + neighbourStart[v + 1], u) - begin;
+    };
+
+    // CSR pattern: row 3v + i holds columns 3u .. 3u + 2 for every neighbour u
+    rows = 3 * numVertices;
+    rowStart.resize(rows + 1);
+    columns.resize(9 * neighbours.size());
+    rowStart[0] = 0;
+    for (int v = 0; v < numVertices; v++) {
+        for (int i = 0; i < 3; i++) {
+            int row = 3 * v + i;
+            int out = rowStart[row];
+            for (int k = neighbourStart[v]; k < neighbourStart[v + 1]; k++) {
+                for (int j = 0; j < 3; j++) columns[out++] = 3 * neighbours[k] + j;
+            }
+            rowStart[row + 1] = out;
+        }
+    }
+
+    diagonalSlots.resize(3 * numVertices);
+    for (int v = 0; v < numVertices; v++) {
+        for (int i = 0; i < 3; i++) {
+            diagonalSlots[3 * v + i] = rowStart[3 * v + i] + 3 * neighbourIndex(v, v) + i;
+        }
+    }
+
+    elementSlots.resize(numTets * ELEMENT_ENTRIES);
+    for (int t = 0; t < numTets; t++) {
+        const Vector4i &tet = mesh.tets[t];
+        int *targets = &elementSlots[t * ELEMENT_ENTRIES];
+        for (int b = 0; b < 4; b++) {
+            for (int j = 0; j < 3; j++) {
+                for (int a = 0; a < 4; a++) {
+                    const int blockColumn = 3 * neighbourIndex(tet[a], tet[b]);
+                    for (int i = 0; i < 3; i++) {
+                        *targets++ = rowStart[3 * tet[a] + i] + blockColumn + j;
+                    }
+                }
+            }
+        }
+    }
+
+    // Greedy colouring in tet order: each tet takes the lowest colour none of its vertices' earlier tets has.
+    // usedBy[c] == t marks colour c as taken for tet t, so nothing is cleared between tets.
+    std::vector<int> tetColors(numTets);
+    std::vector<int> usedBy;
+    int numColors = 0;
+    for (int t = 0; t < numTets; t++) {
+        for (int a = 0; a < 4; a++) {
+            const int v = mesh.tets[t][a];
+            for (int k = mesh.vertexCornerStart[v]; k < mesh.vertexCornerStart[v + 1]; k++) {
+                const int other = mesh.vertexCorners[k] / 4;
+                if (other >= t) break; // Corners are ascending, so the rest are uncoloured yet
+                usedBy[tetColors[other]] = t;
+            }
+        }
+        int color = 0;
+        while (color < numColors && usedBy[color] == t) color++;
+        if (color == numColors) {
+            numColors++;
+            usedBy.push_back(-1);
+        }
+        tetColors[t] = color;
+    }
+
+    colorStart.assign(numColors + 1, 0);
+    for (int t = 0; t < numTets; t++) colorStart[tetColors[t] + 1]++;
+    for (int c = 0; c < numColors; c++) colorStart[c + 1] += colorStart[c];
+    coloredTets.resize(numTets);
+    std::vector<int> next(colorStart.begin(), colorStart.end() - 1);
+    for (int t = 0; t < numTets; t++) {
+        coloredTets[next[tetColors[t]]++] = t;
+    }
+}
+
+SystemMatrix::SystemMatrix()
+    : m_pattern(nullptr)
+{
+}
+
+void SystemMatrix::init(const SystemPattern &pattern)
+{
+    m_pattern = &pattern;
+    m_values.assign(pattern.columns.size(), 0.0);
+}
@@ -0,0 +1,135 @@
+#pragma once
+
+#include <algorithm>
+#include <vector>
+#include "Eigen/Dense"
+#include "Eigen/Sparse"
+
+#include "fem/femmesh.h"
+
+// Where a SystemMatrix's values go, built once per FemMesh (see FemMesh::getSystemPattern) and shared by every
+// matrix over it, e.g. those of an Ensemble's members.
+//
+// It lays out a row-major (CSR) matrix with a 3x3 block for every pair of vertices that share a tet, and
+// records where each tet's 12x12 element matrix lands in the value array: one slot per element entry, plus
+// the slot of every diagonal entry.
+//
+// To scatter element matrices in parallel without atomics, the tets are greedily coloured so that no two
+// tets of one colour share a vertex. Each colour is one parallel loop, so every slot is written by one thread
+// at a time, and always in colour order, which keeps the sums identical for any thread count.
+struct SystemPattern
+{
+    static const int ELEMENT_ENTRIES = 144;
+
+    explicit SystemPattern(const FemMesh &mesh);
+
+    int rows;
+    std::vector<int> rowStart; // rows + 1 offsets into columns
+    std::vector<int> columns;
+
+    // Value slot of entry k of tet t's element matrix, in the element matrix's own column-major order, at
+    // elementSlots[t * ELEMENT_ENTRIES + k]
+    std::vector<int> elementSlots;
+    std::vector<int> diagonalSlots;
+
+    // Tets of colour c are coloredTets[colorStart[c] .. colorStart[c + 1]), in ascending order
+    std::vector<int> colorStart;
+    std::vector<int> coloredTets;
+
+    int getColorCount() const { return colorStart.empty() ? 0 : colorStart.size() - 1; }
+};
+
+// The 3n x 3n matrix of a linear system over a tet mesh's vertices, such as the implicit Euler system, whose
+// sparsity pattern is a SystemPattern. Only the values are its own; assemble() adds into them, with no
+// triplets, sorting or allocation.
+class SystemMatrix
+{
+public:
+    // Rows and columns are corner * 3 + component, in the tet's corner order
+    using ElementMatrix = Eigen::Matrix<double, 12, 12>;
+    using Matrix        = Eigen::SparseMatrix<double, Eigen::RowMajor>;
+    using MatrixMap     = Eigen::Map<const Matrix>;
+
+    SystemMatrix();
+
+    // The pattern must outlive this matrix, or be replaced by another init()
+    void init(const SystemPattern &pattern);
+
+    // Zeroes the values, then adds every tet's element matrix, which compute(tet, matrix) fills in. compute is
+    // called concurrently for tets of the same colour.
+    template <typename Compute>
+    void assemble(Compute &&compute);
+
+    // The same sum built the usual way, through triplets and Matrix::setFromTriplets, then copied into the
+    // values; the pattern comes out identical. Kept to measure the cached assembly against.
+    template <typename Compute>
+    void assembleFromTriplets(const FemMesh &mesh, Compute &&compute);
+
+    // Safe to call concurrently for different rows
+    void addDiagonal(int row, double value) { m_values[m_pattern->diagonalSlots[row]] += value; }
+
+    // A view of the pattern and values, valid until the next init()
+    MatrixMap getMatrix() const
+    {
+        return MatrixMap(m_pattern->rows, m_pattern->rows, m_values.size(), m_pattern->rowStart.data(),
+                         m_pattern->columns.data(), m_values.data());
+    }
+    int getColorCount() const { return m_pattern ? m_pattern->getColorCount() : 0; }
+
+private:
+    const SystemPattern *m_pattern;
+    std::vector<double>  m_values;
+};
+
+template <typename Compute>
+void SystemMatrix::assemble(Compute &&compute)
+{
+    const SystemPattern &pattern = *m_pattern;
+    double *values = m_values.data();
+    std::fill(m_values.begin(), m_values.end(), 0.0);
+
+    for (int c = 0; c < pattern.getColorCount(); c++) {
+        #pragma omp parallel for schedule(static)
+        for (int i = pattern.colorStart[c]; i < pattern.colorStart[c + 1]; i++) {
+            const int tet = pattern.coloredTets[i];
+            ElementMatrix element;
+            compute(tet, element);
+
+            const int *targets = &pattern.elementSlots[tet * SystemPattern::ELEMENT_ENTRIES];
+            for (int k = 0; k < SystemPattern::ELEMENT_ENTRIES; k++) {
+                values[targets[k]] += element.data()[k];
+            }
+        }
+    }
+}
+
+template <typename Compute>
+void SystemMatrix::assembleFromTriplets(const FemMesh &mesh, Compute &&compute)
+{
+    const int ELEMENT_ENTRIES = SystemPattern::ELEMENT_ENTRIES;
+    const int numTets = mesh.tets.size();
+    const int numRows = m_pattern->rows;
+
+    // Each tet fills its own range, so the element matrices are still computed in parallel
+    std::vector<Eigen::Triplet<double>> triplets(numTets * ELEMENT_ENTRIES + numRows);
+    #pragma omp parallel for schedule(static)
+    for (int t = 0; t < numTets; t++) {
+        ElementMatrix element;
+        compute(t, element);
+
+        Eigen::Triplet<double> *out = &triplets[t * ELEMENT_ENTRIES];
+        for (int column = 0; column < 12; column++) {
+            for (int row = 0; row < 12; row++) {
+                *out++ = Eigen::Triplet<double>(mesh.tets[t][row / 3] * 3 + row % 3,
+                                                mesh.tets[t][column / 3] * 3 + column % 3, element(row, column));
+            }
+        }
+    }
+    // Explicit zeros keep the diagonal of vertices outside any tet in the pattern
+    for (int r = 0; r < numRows; r++) {
+        triplets[numTets * ELEMENT_ENTRIES + r] = Eigen::Triplet<double>(r, r, 0.0);
+    }
+    Matrix matrix(numRows, numRows);
+    matrix.setFromTriplets(triplets.begin(), triplets.end());
+    std::copy(matrix.valuePtr(), matrix.valuePtr() + matrix.nonZeros(), m_values.begin());
+}
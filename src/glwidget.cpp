@@ -1,7 +1,11 @@
 #include "glwidget.h"
+#include "profiling/profiler.h"
 
 #include <QApplication>
+#include <QDir>
 #include <QKeyEvent>
+#include <QPainter>
+#include <algorithm>
 #include <iostream>
 
 #define SPEED 1.5
@@ -9,13 +13,20 @@
 
 using namespace std;
 
-GLWidget::GLWidget(QWidget *parent) :
+GLWidget::GLWidget(const SceneDescription &scene, QWidget *parent) :
     QOpenGLWidget(parent),
     m_deltaTimeProvider(),
     m_intervalTimer(),
+    m_frameTimer(),
+    m_hud(FRAMES_TO_AVERAGE),
+    m_hudVisible(false),
+    m_scene(scene),
     m_sim(),
     m_camera(),
     m_shader(),
+    m_cameraUbo(),
+    m_frameCapture(),
+    m_recording(false),
     m_forward(),
     m_sideways(),
     m_vertical(),
@@ -38,6 +49,16 @@ GLWidget::GLWidget(QWidget *parent) :
 
 GLWidget::~GLWidget()
 {
+    // The simulation's shapes free their GL objects when the members are destroyed after this, so the context
+    // is left current for them
+    makeCurrent();
+    // Closing while recording still has frames in flight in the capture's PBOs; reading them back keeps the
+    // sequence complete, and frees the capture's GL objects
+    if (m_recording) {
+        m_frameCapture.destroy();
+        fprintf(stdout, "Stopped recording: %d frames written, %d stalls\n",
+                m_frameCapture.getFramesWritten(), m_frameCapture.getStalls());
+    }
     if (m_shader != nullptr) delete m_shader;
 }
 
@@ -61,25 +82,64 @@ void GLWidget::initializeGL()
 
     // Initialize the shader and simulation
     m_shader = new Shader(":/resources/shaders/shader.vert", ":/resources/shaders/shader.frag");
-    m_sim.init();
+    m_shader->bindUniformBlock("Camera", CAMERA_BINDING);
+    m_shader->bindUniformBlock("Object", OBJECT_BINDING);
+    m_cameraUbo.init(sizeof(CameraBlock), CAMERA_BINDING);
+    if (!m_sim.init(m_scene)) {
+        fprintf(stderr, "Failed to set up the scene\n");
+    }
 
     // Initialize camera with a reasonable transform
     Eigen::Vector3f eye    = {0, 2, -5};
     Eigen::Vector3f target = {0, 1,  0};
     m_camera.lookAt(eye, target);
     m_camera.setOrbitPoint(target);
-    m_camera.setPerspective(120, width() / static_cast<float>(height()), 0.1, 50);
+    m_camera.setPerspective(120, width() / static_cast<float>(height()), CAMERA_NEAR, CAMERA_FAR);
 
     m_deltaTimeProvider.start();
+    m_frameTimer.start();
     m_intervalTimer.start(1000 / 60);
 }
 
 void GLWidget::paintGL()
 {
+    PROFILE_SCOPE("GLWidget::paintGL");
+
+    // While recording, the scene was already rendered offscreen by tick(), so just show that
+    if (m_recording) {
+        m_frameCapture.blitTo(defaultFramebufferObject(), width() * devicePixelRatioF(), height() * devicePixelRatioF());
+    } else {
+        renderScene();
+    }
+
+    double frameMs = m_frameTimer.nsecsElapsed() / 1e6;
+    m_frameTimer.restart();
+
+    if (m_hudVisible) {
+        m_hud.update(frameMs, m_sim.getStats());
+        QPainter painter(this);
+        m_hud.draw(painter, m_sim.getVertexCount(), m_sim.getTetCount(), FemSolver::getThreadCount());
+        painter.end();
+    }
+}
+
+void GLWidget::renderScene()
+{
+    // The HUD's QPainter doesn't restore these
+    glEnable(GL_DEPTH_TEST);
+    glEnable(GL_CULL_FACE);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+    CameraBlock camera;
+    Eigen::Map<Eigen::Matrix4f>(camera.proj) = m_camera.getProjection();
+    Eigen::Map<Eigen::Matrix4f>(camera.view) = m_camera.getView();
+    m_cameraUbo.update(&camera, sizeof(CameraBlock));
+    m_cameraUbo.bind();
+
+    int viewportHeight = m_recording ? CAPTURE_HEIGHT : height() * devicePixelRatioF();
+    m_sim.setView(m_camera.getView(), m_camera.getProjection(), viewportHeight);
+
     m_shader->bind();
-    m_shader->setUniform("proj", m_camera.getProjection());
-    m_shader->setUniform("view", m_camera.getView());
     m_sim.draw(m_shader);
     m_shader->unbind();
 }
@@ -87,7 +147,94 @@ void GLWidget::paintGL()
 void GLWidget::resizeGL(int w, int h)
 {
     glViewport(0, 0, w, h);
-    m_camera.setAspect(static_cast<float>(w) / h);
+    if (!m_recording) {
+        m_camera.setAspect(static_cast<float>(w) / h);
+    }
+}
+
+// Starts or stops writing every simulation step to capture/ as an image sequence. While recording, the
+// simulation advances by a fixed 1 / CAPTURE_FPS per tick so that the sequence plays back in real time
+// regardless of how long each frame took to produce.
+void GLWidget::toggleRecording()
+{
+    makeCurrent();
+    if (!m_recording) {
+        QDir().mkpath("capture");
+        m_frameCapture.init(CAPTURE_WIDTH, CAPTURE_HEIGHT, "capture");
+        m_camera.setAspect(static_cast<float>(CAPTURE_WIDTH) / CAPTURE_HEIGHT);
+        fprintf(stdout, "Recording %dx%d frames to capture/\n", CAPTURE_WIDTH, CAPTURE_HEIGHT);
+    } else {
+        m_frameCapture.destroy();
+        m_camera.setAspect(static_cast<float>(width()) / height());
+        fprintf(stdout, "Stopped recording: %d frames written, %d stalls\n",
+                m_frameCapture.getFramesWritten(), m_frameCapture.getStalls());
+    }
+    doneCurrent();
+    m_recording = !m_recording;
+}
+
+// Recording starts on the first press; the second press stops it and writes the trace
+void GLWidget::toggleProfiling()
+{
+#if PROFILING_ENABLED
+    if (!Profiler::isRecording()) {
+        Profiler::clear();
+        Profiler::setRecording(true);
+        fprintf(stdout, "Profiling...\n");
+    } else {
+        Profiler::setRecording(false);
+        if (Profiler::writeChromeTrace(TRACE_PATH)) {
+            fprintf(stdout, "Wrote %s (open it in chrome://tracing or ui.perfetto.dev)\n", TRACE_PATH);
+        }
+    }
+#else
+    fprintf(stdout, "Profiling was disabled at compile time (ENABLE_PROFILING=OFF)\n");
+#endif
+}
+
+// Looks at the scene from further and further away, timing frames drawn with levels of detail and with full
+// surfaces from each distance, then puts the camera back. Frames are timed to glFinish() so that the GPU's
+// work counts.
+void GLWidget::measureLod()
+{
+    const Eigen::AlignedBox3d bounds = m_sim.getBounds();
+    if (bounds.isEmpty()) return;
+    const Eigen::Vector3f center = bounds.center().cast<float>();
+    const float radius = std::max(0.5 * bounds.diagonal().norm(), 1e-3);
+
+    Camera saved = m_camera;
+    const bool lodWasEnabled = m_sim.isLodEnabled();
+    const Eigen::Vector3f direction = -m_camera.getLook().normalized();
+
+    makeCurrent();
+    fprintf(stdout, "LOD sweep, %d frames per distance:\n", LOD_SWEEP_FRAMES);
+    for (float multiple = 2; multiple * radius < 0.9f * CAMERA_FAR; multiple *= 2) {
+        const float distance = multiple * radius;
+        m_camera.lookAt(center + distance * direction, center);
+
+        double mean[2], p95[2];
+        int triangles[2];
+        for (int lod = 0; lod < 2; lod++) {
+            m_sim.setLodEnabled(lod == 1);
+            FrameTimings timings(LOD_SWEEP_FRAMES);
+            QElapsedTimer timer;
+            for (int frame = 0; frame < LOD_SWEEP_FRAMES; frame++) {
+                timer.start();
+                renderScene();
+                glFinish();
+                timings.addSample(timer.nsecsElapsed() / 1e6);
+            }
+            mean[lod]      = timings.getMean();
+            p95[lod]       = timings.getPercentile(95);
+            triangles[lod] = m_sim.getDrawnTriangles();
+        }
+        fprintf(stdout, "  distance %6.2f: full %8d triangles %6.2f ms (p95 %6.2f), LOD %8d triangles %6.2f ms (p95 %6.2f)\n",
+                distance, triangles[0], mean[0], p95[0], triangles[1], mean[1], p95[1]);
+    }
+    doneCurrent();
+
+    m_camera = saved;
+    m_sim.setLodEnabled(lodWasEnabled);
 }
 
 // ================== Event Listeners
@@ -143,6 +290,26 @@ void GLWidget::keyPressEvent(QKeyEvent *event)
     case Qt::Key_R: m_vertical += SPEED; break;
     case Qt::Key_C: m_camera.toggleIsOrbiting(); break;
     case Qt::Key_T: m_sim.toggleWire(); break;
+    case Qt::Key_V: toggleRecording(); break;
+    case Qt::Key_E: m_sim.toggleExport(); break;
+    case Qt::Key_X: m_sim.toggleCache(); break;
+    case Qt::Key_M: m_sim.toggleReduction(); break;
+    case Qt::Key_N: m_sim.toggleContinuousCollision(); break;
+    case Qt::Key_O: m_sim.toggleSelfCollision(); break;
+    case Qt::Key_B: m_sim.toggleDropScene(); break;
+    case Qt::Key_J: m_sim.toggleLod(); break;
+    case Qt::Key_G: measureLod(); break;
+    case Qt::Key_P: toggleProfiling(); break;
+    case Qt::Key_H:
+        m_hudVisible = !m_hudVisible;
+        m_sim.setTiming(m_hudVisible);
+        m_hud.reset(m_sim.getStats());
+        break;
+    case Qt::Key_K:
+        QDir().mkpath(CHECKPOINT_DIR);
+        m_sim.saveCheckpoint(CHECKPOINT_PATH);
+        break;
+    case Qt::Key_L: m_sim.loadCheckpoint(CHECKPOINT_PATH); break;
     case Qt::Key_Escape: QApplication::quit();
     }
 }
@@ -166,7 +333,12 @@ void GLWidget::keyReleaseEvent(QKeyEvent *event)
 
 void GLWidget::tick()
 {
+    PROFILE_SCOPE("GLWidget::tick");
+
     float deltaSeconds = m_deltaTimeProvider.restart() / 1000.f;
+    if (m_recording) {
+        deltaSeconds = 1.f / CAPTURE_FPS;
+    }
     m_sim.update(deltaSeconds);
 
     // Move camera
@@ -178,6 +350,15 @@ void GLWidget::tick()
     moveVec *= deltaSeconds;
     m_camera.move(moveVec);
 
+    // Capture exactly one frame per simulation step
+    if (m_recording) {
+        makeCurrent();
+        m_frameCapture.beginFrame();
+        renderScene();
+        m_frameCapture.endFrame(defaultFramebufferObject());
+        doneCurrent();
+    }
+
     // Flag this view for repainting (Qt will call paintGL() soon after)
     update();
 }
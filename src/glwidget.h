@@ -7,6 +7,10 @@
 #include "simulation.h"
 #include "graphics/camera.h"
 #include "graphics/shader.h"
+#include "graphics/framecapture.h"
+#include "graphics/frametimings.h"
+#include "graphics/performancehud.h"
+#include "graphics/uniformbuffer.h"
 
 #include <QOpenGLWidget>
 #include <QElapsedTimer>
@@ -18,18 +22,41 @@ class GLWidget : public QOpenGLWidget
     Q_OBJECT
 
 public:
-    GLWidget(QWidget *parent = nullptr);
+    GLWidget(const SceneDescription &scene, QWidget *parent = nullptr);
     ~GLWidget();
 
 private:
     static const int FRAMES_TO_AVERAGE = 30;
 
+    // Offscreen capture settings (see toggleRecording)
+    static const int CAPTURE_WIDTH  = 1920;
+    static const int CAPTURE_HEIGHT = 1080;
+    static const int CAPTURE_FPS    = 60;
+
+    // Written with K, restored with L
+    static constexpr const char *CHECKPOINT_DIR  = "checkpoints";
+    static constexpr const char *CHECKPOINT_PATH = "checkpoints/latest.ckpt";
+
+    // Written when profiling is toggled off with P
+    static constexpr const char *TRACE_PATH = "trace.json";
+
+    static constexpr float CAMERA_NEAR = 0.1f;
+    static constexpr float CAMERA_FAR  = 50.f;
+
+    // G renders LOD_SWEEP_FRAMES frames from each of a series of distances, with and without levels of detail
+    static const int LOD_SWEEP_FRAMES = 60;
+
 private:
     // Basic OpenGL Overrides
     void initializeGL()         override;
     void paintGL()              override;
     void resizeGL(int w, int h) override;
 
+    void renderScene();
+    void toggleRecording();
+    void toggleProfiling();
+    void measureLod();
+
     // Event Listeners
     void mousePressEvent  (QMouseEvent *event) override;
     void mouseMoveEvent   (QMouseEvent *event) override;
@@ -41,11 +68,21 @@ private:
 private:
     QElapsedTimer m_deltaTimeProvider; // For measuring elapsed time
     QTimer        m_intervalTimer;     // For triggering timed events
+    QElapsedTimer m_frameTimer;        // For measuring time between painted frames
+
+    PerformanceHud m_hud;        // Toggled with H
+    bool           m_hudVisible;
 
-    Simulation m_sim;
+    SceneDescription m_scene;
+    Simulation       m_sim;
     Camera     m_camera;
     Shader    *m_shader;
 
+    UniformBuffer m_cameraUbo;
+
+    FrameCapture m_frameCapture;
+    bool         m_recording;
+
     int m_forward;
     int m_sideways;
     int m_vertical;
@@ -0,0 +1,22 @@
+#include "graphics/flatnormals.h"
+
+using namespace Eigen;
+
+float *writeFlatShadedVertices(const std::vector<Eigen::Vector3d> &vertices,
+                               const std::vector<Eigen::Vector3i> &faces,
+                               float *dst)
+{
+    for (const Vector3i &f : faces) {
+        const Vector3d &v1 = vertices[f[0]];
+        const Vector3d &v2 = vertices[f[1]];
+        const Vector3d &v3 = vertices[f[2]];
+        Vector3d n = (v2 - v1).cross(v3 - v1);
+        dst = writeVec3(dst, v1);
+        dst = writeVec3(dst, n);
+        dst = writeVec3(dst, v2);
+        dst = writeVec3(dst, n);
+        dst = writeVec3(dst, v3);
+        dst = writeVec3(dst, n);
+    }
+    return dst;
+}
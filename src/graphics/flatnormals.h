@@ -0,0 +1,18 @@
+#pragma once
+
+#include <vector>
+#include "Eigen/Dense"
+
+inline float *writeVec3(float *dst, const Eigen::Vector3d &v)
+{
+    dst[0] = static_cast<float>(v[0]);
+    dst[1] = static_cast<float>(v[1]);
+    dst[2] = static_cast<float>(v[2]);
+    return dst + 3;
+}
+
+// Writes three interleaved (position, normal) vertices per face, all carrying the face's unnormalized normal.
+// `dst` must have room for 18 floats per face. Returns the end of the written data.
+float *writeFlatShadedVertices(const std::vector<Eigen::Vector3d> &vertices,
+                               const std::vector<Eigen::Vector3i> &faces,
+                               float *dst);
@@ -0,0 +1,240 @@
+#include "graphics/framecapture.h"
+#include "graphics/graphicsdebug.h"
+
+#include <QImage>
+#include <QString>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+
+FrameCapture::FrameCapture()
+    : m_fbo(0),
+      m_colorRbo(0),
+      m_depthRbo(0),
+      m_nextPbo(0),
+      m_width(0),
+      m_height(0),
+      m_format(Format::PPM),
+      m_frame(0),
+      m_stalls(0),
+      m_buffersInFlight(0),
+      m_framesWritten(0)
+{
+}
+
+FrameCapture::~FrameCapture()
+{
+    m_pool.waitForDone();
+    for (std::vector<unsigned char> *buffer : m_freeBuffers) delete buffer;
+}
+
+void FrameCapture::init(int width, int height, const std::string &outputDir, Format format, int numPbos)
+{
+    m_width     = width;
+    m_height    = height;
+    m_outputDir = outputDir;
+    m_format    = format;
+    m_frame     = 0;
+    m_stalls    = 0;
+    m_nextPbo   = 0;
+    m_framesWritten = 0;
+
+    glGenRenderbuffers(1, &m_colorRbo);
+    glBindRenderbuffer(GL_RENDERBUFFER, m_colorRbo);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, m_width, m_height);
+    glGenRenderbuffers(1, &m_depthRbo);
+    glBindRenderbuffer(GL_RENDERBUFFER, m_depthRbo);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, m_width, m_height);
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+    GLint previousFbo;
+    glGetIntegerv(GL_FRAMEBUFFER_BINDING, &previousFbo);
+    glGenFramebuffers(1, &m_fbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, m_fbo);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, m_colorRbo);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT,  GL_RENDERBUFFER, m_depthRbo);
+    checkFramebufferStatus();
+    glBindFramebuffer(GL_FRAMEBUFFER, previousFbo);
+
+    m_pbos.resize(numPbos);
+    m_fences.assign(numPbos, nullptr);
+    m_pboFrames.assign(numPbos, -1);
+    glGenBuffers(numPbos, m_pbos.data());
+    for (GLuint pbo : m_pbos) {
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, pbo);
+        glBufferData(GL_PIXEL_PACK_BUFFER, static_cast<size_t>(m_width) * m_height * 4, nullptr, GL_STREAM_READ);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+}
+
+void FrameCapture::destroy()
+{
+    finish();
+
+    for (GLsync &fence : m_fences) {
+        if (fence != nullptr) glDeleteSync(fence);
+        fence = nullptr;
+    }
+    glDeleteBuffers(m_pbos.size(), m_pbos.data());
+    glDeleteFramebuffers(1, &m_fbo);
+    glDeleteRenderbuffers(1, &m_colorRbo);
+    glDeleteRenderbuffers(1, &m_depthRbo);
+    m_pbos.clear();
+    m_fbo = m_colorRbo = m_depthRbo = 0;
+
+    std::lock_guard<std::mutex> lock(m_bufferMutex);
+    for (std::vector<unsigned char> *buffer : m_freeBuffers) delete buffer;
+    m_freeBuffers.clear();
+}
+
+// ================== Capturing
+
+void FrameCapture::beginFrame()
+{
+    glBindFramebuffer(GL_FRAMEBUFFER, m_fbo);
+    glViewport(0, 0, m_width, m_height);
+}
+
+void FrameCapture::endFrame(GLuint restoreFbo)
+{
+    // The ring is full: the oldest frame has to be read back before its PBO can be reused
+    int pbo = m_nextPbo;
+    if (m_pboFrames[pbo] >= 0) {
+        readBack(pbo);
+    }
+
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, m_pbos[pbo]);
+    glReadPixels(0, 0, m_width, m_height, GL_RGBA, GL_UNSIGNED_BYTE, reinterpret_cast<GLvoid *>(0));
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    m_fences[pbo]    = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    m_pboFrames[pbo] = m_frame++;
+    m_nextPbo        = (pbo + 1) % m_pbos.size();
+
+    glBindFramebuffer(GL_FRAMEBUFFER, restoreFbo);
+}
+
+void FrameCapture::blitTo(GLuint targetFbo, int targetWidth, int targetHeight)
+{
+    // Letterbox the capture into the target while keeping its aspect ratio
+    float scale = std::min(targetWidth / static_cast<float>(m_width), targetHeight / static_cast<float>(m_height));
+    int w = static_cast<int>(m_width  * scale);
+    int h = static_cast<int>(m_height * scale);
+    int x = (targetWidth  - w) / 2;
+    int y = (targetHeight - h) / 2;
+
+    glBindFramebuffer(GL_FRAMEBUFFER, targetFbo);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, m_fbo);
+    glBlitFramebuffer(0, 0, m_width, m_height, x, y, x + w, y + h, GL_COLOR_BUFFER_BIT, GL_LINEAR);
+    glBindFramebuffer(GL_FRAMEBUFFER, targetFbo);
+}
+
+void FrameCapture::finish()
+{
+    for (size_t i = 0; i < m_pbos.size(); i++) {
+        int pbo = (m_nextPbo + i) % m_pbos.size();
+        if (m_pboFrames[pbo] >= 0) {
+            readBack(pbo);
+        }
+    }
+    m_pool.waitForDone();
+}
+
+// ================== Private Helpers
+
+void FrameCapture::readBack(int pbo)
+{
+    GLsync &fence = m_fences[pbo];
+    GLenum status = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+    if (status == GL_TIMEOUT_EXPIRED) {
+        m_stalls++;
+        do {
+            status = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, FENCE_TIMEOUT);
+        } while (status == GL_TIMEOUT_EXPIRED);
+    }
+    glDeleteSync(fence);
+    fence = nullptr;
+
+    size_t size = static_cast<size_t>(m_width) * m_height * 4;
+    std::vector<unsigned char> *pixels = acquireBuffer();
+
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, m_pbos[pbo]);
+    const void *src = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, size, GL_MAP_READ_BIT);
+    if (src != nullptr) {
+        std::memcpy(pixels->data(), src, size);
+    }
+    glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    int frame = m_pboFrames[pbo];
+    m_pboFrames[pbo] = -1;
+    m_pool.start([this, pixels, frame]() { encode(pixels, frame); });
+}
+
+std::vector<unsigned char> *FrameCapture::acquireBuffer()
+{
+    std::unique_lock<std::mutex> lock(m_bufferMutex);
+    if (m_buffersInFlight >= MAX_IN_FLIGHT) {
+        // The encoders are behind; block rather than drop frames from the sequence
+        m_stalls++;
+        m_bufferReturned.wait(lock, [this]() { return m_buffersInFlight < MAX_IN_FLIGHT; });
+    }
+    m_buffersInFlight++;
+
+    if (m_freeBuffers.empty()) {
+        return new std::vector<unsigned char>(static_cast<size_t>(m_width) * m_height * 4);
+    }
+    std::vector<unsigned char> *buffer = m_freeBuffers.back();
+    m_freeBuffers.pop_back();
+    return buffer;
+}
+
+void FrameCapture::releaseBuffer(std::vector<unsigned char> *buffer)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_bufferMutex);
+        m_freeBuffers.push_back(buffer);
+        m_buffersInFlight--;
+    }
+    m_bufferReturned.notify_one();
+}
+
+// Runs on the thread pool
+void FrameCapture::encode(std::vector<unsigned char> *pixels, int frame)
+{
+    char filename[64];
+    const char *extension = m_format == Format::PNG ? "png" : "ppm";
+    std::snprintf(filename, sizeof(filename), "/frame_%05d.%s", frame, extension);
+    std::string path = m_outputDir + filename;
+
+    // OpenGL rows start at the bottom of the image, so both writers flip vertically
+    if (m_format == Format::PNG) {
+        QImage image(pixels->data(), m_width, m_height, m_width * 4, QImage::Format_RGBA8888);
+        if (!image.mirrored().save(QString::fromStdString(path))) {
+            std::cerr << "Failed to write " << path << std::endl;
+        }
+    } else {
+        FILE *file = std::fopen(path.c_str(), "wb");
+        if (file == nullptr) {
+            std::cerr << "Failed to write " << path << std::endl;
+        } else {
+            std::fprintf(file, "P6\n%d %d\n255\n", m_width, m_height);
+            std::vector<unsigned char> row(m_width * 3);
+            for (int y = m_height - 1; y >= 0; y--) {
+                const unsigned char *src = pixels->data() + static_cast<size_t>(y) * m_width * 4;
+                for (int x = 0; x < m_width; x++) {
+                    row[3 * x + 0] = src[4 * x + 0];
+                    row[3 * x + 1] = src[4 * x + 1];
+                    row[3 * x + 2] = src[4 * x + 2];
+                }
+                std::fwrite(row.data(), 1, row.size(), file);
+            }
+            std::fclose(file);
+        }
+    }
+
+    releaseBuffer(pixels);
+    m_framesWritten++;
+}
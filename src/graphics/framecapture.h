@@ -0,0 +1,75 @@
+#pragma once
+
+#include <GL/glew.h>
+#include <QThreadPool>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Renders frames into an offscreen framebuffer at a fixed resolution and writes them out as an image
+// sequence. Read-back goes through a ring of pixel buffer objects: glReadPixels into a PBO returns
+// immediately, and the PBO is only mapped a few frames later once its fence has signalled. Encoding and
+// file writing happen on a thread pool, using pixel buffers recycled from a small pool.
+class FrameCapture
+{
+public:
+    enum class Format { PPM, PNG };
+
+    static const int DEFAULT_PBOS  = 3;
+    static const int MAX_IN_FLIGHT = 16; // Frames waiting to be encoded before capture starts blocking
+
+    FrameCapture();
+    ~FrameCapture();
+
+    void init(int width, int height, const std::string &outputDir, Format format = Format::PPM, int numPbos = DEFAULT_PBOS);
+    void destroy();
+
+    // Everything drawn between beginFrame() and endFrame() is captured. endFrame() rebinds `restoreFbo`
+    // (QOpenGLWidget does not render into framebuffer 0).
+    void beginFrame();
+    void endFrame(GLuint restoreFbo);
+
+    // Copies the last captured frame into `targetFbo`, scaled to fit
+    void blitTo(GLuint targetFbo, int targetWidth, int targetHeight);
+
+    // Reads back every pending PBO and waits for the encoders to finish
+    void finish();
+
+    int  getWidth()  const { return m_width; }
+    int  getHeight() const { return m_height; }
+    int  getFramesWritten() const { return m_framesWritten.load(); }
+    int  getStalls()        const { return m_stalls; } // Times endFrame() waited on the GPU or the encoders
+
+private:
+    void readBack(int pbo);
+    std::vector<unsigned char> *acquireBuffer();
+    void releaseBuffer(std::vector<unsigned char> *buffer);
+    void encode(std::vector<unsigned char> *pixels, int frame);
+
+    GLuint m_fbo;
+    GLuint m_colorRbo;
+    GLuint m_depthRbo;
+
+    std::vector<GLuint> m_pbos;
+    std::vector<GLsync> m_fences;
+    std::vector<int>    m_pboFrames;  // Frame number held by each PBO, or -1
+    int                 m_nextPbo;
+
+    int         m_width;
+    int         m_height;
+    std::string m_outputDir;
+    Format      m_format;
+    int         m_frame;
+    int         m_stalls;
+
+    // Pixel buffers are recycled between the GL thread and the encoders
+    QThreadPool m_pool;
+    std::mutex  m_bufferMutex;
+    std::condition_variable m_bufferReturned;
+    std::vector<std::vector<unsigned char> *> m_freeBuffers;
+    int                     m_buffersInFlight;
+
+    std::atomic<int> m_framesWritten;
+};
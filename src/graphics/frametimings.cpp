@@ -0,0 +1,45 @@
+#include "graphics/frametimings.h"
+
+#include <algorithm>
+#include <cmath>
+
+FrameTimings::FrameTimings(size_t capacity)
+    : m_samples(capacity),
+      m_next(0),
+      m_count(0)
+{
+}
+
+void FrameTimings::addSample(double ms)
+{
+    m_samples[m_next] = ms;
+    m_next = (m_next + 1) % m_samples.size();
+    m_count = std::min(m_count + 1, m_samples.size());
+}
+
+void FrameTimings::clear()
+{
+    m_next  = 0;
+    m_count = 0;
+}
+
+double FrameTimings::getMean() const
+{
+    if (m_count == 0) return 0;
+
+    double sum = 0;
+    for (size_t i = 0; i < m_count; i++) sum += m_samples[i];
+    return sum / m_count;
+}
+
+double FrameTimings::getPercentile(double p) const
+{
+    if (m_count == 0) return 0;
+
+    std::vector<double> sorted(m_samples.begin(), m_samples.begin() + m_count);
+    // Nearest-rank percentile
+    size_t rank = static_cast<size_t>(std::ceil(p / 100.0 * m_count));
+    rank = std::clamp<size_t>(rank, 1, m_count) - 1;
+    std::nth_element(sorted.begin(), sorted.begin() + rank, sorted.end());
+    return sorted[rank];
+}
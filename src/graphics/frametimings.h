@@ -0,0 +1,23 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+// Keeps the most recent frame times (in milliseconds) and answers mean/percentile queries over them
+class FrameTimings
+{
+public:
+    FrameTimings(size_t capacity);
+
+    void addSample(double ms);
+    void clear();
+
+    size_t getCount() const { return m_count; }
+    double getMean() const;
+    double getPercentile(double p) const; // p in [0, 100]
+
+private:
+    std::vector<double> m_samples;
+    size_t m_next;
+    size_t m_count;
+};
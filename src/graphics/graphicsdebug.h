@@ -5,6 +5,9 @@
 
 #define GRAPHICS_DEBUG_LEVEL 0
 
+// How long each glClientWaitSync call in a wait loop blocks before checking again (in nanoseconds)
+const GLuint64 FENCE_TIMEOUT = 1000000;
+
 void checkError(std::string prefix = "");
 void printGLErrorCodeInEnglish(GLenum err);
 
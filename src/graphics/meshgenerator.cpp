@@ -0,0 +1,181 @@
+#include "graphics/meshgenerator.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <functional>
+#include <iostream>
+#include <numeric>
+#include <random>
+
+using namespace Eigen;
+
+namespace {
+
+// Cube corners are numbered i + 2j + 4k. Every tet contains the 0-7 diagonal, so neighbouring cubes split
+// their shared faces the same way and the mesh is conforming.
+const int SIX_TET_SPLIT[6][4] = {
+    {0, 1, 3, 7}, {0, 3, 2, 7}, {0, 2, 6, 7}, {0, 6, 4, 7}, {0, 4, 5, 7}, {0, 5, 1, 7}
+};
+
+// A central tet plus the four corners cut off around it. Each cube face is split along one diagonal, and the
+// mirrored split on odd cubes uses the other, so the pattern has to alternate like a checkerboard.
+const int FIVE_TET_SPLIT_EVEN[5][4] = {
+    {1, 2, 4, 7}, {0, 1, 2, 4}, {3, 2, 1, 7}, {5, 4, 7, 1}, {6, 7, 4, 2}
+};
+const int FIVE_TET_SPLIT_ODD[5][4] = {
+    {0, 3, 5, 6}, {1, 0, 3, 5}, {2, 3, 0, 6}, {4, 5, 6, 0}, {7, 6, 5, 3}
+};
+
+void orientPositively(const std::vector<Vector3d> &vertices, Vector4i &tet)
+{
+    Matrix3d edges;
+    edges << vertices[tet[1]] - vertices[tet[0]],
+             vertices[tet[2]] - vertices[tet[0]],
+             vertices[tet[3]] - vertices[tet[0]];
+    if (edges.determinant() < 0) std::swap(tet[1], tet[2]);
+}
+
+// Splits every cube of an nx * ny * nz grid (spanning `origin` to `origin + size`) for which `inside(centre)`
+// holds, keeping only the grid points those cubes use
+void generateGrid(int nx, int ny, int nz, const Vector3d &origin, const Vector3d &size,
+                  const std::function<bool(const Vector3d &)> &inside,
+                  std::vector<Vector3d> &vertices, std::vector<Vector4i> &tets,
+                  const MeshGenerator::Options &options)
+{
+    vertices.clear();
+    tets.clear();
+
+    Vector3d spacing = size.cwiseQuotient(Vector3d(nx, ny, nz));
+    auto gridPoint = [&](int i, int j, int k) -> Vector3d { return origin + spacing.cwiseProduct(Vector3d(i, j, k)); };
+    auto gridIndex = [&](int i, int j, int k) { return i + static_cast<size_t>(nx + 1) * (j + static_cast<size_t>(ny + 1) * k); };
+
+    // Grid points get a vertex index the first time a kept cube uses them
+    std::vector<int> vertexIndex(static_cast<size_t>(nx + 1) * (ny + 1) * (nz + 1), -1);
+    for (int k = 0; k < nz; k++) {
+        for (int j = 0; j < ny; j++) {
+            for (int i = 0; i < nx; i++) {
+                if (!inside(gridPoint(i, j, k) + spacing / 2)) continue;
+
+                int corners[8];
+                for (int c = 0; c < 8; c++) {
+                    int ci = i + (c & 1), cj = j + ((c >> 1) & 1), ck = k + ((c >> 2) & 1);
+                    int &index = vertexIndex[gridIndex(ci, cj, ck)];
+                    if (index < 0) {
+                        index = vertices.size();
+                        vertices.push_back(gridPoint(ci, cj, ck));
+                    }
+                    corners[c] = index;
+                }
+
+                auto addTets = [&](const int (*split)[4], int count) {
+                    for (int t = 0; t < count; t++) {
+                        tets.emplace_back(corners[split[t][0]], corners[split[t][1]], corners[split[t][2]], corners[split[t][3]]);
+                    }
+                };
+                if (options.split == CubeSplit::Six) {
+                    addTets(SIX_TET_SPLIT, 6);
+                } else {
+                    addTets((i + j + k) % 2 == 0 ? FIVE_TET_SPLIT_EVEN : FIVE_TET_SPLIT_ODD, 5);
+                }
+            }
+        }
+    }
+
+    std::mt19937_64 rng(options.seed);
+    if (options.jitter > 0) {
+        std::uniform_real_distribution<double> offset(-options.jitter, options.jitter);
+        for (Vector3d &v : vertices) {
+            v += spacing.cwiseProduct(Vector3d(offset(rng), offset(rng), offset(rng)));
+        }
+    }
+
+    if (options.shuffle) {
+        std::vector<int> permutation(vertices.size());
+        std::iota(permutation.begin(), permutation.end(), 0);
+        std::shuffle(permutation.begin(), permutation.end(), rng);
+
+        std::vector<Vector3d> shuffled(vertices.size());
+        for (size_t v = 0; v < vertices.size(); v++) shuffled[permutation[v]] = vertices[v];
+        vertices.swap(shuffled);
+        for (Vector4i &tet : tets) {
+            for (int i = 0; i < 4; i++) tet[i] = permutation[tet[i]];
+        }
+        std::shuffle(tets.begin(), tets.end(), rng);
+    }
+
+    for (Vector4i &tet : tets) orientPositively(vertices, tet);
+}
+
+}
+
+void MeshGenerator::generateBox(int nx, int ny, int nz, const Eigen::Vector3d &size,
+                                std::vector<Eigen::Vector3d> &vertices, std::vector<Eigen::Vector4i> &tets,
+                                const Options &options)
+{
+    generateGrid(nx, ny, nz, Vector3d::Zero(), size, [](const Vector3d &) { return true; },
+                 vertices, tets, options);
+}
+
+void MeshGenerator::generateSphere(int resolution, double radius,
+                                   std::vector<Eigen::Vector3d> &vertices, std::vector<Eigen::Vector4i> &tets,
+                                   const Options &options)
+{
+    generateGrid(resolution, resolution, resolution, Vector3d::Constant(-radius), Vector3d::Constant(2 * radius),
+                 [radius](const Vector3d &p) { return p.squaredNorm() <= radius * radius; },
+                 vertices, tets, options);
+}
+
+void MeshGenerator::generateRod(int resolution, double length, double radius,
+                                std::vector<Eigen::Vector3d> &vertices, std::vector<Eigen::Vector4i> &tets,
+                                const Options &options)
+{
+    // Roughly cubic cells along the length too
+    int segments = std::max(1, static_cast<int>(std::lround(resolution * length / (2 * radius))));
+    generateGrid(segments, resolution, resolution, Vector3d(0, -radius, -radius), Vector3d(length, 2 * radius, 2 * radius),
+                 [radius](const Vector3d &p) { return p.y() * p.y() + p.z() * p.z() <= radius * radius; },
+                 vertices, tets, options);
+}
+
+bool MeshGenerator::writeTetMesh(const std::string &path,
+                                 const std::vector<Eigen::Vector3d> &vertices, const std::vector<Eigen::Vector4i> &tets)
+{
+    FILE *file = std::fopen(path.c_str(), "w");
+    if (file == nullptr) {
+        std::cerr << "Error opening file: " << path << std::endl;
+        return false;
+    }
+
+    // Format into a large buffer and write it in chunks, so that huge meshes aren't bound by per-line calls
+    const size_t flushSize = 1 << 20;
+    std::string text;
+    text.reserve(flushSize + 128);
+    char line[128];
+    bool ok = true;
+    auto flush = [&](bool force) {
+        if (text.size() >= flushSize || force) {
+            ok = ok && std::fwrite(text.data(), 1, text.size(), file) == text.size();
+            text.clear();
+        }
+    };
+    for (const Vector3d &v : vertices) {
+        // Fixed point, since loadTetMesh doesn't read exponents
+        int n = std::snprintf(line, sizeof(line), "v %.9f %.9f %.9f\n", v[0], v[1], v[2]);
+        text.append(line, n);
+        flush(false);
+    }
+    for (const Vector4i &t : tets) {
+        int n = std::snprintf(line, sizeof(line), "t %d %d %d %d\n", t[0], t[1], t[2], t[3]);
+        text.append(line, n);
+        flush(false);
+    }
+    flush(true);
+
+    ok = std::fclose(file) == 0 && ok;
+    if (!ok) std::cerr << "Failed to write " << path << std::endl;
+    return ok;
+}
+
+MeshGenerator::MeshGenerator()
+{
+
+}
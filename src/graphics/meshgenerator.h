@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "Eigen/Dense"
+
+enum class CubeSplit {
+    Five, // Four corner tets around a central one, mirrored on alternate cubes so that faces match up
+    Six   // Six tets around the cube's main diagonal
+};
+
+struct MeshGeneratorOptions {
+    CubeSplit split   = CubeSplit::Six;
+    double    jitter  = 0;     // Random vertex offset as a fraction of the cell size; keep below ~0.2
+    bool      shuffle = false; // Randomly permute vertices and tets, destroying memory locality
+    uint64_t  seed    = 0;
+};
+
+// Procedural tetrahedral meshes for tests and benchmarks.
+//
+// Every shape is a regular grid of cubes, each split into tets; spheres and rods keep the cubes whose centres
+// lie inside the shape. Tets are always positively oriented.
+class MeshGenerator
+{
+public:
+    using Options = MeshGeneratorOptions;
+
+    // nx * ny * nz cubes with the minimum corner at the origin
+    static void generateBox(int nx, int ny, int nz, const Eigen::Vector3d &size,
+                            std::vector<Eigen::Vector3d> &vertices, std::vector<Eigen::Vector4i> &tets,
+                            const Options &options = Options());
+
+    // `resolution` cubes across the diameter, centred on the origin
+    static void generateSphere(int resolution, double radius,
+                               std::vector<Eigen::Vector3d> &vertices, std::vector<Eigen::Vector4i> &tets,
+                               const Options &options = Options());
+
+    // A cylinder along x from the origin, with `resolution` cubes across its diameter
+    static void generateRod(int resolution, double length, double radius,
+                            std::vector<Eigen::Vector3d> &vertices, std::vector<Eigen::Vector4i> &tets,
+                            const Options &options = Options());
+
+    // Writes the "v x y z" / "t a b c d" format read by MeshLoader::loadTetMesh
+    static bool writeTetMesh(const std::string &path,
+                             const std::vector<Eigen::Vector3d> &vertices, const std::vector<Eigen::Vector4i> &tets);
+private:
+    MeshGenerator();
+};
@@ -47,6 +47,29 @@ bool MeshLoader::loadTetMesh(const std::string &filepath, std::vector<Eigen::Vec
     return true;
 }
 
+bool MeshLoader::loadTriangleMesh(const std::string &filepath, std::vector<Eigen::Vector3d> &vertices, std::vector<Eigen::Vector3i> &faces)
+{
+    tinyobj::attrib_t attrib;
+    std::vector<tinyobj::shape_t> shapes;
+    std::vector<tinyobj::material_t> materials;
+    std::string err;
+    if (!tinyobj::LoadObj(&attrib, &shapes, &materials, &err, filepath.c_str())) {
+        std::cout << "Error loading " << filepath << ": " << err << std::endl;
+        return false;
+    }
+
+    for (size_t v = 0; v + 2 < attrib.vertices.size(); v += 3) {
+        vertices.emplace_back(attrib.vertices[v], attrib.vertices[v + 1], attrib.vertices[v + 2]);
+    }
+    for (const tinyobj::shape_t &shape : shapes) {
+        const std::vector<tinyobj::index_t> &indices = shape.mesh.indices;
+        for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+            faces.emplace_back(indices[i].vertex_index, indices[i + 1].vertex_index, indices[i + 2].vertex_index);
+        }
+    }
+    return true;
+}
+
 MeshLoader::MeshLoader()
 {
 
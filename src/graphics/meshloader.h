@@ -10,6 +10,9 @@ class MeshLoader
 {
 public:
     static bool loadTetMesh(const std::string &filepath, std::vector<Eigen::Vector3d> &vertices, std::vector<Eigen::Vector4i> &tets);
+
+    // Every shape in an OBJ file, triangulated and merged into one mesh
+    static bool loadTriangleMesh(const std::string &filepath, std::vector<Eigen::Vector3d> &vertices, std::vector<Eigen::Vector3i> &faces);
 private:
     MeshLoader();
 };
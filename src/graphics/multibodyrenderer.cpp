@@ -0,0 +1,195 @@
+#include "graphics/multibodyrenderer.h"
+#include "graphics/shader.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <iostream>
+
+using namespace Eigen;
+
+MultiBodyRenderer::MultiBodyRenderer()
+    : m_vao(0),
+      m_ibo(0),
+      m_instanceVbo(0),
+      m_positionTexture(0),
+      m_mapped(nullptr),
+      m_handleProgram(0),
+      m_instancesDirty(true),
+      m_verticesPerBody(0),
+      m_maxBodies(0),
+      m_numBodies(0),
+      m_numIndices(0),
+      m_drawCalls(0),
+      m_submitTime(0),
+      m_uploadBytes(0)
+{
+}
+
+MultiBodyRenderer::~MultiBodyRenderer()
+{
+    destroy();
+}
+
+void MultiBodyRenderer::init(const std::vector<Eigen::Vector3i> &faces, int verticesPerBody, int maxBodies)
+{
+    m_verticesPerBody = verticesPerBody;
+    m_maxBodies       = maxBodies;
+    m_numBodies       = maxBodies;
+    m_numIndices      = faces.size() * 3;
+
+    Instance identity;
+    Map<Matrix4f>(identity.model) = Matrix4f::Identity();
+    Map<Vector4f>(identity.color) = Vector4f::Ones();
+    m_instances.assign(maxBodies, identity);
+
+    // Positions for every body, streamed as a ring and sampled as a texture buffer. They are padded to RGBA32F,
+    // since three-component buffer textures need GL 4.0 (or ARB_texture_buffer_object_rgb32) and this keeps 3.1.
+    m_positions.init(sizeof(float) * 4 * verticesPerBody * maxBodies);
+    glGenTextures(1, &m_positionTexture);
+    glBindTexture(GL_TEXTURE_BUFFER, m_positionTexture);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, m_positions.getBufferID());
+    glBindTexture(GL_TEXTURE_BUFFER, 0);
+
+    glGenBuffers(1, &m_ibo);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_ibo);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(int) * 3 * faces.size(), static_cast<const void *>(faces.data()), GL_STATIC_DRAW);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+
+    glGenBuffers(1, &m_instanceVbo);
+    glBindBuffer(GL_ARRAY_BUFFER, m_instanceVbo);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(Instance) * maxBodies, nullptr, GL_DYNAMIC_DRAW);
+
+    // The model matrix takes four vec4 attribute slots (2-5), followed by the colour (6)
+    glGenVertexArrays(1, &m_vao);
+    glBindVertexArray(m_vao);
+    for (int column = 0; column < 4; column++) {
+        glEnableVertexAttribArray(2 + column);
+        glVertexAttribPointer(2 + column, 4, GL_FLOAT, GL_FALSE, sizeof(Instance), reinterpret_cast<GLvoid *>(sizeof(float) * 4 * column));
+        glVertexAttribDivisor(2 + column, 1);
+    }
+    glEnableVertexAttribArray(6);
+    glVertexAttribPointer(6, 4, GL_FLOAT, GL_FALSE, sizeof(Instance), reinterpret_cast<GLvoid *>(offsetof(Instance, color)));
+    glVertexAttribDivisor(6, 1);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_ibo);
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+}
+
+// ================== Updating Bodies
+
+void MultiBodyRenderer::beginUpdate()
+{
+    m_mapped = static_cast<float *>(m_positions.beginWrite());
+}
+
+void MultiBodyRenderer::setBodyVertices(int body, const std::vector<Eigen::Vector3d> &vertices)
+{
+    if (static_cast<int>(vertices.size()) != m_verticesPerBody) {
+        std::cerr << "Body " << body << " has " << vertices.size() << " vertices, expected " << m_verticesPerBody << std::endl;
+        return;
+    }
+    setBodyVertices(body, vertices.data());
+}
+
+void MultiBodyRenderer::setBodyVertices(int body, const Eigen::Vector3d *vertices)
+{
+    if (m_mapped == nullptr) {
+        std::cerr << "MultiBodyRenderer::setBodyVertices called outside of beginUpdate/endUpdate" << std::endl;
+        return;
+    }
+    float *dst = m_mapped + 4 * static_cast<size_t>(body) * m_verticesPerBody;
+    for (int i = 0; i < m_verticesPerBody; i++) {
+        dst[4 * i + 0] = static_cast<float>(vertices[i][0]);
+        dst[4 * i + 1] = static_cast<float>(vertices[i][1]);
+        dst[4 * i + 2] = static_cast<float>(vertices[i][2]);
+        dst[4 * i + 3] = 1;
+    }
+    m_uploadBytes += sizeof(float) * 4 * static_cast<uint64_t>(m_verticesPerBody);
+}
+
+void MultiBodyRenderer::endUpdate()
+{
+    m_positions.endWrite();
+    m_mapped = nullptr;
+}
+
+void MultiBodyRenderer::setBodyCount(int numBodies)
+{
+    m_numBodies = std::min(numBodies, m_maxBodies);
+}
+
+void MultiBodyRenderer::setModelMatrix(int body, const Eigen::Affine3f &model)
+{
+    Map<Matrix4f>(m_instances[body].model) = model.matrix();
+    m_instancesDirty = true;
+}
+
+void MultiBodyRenderer::setColor(int body, const Eigen::Vector4f &color)
+{
+    Map<Vector4f>(m_instances[body].color) = color;
+    m_instancesDirty = true;
+}
+
+// ================== Drawing
+
+void MultiBodyRenderer::draw(Shader *shader)
+{
+    auto start = std::chrono::steady_clock::now();
+
+    if (m_instancesDirty) {
+        uploadInstances();
+    }
+
+    if (shader->getProgramID() != m_handleProgram) {
+        m_positionsHandle       = shader->getUniformHandle("positions");
+        m_regionBaseHandle      = shader->getUniformHandle("regionBase");
+        m_verticesPerBodyHandle = shader->getUniformHandle("verticesPerBody");
+        m_handleProgram         = shader->getProgramID();
+    }
+
+    // All bodies of the current ring region start at this texel
+    int regionBase = m_positions.getRegionIndex() * m_maxBodies * m_verticesPerBody;
+    shader->setUniform(m_positionsHandle, 0);
+    shader->setUniform(m_regionBaseHandle, regionBase);
+    shader->setUniform(m_verticesPerBodyHandle, m_verticesPerBody);
+
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_BUFFER, m_positionTexture);
+    glBindVertexArray(m_vao);
+    glDrawElementsInstanced(GL_TRIANGLES, m_numIndices, GL_UNSIGNED_INT, reinterpret_cast<GLvoid *>(0), m_numBodies);
+    glBindVertexArray(0);
+    glBindTexture(GL_TEXTURE_BUFFER, 0);
+    m_positions.fence();
+
+    m_drawCalls  = 1;
+    m_submitTime = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// ================== Private Helpers
+
+void MultiBodyRenderer::uploadInstances()
+{
+    glBindBuffer(GL_ARRAY_BUFFER, m_instanceVbo);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(Instance) * m_instances.size(), static_cast<const void *>(m_instances.data()));
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    m_uploadBytes   += sizeof(Instance) * m_instances.size();
+    m_instancesDirty = false;
+}
+
+void MultiBodyRenderer::destroy()
+{
+    // Nothing was created in a renderer that was never initialised, e.g. outside the drop scene
+    if (m_vao == 0) return;
+
+    glDeleteVertexArrays(1, &m_vao);
+    glDeleteBuffers(1, &m_ibo);
+    glDeleteBuffers(1, &m_instanceVbo);
+    glDeleteTextures(1, &m_positionTexture);
+    m_positions.destroy();
+    m_vao             = 0;
+    m_ibo             = 0;
+    m_instanceVbo     = 0;
+    m_positionTexture = 0;
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <GL/glew.h>
+#include <cstdint>
+#include <vector>
+
+#include <Eigen/Dense>
+
+#include "graphics/shader.h"
+#include "graphics/streambuffer.h"
+
+// Draws many deformable bodies that share one surface topology with a single glDrawElementsInstanced.
+//
+// Every body's positions are packed back to back into one streamed buffer that the vertex shader reads
+// as a texture buffer (body b, vertex v lives at texel b * verticesPerBody + v), so each instance can
+// deform independently. Per-instance model matrices and colours come from an instance attribute buffer.
+// Normals are derived in the fragment shader, so only positions are uploaded.
+class MultiBodyRenderer
+{
+public:
+    MultiBodyRenderer();
+    ~MultiBodyRenderer();
+
+    void init(const std::vector<Eigen::Vector3i> &faces, int verticesPerBody, int maxBodies);
+
+    // Vertex updates for all bodies go between beginUpdate() and endUpdate()
+    void beginUpdate();
+    void setBodyVertices(int body, const std::vector<Eigen::Vector3d> &vertices);
+    void setBodyVertices(int body, const Eigen::Vector3d *vertices);
+    void endUpdate();
+
+    void setBodyCount(int numBodies);
+    void setModelMatrix(int body, const Eigen::Affine3f &model);
+    void setColor(int body, const Eigen::Vector4f &color);
+
+    // Expects a shader built from instanced.vert/instanced.frag
+    void draw(Shader *shader);
+
+    int    getBodyCount()  const { return m_numBodies; }
+    int    getDrawCalls()  const { return m_drawCalls; }   // Issued by the last draw()
+    double getSubmitTime() const { return m_submitTime; }  // CPU time of the last draw(), in milliseconds
+    // Total bytes of positions and instance attributes written so far
+    uint64_t getUploadBytes() const { return m_uploadBytes; }
+
+private:
+    // Per-instance attributes, matching locations 2-6 in instanced.vert
+    struct Instance {
+        float model[16];
+        float color[4];
+    };
+
+    void uploadInstances();
+    void destroy();
+
+    GLuint m_vao;
+    GLuint m_ibo;
+    GLuint m_instanceVbo;
+    GLuint m_positionTexture;
+
+    StreamBuffer m_positions;
+    float       *m_mapped;
+
+    // Resolved the first time a given program draws us
+    GLuint        m_handleProgram;
+    UniformHandle m_positionsHandle;
+    UniformHandle m_regionBaseHandle;
+    UniformHandle m_verticesPerBodyHandle;
+
+    std::vector<Instance> m_instances;
+    bool                  m_instancesDirty;
+
+    int m_verticesPerBody;
+    int m_maxBodies;
+    int m_numBodies;
+    int m_numIndices;
+
+    int      m_drawCalls;
+    double   m_submitTime;
+    uint64_t m_uploadBytes;
+};
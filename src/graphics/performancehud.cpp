@@ -0,0 +1,82 @@
+#include "graphics/performancehud.h"
+
+#include <QColor>
+#include <QFont>
+#include <QPainter>
+#include <QRect>
+#include <QString>
+#include <cstdio>
+
+namespace {
+
+const int HUD_MARGIN      = 8;
+const int HUD_LINE_HEIGHT = 16;
+const int HUD_WIDTH       = 330;
+const int HUD_LINES       = 7;
+
+}
+
+PerformanceHud::PerformanceHud(size_t window)
+    : m_frameMs(window),
+      m_stepMs(window),
+      m_substeps(window),
+      m_uploadBytes(window),
+      m_busySeconds(window),
+      m_availableSeconds(window),
+      m_drawCalls(window),
+      m_submitMs(window)
+{
+}
+
+void PerformanceHud::reset(const Simulation::Stats &stats)
+{
+    m_frameMs.clear();
+    m_stepMs.clear();
+    m_substeps.clear();
+    m_uploadBytes.clear();
+    m_busySeconds.clear();
+    m_availableSeconds.clear();
+    m_drawCalls.clear();
+    m_submitMs.clear();
+    m_last = stats;
+}
+
+void PerformanceHud::update(double frameMs, const Simulation::Stats &stats)
+{
+    m_frameMs.addSample(frameMs);
+    m_stepMs.addSample(1e3 * (stats.stepSeconds - m_last.stepSeconds));
+    m_substeps.addSample(static_cast<double>(stats.steps - m_last.steps));
+    m_uploadBytes.addSample(static_cast<double>(stats.uploadBytes - m_last.uploadBytes));
+    m_busySeconds.addSample(stats.threadBusySeconds - m_last.threadBusySeconds);
+    m_availableSeconds.addSample(stats.threadAvailableSeconds - m_last.threadAvailableSeconds);
+    m_drawCalls.addSample(stats.drawCalls);
+    m_submitMs.addSample(stats.submitMs);
+    m_last = stats;
+}
+
+void PerformanceHud::draw(QPainter &painter, int vertexCount, int tetCount, int threadCount) const
+{
+    double available   = m_availableSeconds.getMean();
+    double utilization = available > 0 ? 100 * m_busySeconds.getMean() / available : 0;
+
+    char lines[HUD_LINES][96];
+    std::snprintf(lines[0], sizeof(lines[0]), "Frame     %6.2f ms  p99 %6.2f ms",
+                  m_frameMs.getMean(), m_frameMs.getPercentile(99));
+    std::snprintf(lines[1], sizeof(lines[1]), "Sim step  %6.2f ms  p99 %6.2f ms",
+                  m_stepMs.getMean(), m_stepMs.getPercentile(99));
+    std::snprintf(lines[2], sizeof(lines[2]), "Substeps  %6.1f per frame", m_substeps.getMean());
+    std::snprintf(lines[3], sizeof(lines[3]), "Upload    %6.1f KB per frame", m_uploadBytes.getMean() / 1024);
+    std::snprintf(lines[4], sizeof(lines[4]), "Mesh      %d vertices, %d tets", vertexCount, tetCount);
+    std::snprintf(lines[5], sizeof(lines[5]), "Threads   %d, %.0f%% busy in force loop", threadCount, utilization);
+    std::snprintf(lines[6], sizeof(lines[6]), "Draws     %4.1f calls, %6.3f ms submit",
+                  m_drawCalls.getMean(), m_submitMs.getMean());
+
+    QFont font("Monospace", 10);
+    font.setStyleHint(QFont::TypeWriter);
+    painter.setFont(font);
+    painter.fillRect(QRect(HUD_MARGIN, HUD_MARGIN, HUD_WIDTH, HUD_LINE_HEIGHT * HUD_LINES + HUD_MARGIN), QColor(0, 0, 0, 160));
+    painter.setPen(QColor(255, 255, 255));
+    for (int i = 0; i < HUD_LINES; i++) {
+        painter.drawText(2 * HUD_MARGIN, HUD_MARGIN + HUD_LINE_HEIGHT * (i + 1), QString(lines[i]));
+    }
+}
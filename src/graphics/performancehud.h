@@ -0,0 +1,37 @@
+#pragma once
+
+#include "graphics/frametimings.h"
+#include "simulation.h"
+
+class QPainter;
+
+// Text overlay with rolling averages of frame time, simulation cost, uploads, thread utilization and the
+// instanced renderer's draw calls and submit time.
+//
+// It only ever looks at the Simulation::Stats totals and the frame time GLWidget already measures:
+// update() takes the difference between two snapshots of the totals (the renderer's per-frame figures are
+// sampled as they are), so nothing extra is measured, and
+// while the overlay is hidden nothing is sampled at all.
+class PerformanceHud
+{
+public:
+    PerformanceHud(size_t window);
+
+    // Forgets the rolling window; call when the overlay is shown again
+    void reset(const Simulation::Stats &stats);
+
+    void update(double frameMs, const Simulation::Stats &stats);
+    void draw(QPainter &painter, int vertexCount, int tetCount, int threadCount) const;
+
+private:
+    FrameTimings m_frameMs;
+    FrameTimings m_stepMs;          // Simulation time per frame, over all substeps
+    FrameTimings m_substeps;
+    FrameTimings m_uploadBytes;
+    FrameTimings m_busySeconds;     // Thread time spent working in the element loop
+    FrameTimings m_availableSeconds;
+    FrameTimings m_drawCalls;
+    FrameTimings m_submitMs;
+
+    Simulation::Stats m_last;
+};
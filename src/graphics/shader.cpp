@@ -28,7 +28,8 @@ Shader::~Shader()
 Shader::Shader(Shader &&that)
     : m_programID(that.m_programID),
       m_attributes(std::move(that.m_attributes)),
-      m_uniforms(std::move(that.m_uniforms))
+      m_uniforms(std::move(that.m_uniforms)),
+      m_uniformBlocks(std::move(that.m_uniformBlocks))
 {
     that.m_programID = 0;
 }
@@ -40,6 +41,7 @@ Shader& Shader::operator=(Shader &&that)
     m_programID = that.m_programID;
     m_attributes = std::move(that.m_attributes);
     m_uniforms = std::move(that.m_uniforms);
+    m_uniformBlocks = std::move(that.m_uniformBlocks);
 
     that.m_programID = 0;
 
@@ -63,23 +65,55 @@ GLuint Shader::getEnumeratedUniformLocation(std::string name, int index)
     return glGetUniformLocation(m_programID, n.c_str());
 }
 
+UniformHandle Shader::getUniformHandle(const std::string &name) const
+{
+    auto it = m_uniforms.find(name);
+    if (it == m_uniforms.end()) return UniformHandle();
+    return UniformHandle{static_cast<GLint>(it->second)};
+}
+
+void Shader::bindUniformBlock(const std::string &name, GLuint bindingPoint)
+{
+    auto it = m_uniformBlocks.find(name);
+    if (it == m_uniformBlocks.end()) {
+        std::cerr << "Shader has no uniform block named " << name << std::endl;
+        return;
+    }
+    glUniformBlockBinding(m_programID, it->second, bindingPoint);
+}
+
 // ================== Setting Uniforms
 
-// Note: the overload to set matrix uniforms is in the .h file
+// Note: the overloads to set matrix uniforms are in the .h file
 
 void Shader::setUniform(const std::string &name, float f)
 {
-    glUniform1f(m_uniforms[name], f);
+    setUniform(getUniformHandle(name), f);
 }
 
 void Shader::setUniform(const std::string &name, int i)
 {
-    glUniform1i(m_uniforms[name], i);
+    setUniform(getUniformHandle(name), i);
 }
 
 void Shader::setUniform(const std::string &name, bool b)
 {
-    glUniform1i(m_uniforms[name], static_cast<GLint>(b));
+    setUniform(getUniformHandle(name), b);
+}
+
+void Shader::setUniform(UniformHandle handle, float f)
+{
+    if (handle.isValid()) glUniform1f(handle.location, f);
+}
+
+void Shader::setUniform(UniformHandle handle, int i)
+{
+    if (handle.isValid()) glUniform1i(handle.location, i);
+}
+
+void Shader::setUniform(UniformHandle handle, bool b)
+{
+    if (handle.isValid()) glUniform1i(handle.location, static_cast<GLint>(b));
 }
 
 // ================== Creating the Program
@@ -144,6 +178,7 @@ GLuint Shader::createShaderFromString(const std::string &str, GLenum shaderType)
 void Shader::discoverShaderData() {
     discoverAttributes();
     discoverUniforms();
+    discoverUniformBlocks();
 }
 
 void Shader::discoverAttributes() {
@@ -176,6 +211,12 @@ void Shader::discoverUniforms() {
         glGetActiveUniform(m_programID, i, bufSize, &nameLength, &arraySize, &type, name);
         name[std::min(nameLength, bufSize - 1)] = 0;
 
+        // Members of uniform blocks are set through buffers, not locations
+        GLuint uniformIndex = i;
+        GLint blockIndex = -1;
+        glGetActiveUniformsiv(m_programID, 1, &uniformIndex, GL_UNIFORM_BLOCK_INDEX, &blockIndex);
+        if (blockIndex != -1) continue;
+
         std::string strname(name);
         if (isUniformArray(name, nameLength)) {
             addUniformArray(strname, arraySize);
@@ -188,6 +229,19 @@ void Shader::discoverUniforms() {
     unbind();
 }
 
+void Shader::discoverUniformBlocks() {
+    GLint blockCount;
+    glGetProgramiv(m_programID, GL_ACTIVE_UNIFORM_BLOCKS, &blockCount);
+    for (int i = 0; i < blockCount; i++) {
+        const GLsizei bufSize = 256;
+        GLsizei nameLength = 0;
+        GLchar name[bufSize];
+        glGetActiveUniformBlockName(m_programID, i, bufSize, &nameLength, name);
+        name[std::min(nameLength, bufSize - 1)] = 0;
+        m_uniformBlocks[std::string(name)] = i;
+    }
+}
+
 bool Shader::isUniformArray(const GLchar *name, GLsizei nameLength) {
     // Check if the last 3 characters are '[0]'
     return (name[nameLength - 3] == '[') &&
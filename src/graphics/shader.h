@@ -10,6 +10,12 @@
 #include "util/unsupportedeigenthing/OpenGLSupport"
 
 
+// A uniform location resolved once up front, so setting it doesn't go through a name lookup
+struct UniformHandle {
+    GLint location = -1;
+    bool isValid() const { return location >= 0; }
+};
+
 class Shader {
 public:
     Shader(const std::string &vertexPath,
@@ -28,6 +34,10 @@ public:
     void   unbind() const;
     GLuint getUniformLocation(std::string name);
     GLuint getEnumeratedUniformLocation(std::string name, int index);
+    UniformHandle getUniformHandle(const std::string &name) const;
+
+    // Connects a uniform block to a shared binding point (see UniformBuffer)
+    void bindUniformBlock(const std::string &name, GLuint bindingPoint);
 
     // Setting Uniforms
     void setUniform(const std::string &name, float f);
@@ -36,7 +46,17 @@ public:
     template<typename type, int n, int m>
     void setUniform(const std::string &name, const Eigen::Matrix<type, n, m> &mat)
     {
-        glUniform(m_uniforms[name], mat);
+        setUniform(getUniformHandle(name), mat);
+    }
+
+    // Setting Uniforms Through Pre-resolved Handles
+    void setUniform(UniformHandle handle, float f);
+    void setUniform(UniformHandle handle, int   i);
+    void setUniform(UniformHandle handle, bool  b);
+    template<typename type, int n, int m>
+    void setUniform(UniformHandle handle, const Eigen::Matrix<type, n, m> &mat)
+    {
+        if (handle.isValid()) glUniform(handle.location, mat);
     }
 
 
@@ -53,6 +73,7 @@ private:
     void discoverShaderData();
     void discoverAttributes();
     void discoverUniforms();
+    void discoverUniformBlocks();
     bool isUniformArray(const GLchar *name , GLsizei nameLength);
     bool isTexture(GLenum type);
     void addUniform(const std::string &name);
@@ -65,6 +86,7 @@ private:
     // Collections of known attributes/uniforms/textures
     std::map<std::string, GLuint>                     m_attributes;
     std::map<std::string, GLuint>                     m_uniforms;
+    std::map<std::string, GLuint>                     m_uniformBlocks;    // name to block index
     std::map<std::tuple<std::string, size_t>, GLuint> m_uniformArrays;
     std::map<std::string, GLuint>                     m_textureLocations; // name to uniform location
     std::map<GLuint, GLuint>                          m_textureSlots;     // uniform location to texture slot
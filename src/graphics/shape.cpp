@@ -1,18 +1,46 @@
 #include "shape.h"
 
+#include <algorithm>
 #include <iostream>
 
+#include "graphics/flatnormals.h"
 #include "graphics/shader.h"
+#include "profiling/profiler.h"
 
 using namespace Eigen;
 
+namespace {
+
+// Surface vertices are interleaved as (position, normal) in single precision, unless the
+// normals are derived on the GPU, in which case only positions are stored
+const GLsizei SURFACE_STRIDE  = sizeof(float) * 3 * 2;
+const GLsizei POSITION_STRIDE = sizeof(float) * 3;
+const GLsizei TET_STRIDE      = POSITION_STRIDE;
+
+}
+
 Shape::Shape()
-    : m_tetVao(-1),
+    : m_surfaceVao(0),
+      m_tetVao(-1),
+      m_surfaceIbo(0),
+      m_tetIbo(0),
+      m_objectDirty(true),
       m_numSurfaceVertices(),
+      m_numTetVertices(),
+      m_numBufferVertices(),
       m_verticesSize(),
+      m_red(1), m_blue(1), m_green(1), m_alpha(1),
+      m_useRanges(false),
       m_modelMatrix(Eigen::Matrix4f::Identity()),
-      m_wireframe(false)
+      m_wireframe(false),
+      m_gpuNormals(false),
+      m_uploadBytes(0)
+{
+}
+
+Shape::~Shape()
 {
+    destroy();
 }
 
 void Shape::init(const std::vector<Eigen::Vector3d> &vertices, const std::vector<Eigen::Vector3d> &normals, const std::vector<Eigen::Vector3i> &triangles)
@@ -21,88 +49,36 @@ void Shape::init(const std::vector<Eigen::Vector3d> &vertices, const std::vector
         std::cerr << "Vertices and normals are not the same size" << std::endl;
         return;
     }
-    glGenBuffers(1, &m_surfaceVbo);
-    glGenBuffers(1, &m_surfaceIbo);
-    glGenVertexArrays(1, &m_surfaceVao);
-
-    glBindBuffer(GL_ARRAY_BUFFER, m_surfaceVbo);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(double) * vertices.size() * 3 * 2, nullptr, GL_DYNAMIC_DRAW);
-    glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(double) * vertices.size() * 3, static_cast<const void *>(vertices.data()));
-    glBufferSubData(GL_ARRAY_BUFFER, sizeof(double) * vertices.size() * 3, sizeof(double) * vertices.size() * 3, static_cast<const void *>(normals.data()));
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_surfaceIbo);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(int) * 3 * triangles.size(), static_cast<const void *>(triangles.data()), GL_STATIC_DRAW);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
-
-    glBindVertexArray(m_surfaceVao);
-    glBindBuffer(GL_ARRAY_BUFFER, m_surfaceVbo);
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(0, 3, GL_DOUBLE, GL_FALSE, 0, static_cast<GLvoid *>(0));
-    glEnableVertexAttribArray(1);
-    glVertexAttribPointer(1, 3, GL_DOUBLE, GL_FALSE, 0, reinterpret_cast<GLvoid *>(sizeof(double) * vertices.size() * 3));
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_surfaceIbo);
-    glBindVertexArray(0);
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    initSurfaceBuffers(vertices.size(), triangles, true);
 
     m_numSurfaceVertices = triangles.size() * 3;
     m_verticesSize = vertices.size();
     m_faces = triangles;
+
+    setVertices(vertices, normals);
 }
 
 void Shape::init(const std::vector<Eigen::Vector3d> &vertices, const std::vector<Eigen::Vector3i> &triangles)
 {
-    std::vector<Eigen::Vector3d> verts;
-    std::vector<Eigen::Vector3d> normals;
-    std::vector<Eigen::Vector3i> faces;
-    verts.reserve(triangles.size() * 3);
-    normals.reserve(triangles.size() * 3);
-    for(auto& f : triangles) {
-        auto& v1 = vertices[f[0]];
-        auto& v2 = vertices[f[1]];
-        auto& v3 = vertices[f[2]];
-        auto& e1 = v2 - v1;
-        auto& e2 = v3 - v1;
-        auto n = e1.cross(e2);
-        int s = verts.size();
-        faces.push_back(Eigen::Vector3i(s, s + 1, s + 2));
-        normals.push_back(n);
-        normals.push_back(n);
-        normals.push_back(n);
-        verts.push_back(v1);
-        verts.push_back(v2);
-        verts.push_back(v3);
-    }
-    glGenBuffers(1, &m_surfaceVbo);
-    glGenBuffers(1, &m_surfaceIbo);
-    glGenVertexArrays(1, &m_surfaceVao);
-
-    glBindBuffer(GL_ARRAY_BUFFER, m_surfaceVbo);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(double) * verts.size() * 3 * 2, nullptr, GL_DYNAMIC_DRAW);
-    glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(double) * verts.size() * 3, static_cast<const void *>(verts.data()));
-    glBufferSubData(GL_ARRAY_BUFFER, sizeof(double) * verts.size() * 3, sizeof(double) * verts.size() * 3, static_cast<const void *>(normals.data()));
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_surfaceIbo);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(int) * 3 * faces.size(), static_cast<const void *>(faces.data()), GL_STATIC_DRAW);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
-
-    glBindVertexArray(m_surfaceVao);
-    glBindBuffer(GL_ARRAY_BUFFER, m_surfaceVbo);
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(0, 3, GL_DOUBLE, GL_FALSE, 0, static_cast<GLvoid *>(0));
-    glEnableVertexAttribArray(1);
-    glVertexAttribPointer(1, 3, GL_DOUBLE, GL_FALSE, 0, reinterpret_cast<GLvoid *>(sizeof(double) * verts.size() * 3));
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_surfaceIbo);
-    glBindVertexArray(0);
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    if (m_gpuNormals) {
+        // Positions are shared between faces, and the index buffer is just the triangles
+        initSurfaceBuffers(vertices.size(), triangles, false);
+    } else {
+        // Every face gets its own three vertices so that it can carry a flat normal
+        std::vector<Eigen::Vector3i> faces;
+        faces.reserve(triangles.size());
+        for (int s = 0; s < static_cast<int>(triangles.size() * 3); s += 3) {
+            faces.emplace_back(s, s + 1, s + 2);
+        }
+        initSurfaceBuffers(triangles.size() * 3, faces, true);
+    }
 
-    m_numSurfaceVertices = faces.size() * 3;
+    m_numSurfaceVertices = triangles.size() * 3;
     m_verticesSize = vertices.size();
     m_faces = triangles;
 
+    setVertices(vertices);
+
     if (vertices.size() > 4) { //shape
         m_red = 0.93;
         m_green = 0.8;
@@ -133,72 +109,102 @@ void Shape::init(const std::vector<Eigen::Vector3d> &vertices, const std::vector
         lines.emplace_back(tet[1], tet[3]);
         lines.emplace_back(tet[2], tet[3]);
     }
-    glGenBuffers(1, &m_tetVbo);
+    // With GPU normals the surface buffer already holds exactly the tet positions, so the wireframe reads from it
+    if (!m_gpuNormals) {
+        m_tetStream.init(TET_STRIDE * vertices.size());
+    }
     glGenBuffers(1, &m_tetIbo);
     glGenVertexArrays(1, &m_tetVao);
 
-    glBindBuffer(GL_ARRAY_BUFFER, m_tetVbo);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(double) * vertices.size() * 3, vertices.data(), GL_DYNAMIC_DRAW);
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_tetIbo);
     glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(int) * 2 * lines.size(), static_cast<const void *>(lines.data()), GL_STATIC_DRAW);
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
 
     glBindVertexArray(m_tetVao);
-    glBindBuffer(GL_ARRAY_BUFFER, m_tetVbo);
+    glBindBuffer(GL_ARRAY_BUFFER, tetStream().getBufferID());
     glEnableVertexAttribArray(0);
-    glVertexAttribPointer(0, 3, GL_DOUBLE, GL_FALSE, 0, static_cast<GLvoid *>(0));
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, TET_STRIDE, static_cast<GLvoid *>(0));
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_tetIbo);
     glBindVertexArray(0);
     glBindBuffer(GL_ARRAY_BUFFER, 0);
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
 
     m_numTetVertices = lines.size() * 2;
+
+    if (!m_gpuNormals) {
+        writePositions(m_tetStream, vertices);
+    }
 }
 
 void Shape::setVertices(const std::vector<Eigen::Vector3d> &vertices)
 {
+    PROFILE_SCOPE("Shape::setVertices");
     if(vertices.size() != m_verticesSize) {
         std::cerr << "You can't set vertices to a vector that is a different length that what shape was inited with" << std::endl;
         return;
     }
-    std::vector<Eigen::Vector3d> verts;
-    std::vector<Eigen::Vector3d> normals;
-    verts.reserve(m_faces.size() * 3);
-    normals.reserve(m_faces.size() * 3);
-    for(auto& f : m_faces) {
-        auto& v1 = vertices[f[0]];
-        auto& v2 = vertices[f[1]];
-        auto& v3 = vertices[f[2]];
-        auto& e1 = v2 - v1;
-        auto& e2 = v3 - v1;
-        auto n = e1.cross(e2);
-        normals.push_back(n);
-        normals.push_back(n);
-        normals.push_back(n);
-        verts.push_back(v1);
-        verts.push_back(v2);
-        verts.push_back(v3);
-    }
-    glBindBuffer(GL_ARRAY_BUFFER, m_surfaceVbo);
-    glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(double) * verts.size() * 3, static_cast<const void *>(verts.data()));
-    glBufferSubData(GL_ARRAY_BUFFER, sizeof(double) * verts.size() * 3, sizeof(double) * verts.size() * 3, static_cast<const void *>(normals.data()));
+    if (m_gpuNormals) {
+        writePositions(m_surfaceStream, vertices);
+        return;
+    }
+
+    // Write straight into the mapped region, one face at a time
+    float *dst = static_cast<float *>(m_surfaceStream.beginWrite());
+    {
+        PROFILE_SCOPE("Shape::setVertices/normals");
+        writeFlatShadedVertices(vertices, m_faces, dst);
+    }
+    m_surfaceStream.endWrite();
+    m_uploadBytes += static_cast<uint64_t>(m_faces.size()) * 3 * SURFACE_STRIDE;
+
     if(m_tetVao != static_cast<GLuint>(-1)) {
-        glBindBuffer(GL_ARRAY_BUFFER, m_tetVbo);
-        glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(double) * vertices.size() * 3, static_cast<const void *>(vertices.data()));
+        writePositions(m_tetStream, vertices);
     }
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
 }
 
 void Shape::setModelMatrix(const Eigen::Affine3f &model)
 {
     m_modelMatrix = model.matrix();
+    m_objectDirty = true;
+}
+
+void Shape::setGpuNormals(bool gpuNormals)
+{
+    m_gpuNormals = gpuNormals;
 }
 
 void Shape::toggleWireframe()
 {
     m_wireframe = !m_wireframe;
+    m_objectDirty = true;
+}
+
+int Shape::addTriangles(const std::vector<Eigen::Vector3i> &triangles)
+{
+    if (!m_gpuNormals) {
+        std::cerr << "Extra triangles need GPU normals" << std::endl;
+        return -1;
+    }
+    // m_faces isn't read in this mode, so it doubles as the copy to re-upload from
+    int first = m_faces.size();
+    m_faces.insert(m_faces.end(), triangles.begin(), triangles.end());
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_surfaceIbo);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(int) * 3 * m_faces.size(), static_cast<const void *>(m_faces.data()), GL_STATIC_DRAW);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    return first;
+}
+
+void Shape::setDrawRanges(const std::vector<Eigen::Vector2i> &ranges)
+{
+    m_useRanges = !ranges.empty();
+    m_rangeCounts.clear();
+    m_rangeOffsets.clear();
+    for (const Vector2i &range : ranges) {
+        if (range[1] == 0) continue;
+        m_rangeCounts.push_back(range[1] * 3);
+        m_rangeOffsets.push_back(reinterpret_cast<const GLvoid *>(sizeof(int) * 3 * static_cast<size_t>(range[0])));
+    }
+    m_rangeBaseVertices.resize(m_rangeCounts.size());
 }
 
 void Shape::setVertices(const std::vector<Eigen::Vector3d> &vertices, const std::vector<Eigen::Vector3d> &normals)
@@ -207,42 +213,135 @@ void Shape::setVertices(const std::vector<Eigen::Vector3d> &vertices, const std:
         std::cerr << "Vertices and normals are not the same size" << std::endl;
         return;
     }
-    if(vertices.size() != m_verticesSize) {
+    if(vertices.size() != m_verticesSize || vertices.size() != m_numBufferVertices) {
         std::cerr << "You can't set vertices to a vector that is a different length that what shape was inited with" << std::endl;
         return;
     }
-    glBindBuffer(GL_ARRAY_BUFFER, m_surfaceVbo);
-    glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(double) * vertices.size() * 3, static_cast<const void *>(vertices.data()));
-    glBufferSubData(GL_ARRAY_BUFFER, sizeof(double) * vertices.size() * 3, sizeof(double) * vertices.size() * 3, static_cast<const void *>(normals.data()));
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    float *dst = static_cast<float *>(m_surfaceStream.beginWrite());
+    for(size_t i = 0; i < vertices.size(); i++) {
+        dst = writeVec3(dst, vertices[i]);
+        dst = writeVec3(dst, normals[i]);
+    }
+    m_surfaceStream.endWrite();
+    m_uploadBytes += static_cast<uint64_t>(vertices.size()) * SURFACE_STRIDE;
 }
 
 void Shape::draw(Shader *shader)
 {
-    Eigen::Matrix3f m3 = m_modelMatrix.topLeftCorner(3, 3);
-    Eigen::Matrix3f inverseTransposeModel = m3.inverse().transpose();
-
-    if(m_wireframe && m_tetVao != static_cast<GLuint>(-1)) {
-        shader->setUniform("wire", 1);
-        shader->setUniform("model", m_modelMatrix);
-        shader->setUniform("inverseTransposeModel", inverseTransposeModel);
-        shader->setUniform("red",   1);
-        shader->setUniform("green", 1);
-        shader->setUniform("blue",  1);
-        shader->setUniform("alpha", 1);
+    PROFILE_SCOPE("Shape::draw");
+    bool wire = m_wireframe && m_tetVao != static_cast<GLuint>(-1);
+    if (m_objectDirty) {
+        updateObjectBlock(wire);
+    }
+    m_objectUbo.bind();
+
+    if(wire) {
         glBindVertexArray(m_tetVao);
-        glDrawElements(GL_LINES, m_numTetVertices, GL_UNSIGNED_INT, reinterpret_cast<GLvoid *>(0));
+        glDrawElementsBaseVertex(GL_LINES, m_numTetVertices, GL_UNSIGNED_INT, reinterpret_cast<GLvoid *>(0),
+                                 tetStream().getRegionIndex() * m_verticesSize);
         glBindVertexArray(0);
+        tetStream().fence();
     } else {
-        shader->setUniform("wire", 0);
-        shader->setUniform("model", m_modelMatrix);
-        shader->setUniform("inverseTransposeModel", inverseTransposeModel);
-        shader->setUniform("red",   m_red);
-        shader->setUniform("green", m_green);
-        shader->setUniform("blue",  m_blue);
-        shader->setUniform("alpha", m_alpha);
+        GLint baseVertex = m_surfaceStream.getRegionIndex() * m_numBufferVertices;
         glBindVertexArray(m_surfaceVao);
-        glDrawElements(GL_TRIANGLES, m_numSurfaceVertices, GL_UNSIGNED_INT, reinterpret_cast<GLvoid *>(0));
+        if (!m_useRanges) {
+            glDrawElementsBaseVertex(GL_TRIANGLES, m_numSurfaceVertices, GL_UNSIGNED_INT, reinterpret_cast<GLvoid *>(0),
+                                     baseVertex);
+        } else if (!m_rangeCounts.empty()) {
+            std::fill(m_rangeBaseVertices.begin(), m_rangeBaseVertices.end(), baseVertex);
+            glMultiDrawElementsBaseVertex(GL_TRIANGLES, m_rangeCounts.data(), GL_UNSIGNED_INT, m_rangeOffsets.data(),
+                                          m_rangeCounts.size(), m_rangeBaseVertices.data());
+        }
         glBindVertexArray(0);
+        m_surfaceStream.fence();
+    }
+}
+
+// ================== Private Helpers
+
+void Shape::initSurfaceBuffers(unsigned int numBufferVertices, const std::vector<Eigen::Vector3i> &triangles, bool withNormals)
+{
+    GLsizei stride = withNormals ? SURFACE_STRIDE : POSITION_STRIDE;
+
+    m_numBufferVertices = numBufferVertices;
+    m_surfaceStream.init(stride * numBufferVertices);
+    m_objectUbo.init(sizeof(ObjectBlock), OBJECT_BINDING);
+    glGenBuffers(1, &m_surfaceIbo);
+    glGenVertexArrays(1, &m_surfaceVao);
+
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_surfaceIbo);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(int) * 3 * triangles.size(), static_cast<const void *>(triangles.data()), GL_STATIC_DRAW);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+
+    // Attribute offsets stay at zero; draw() selects the current region with a base vertex
+    glBindVertexArray(m_surfaceVao);
+    glBindBuffer(GL_ARRAY_BUFFER, m_surfaceStream.getBufferID());
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, static_cast<GLvoid *>(0));
+    if (withNormals) {
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, stride, reinterpret_cast<GLvoid *>(sizeof(float) * 3));
+    }
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_surfaceIbo);
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+}
+
+void Shape::writePositions(StreamBuffer &stream, const std::vector<Eigen::Vector3d> &vertices)
+{
+    float *dst = static_cast<float *>(stream.beginWrite());
+    for (const Vector3d &v : vertices) {
+        dst = writeVec3(dst, v);
+    }
+    stream.endWrite();
+    m_uploadBytes += static_cast<uint64_t>(vertices.size()) * POSITION_STRIDE;
+}
+
+StreamBuffer &Shape::tetStream()
+{
+    return m_gpuNormals ? m_surfaceStream : m_tetStream;
+}
+
+void Shape::updateObjectBlock(bool wire)
+{
+    ObjectBlock block;
+    Map<Matrix4f>(block.model) = m_modelMatrix;
+
+    // std140 stores each mat3 column in a vec4 slot, so the last row is padding
+    Matrix3f m3 = m_modelMatrix.topLeftCorner(3, 3);
+    Map<Matrix<float, 4, 3>> inverseTransposeModel(block.inverseTransposeModel);
+    inverseTransposeModel.setZero();
+    inverseTransposeModel.topRows<3>() = m3.inverse().transpose();
+
+    if (wire) {
+        Map<Vector4f>(block.color) = Vector4f::Ones();
+    } else {
+        Map<Vector4f>(block.color) = Vector4f(m_red, m_green, m_blue, m_alpha);
+    }
+    block.wire       = wire ? 1 : 0;
+    block.gpuNormals = (!wire && m_gpuNormals) ? 1 : 0;
+
+    m_objectUbo.update(&block, sizeof(ObjectBlock));
+    m_objectDirty = false;
+}
+
+void Shape::destroy()
+{
+    // Nothing was created in a shape that was never initialised, e.g. one of a headless run
+    if (m_surfaceVao == 0) return;
+
+    glDeleteVertexArrays(1, &m_surfaceVao);
+    glDeleteBuffers(1, &m_surfaceIbo);
+    m_surfaceStream.destroy();
+    m_objectUbo.destroy();
+    if (m_tetVao != static_cast<GLuint>(-1)) {
+        glDeleteVertexArrays(1, &m_tetVao);
+        glDeleteBuffers(1, &m_tetIbo);
+        m_tetStream.destroy();
     }
+    m_surfaceVao = 0;
+    m_surfaceIbo = 0;
+    m_tetVao     = -1;
+    m_tetIbo     = 0;
 }
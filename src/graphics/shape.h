@@ -2,16 +2,26 @@
 #define SHAPE_H
 
 #include <GL/glew.h>
+#include <cstdint>
 #include <vector>
 
 #include <Eigen/Dense>
 
+#include "graphics/streambuffer.h"
+#include "graphics/uniformbuffer.h"
+
 class Shader;
 
 class Shape
 {
 public:
     Shape();
+    // Needs the context the shape was initialised in to be current, unless it never was
+    ~Shape();
+
+    // Owns GL objects
+    Shape(const Shape &) = delete;
+    Shape &operator=(const Shape &) = delete;
 
     void init(const std::vector<Eigen::Vector3d> &vertices, const std::vector<Eigen::Vector3d> &normals, const std::vector<Eigen::Vector3i> &triangles);
     void init(const std::vector<Eigen::Vector3d> &vertices, const std::vector<Eigen::Vector3i> &triangles);
@@ -22,20 +32,49 @@ public:
 
     void setModelMatrix(const Eigen::Affine3f &model);
 
+    // When enabled (before init), only positions are uploaded and the fragment shader derives flat normals
+    void setGpuNormals(bool gpuNormals);
+
     void toggleWireframe();
 
+    // Appends triangles over the same vertices to the index buffer, after the ones init() was given, and returns
+    // the index of the first. They are only drawn through setDrawRanges(). Needs GPU normals, since otherwise
+    // every face has vertices of its own; returns -1 without them.
+    int addTriangles(const std::vector<Eigen::Vector3i> &triangles);
+
+    // Restricts draw() to ranges of (first triangle, triangle count) in the index buffer, drawn with one call.
+    // An empty list draws the triangles init() was given, and a list of empty ranges draws nothing. The
+    // wireframe ignores this.
+    void setDrawRanges(const std::vector<Eigen::Vector2i> &ranges);
+
     void draw(Shader *shader);
 
+    // Total bytes written into the vertex streams so far
+    uint64_t getUploadBytes() const { return m_uploadBytes; }
+
 private:
+    void initSurfaceBuffers(unsigned int numBufferVertices, const std::vector<Eigen::Vector3i> &triangles, bool withNormals);
+    void writePositions(StreamBuffer &stream, const std::vector<Eigen::Vector3d> &vertices);
+    StreamBuffer &tetStream();
+    void updateObjectBlock(bool wire);
+    void destroy();
+
     GLuint m_surfaceVao;
     GLuint m_tetVao;
-    GLuint m_surfaceVbo;
-    GLuint m_tetVbo;
     GLuint m_surfaceIbo;
     GLuint m_tetIbo;
 
+    // Vertex data is rewritten every frame, so it lives in rings of buffer regions (see StreamBuffer)
+    StreamBuffer m_surfaceStream;
+    StreamBuffer m_tetStream;
+
+    // Per-object shader inputs, only re-uploaded when the model matrix or draw mode changes
+    UniformBuffer m_objectUbo;
+    bool          m_objectDirty;
+
     unsigned int m_numSurfaceVertices;
     unsigned int m_numTetVertices;
+    unsigned int m_numBufferVertices; // Vertices per surface buffer region
     unsigned int m_verticesSize;
     float m_red;
     float m_blue;
@@ -44,9 +83,18 @@ private:
 
     std::vector<Eigen::Vector3i> m_faces;
 
+    // setDrawRanges() as glMultiDrawElementsBaseVertex arguments; the base vertices are all the current region
+    bool                        m_useRanges;
+    std::vector<GLsizei>        m_rangeCounts;
+    std::vector<const GLvoid *> m_rangeOffsets;
+    std::vector<GLint>          m_rangeBaseVertices;
+
     Eigen::Matrix4f m_modelMatrix;
 
     bool m_wireframe;
+    bool m_gpuNormals;
+
+    uint64_t m_uploadBytes;
 };
 
 #endif // SHAPE_H
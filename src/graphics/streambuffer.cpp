@@ -0,0 +1,122 @@
+#include "graphics/streambuffer.h"
+#include "graphics/graphicsdebug.h"
+
+#include <iostream>
+
+StreamBuffer::StreamBuffer()
+    : m_buffer(0),
+      m_regionSize(0),
+      m_numRegions(0),
+      m_region(0),
+      m_mapped(nullptr),
+      m_stalls(0)
+{
+}
+
+void StreamBuffer::init(size_t regionSize, int numRegions)
+{
+    m_regionSize = regionSize;
+    m_numRegions = numRegions;
+    m_region     = numRegions - 1; // The first beginWrite() lands on region 0
+    m_fences.assign(numRegions, nullptr);
+
+    size_t totalSize = m_regionSize * m_numRegions;
+
+    glGenBuffers(1, &m_buffer);
+    glBindBuffer(GL_ARRAY_BUFFER, m_buffer);
+    if (GLEW_ARB_buffer_storage) {
+        GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glBufferStorage(GL_ARRAY_BUFFER, totalSize, nullptr, flags);
+        m_mapped = glMapBufferRange(GL_ARRAY_BUFFER, 0, totalSize, flags);
+        if (m_mapped == nullptr) {
+            std::cerr << "Persistent mapping failed, falling back to per-frame mapping" << std::endl;
+            glDeleteBuffers(1, &m_buffer);
+            glGenBuffers(1, &m_buffer);
+            glBindBuffer(GL_ARRAY_BUFFER, m_buffer);
+            glBufferData(GL_ARRAY_BUFFER, totalSize, nullptr, GL_STREAM_DRAW);
+        }
+    } else {
+        glBufferData(GL_ARRAY_BUFFER, totalSize, nullptr, GL_STREAM_DRAW);
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void StreamBuffer::destroy()
+{
+    if (m_buffer == 0) return;
+    for (GLsync &fence : m_fences) {
+        if (fence != nullptr) glDeleteSync(fence);
+        fence = nullptr;
+    }
+    if (m_mapped != nullptr) {
+        glBindBuffer(GL_ARRAY_BUFFER, m_buffer);
+        glUnmapBuffer(GL_ARRAY_BUFFER);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        m_mapped = nullptr;
+    }
+    glDeleteBuffers(1, &m_buffer);
+    m_buffer = 0;
+}
+
+void *StreamBuffer::beginWrite()
+{
+    m_region = (m_region + 1) % m_numRegions;
+    glBindBuffer(GL_ARRAY_BUFFER, m_buffer);
+    waitForRegion(m_region);
+
+    if (m_mapped != nullptr) {
+        return static_cast<char *>(m_mapped) + getRegionOffset();
+    }
+    return glMapBufferRange(GL_ARRAY_BUFFER, getRegionOffset(), m_regionSize,
+                            GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+}
+
+void StreamBuffer::endWrite()
+{
+    if (m_mapped == nullptr) {
+        glUnmapBuffer(GL_ARRAY_BUFFER);
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void StreamBuffer::fence()
+{
+    GLsync &fence = m_fences[m_region];
+    if (fence != nullptr) glDeleteSync(fence);
+    fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+// ================== Private Helpers
+
+void StreamBuffer::waitForRegion(int region)
+{
+    GLsync &fence = m_fences[region];
+    if (fence == nullptr) return;
+
+    GLenum status = glClientWaitSync(fence, 0, 0);
+    if (status == GL_ALREADY_SIGNALED || status == GL_CONDITION_SATISFIED) {
+        glDeleteSync(fence);
+        fence = nullptr;
+        return;
+    }
+
+    m_stalls++;
+
+    if (m_mapped == nullptr) {
+        // Orphan the storage: the driver hands us fresh memory and keeps the old one alive for pending draws,
+        // so none of the outstanding fences guard anything anymore
+        glBufferData(GL_ARRAY_BUFFER, m_regionSize * m_numRegions, nullptr, GL_STREAM_DRAW);
+        for (GLsync &f : m_fences) {
+            if (f != nullptr) glDeleteSync(f);
+            f = nullptr;
+        }
+        return;
+    }
+
+    // Immutable storage can't be orphaned, so block until the GPU is done with this region
+    do {
+        status = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, FENCE_TIMEOUT);
+    } while (status == GL_TIMEOUT_EXPIRED);
+    glDeleteSync(fence);
+    fence = nullptr;
+}
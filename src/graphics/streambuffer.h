@@ -0,0 +1,53 @@
+#pragma once
+
+#include <GL/glew.h>
+#include <cstddef>
+#include <vector>
+
+// A vertex buffer split into a ring of equally sized regions, for data that is rewritten every frame.
+// Each update goes into the next region while the GPU may still be reading older ones, and a fence per
+// region keeps us from writing over data that is still in flight.
+//
+// When ARB_buffer_storage is available the whole buffer is mapped once (persistent + coherent). On plain
+// GL 4.1 each region is mapped with glMapBufferRange(UNSYNCHRONIZED), and if the region we are about to
+// reuse is still busy the buffer is orphaned instead of waiting on the GPU.
+class StreamBuffer
+{
+public:
+    static const int DEFAULT_REGIONS = 3;
+
+    StreamBuffer();
+
+    void init(size_t regionSize, int numRegions = DEFAULT_REGIONS);
+    void destroy();
+
+    // Advances to the next region and returns a pointer to write regionSize bytes into. Leaves the buffer
+    // bound to GL_ARRAY_BUFFER until endWrite().
+    void *beginWrite();
+    void  endWrite();
+
+    // Call once the draw calls that read the current region have been issued
+    void fence();
+
+    GLuint getBufferID()     const { return m_buffer; }
+    int    getRegionIndex()  const { return m_region; }
+    size_t getRegionOffset() const { return m_region * m_regionSize; }
+    size_t getRegionSize()   const { return m_regionSize; }
+    bool   isPersistent()    const { return m_mapped != nullptr; }
+
+    // Number of times beginWrite() had to wait on (or orphan) a region the GPU was still using
+    unsigned long getStallCount() const { return m_stalls; }
+
+private:
+    void waitForRegion(int region);
+
+    GLuint m_buffer;
+    size_t m_regionSize;
+    int    m_numRegions;
+    int    m_region;
+
+    void  *m_mapped;
+    std::vector<GLsync> m_fences;
+
+    unsigned long m_stalls;
+};
@@ -0,0 +1,255 @@
+#include "graphics/surfacelod.h"
+#include "profiling/profiler.h"
+
+#include <algorithm>
+#include <queue>
+
+using namespace Eigen;
+
+namespace {
+
+// A collapse of `from` into `to`, valid while neither vertex has changed since it was queued
+struct Collapse {
+    double cost;
+    int    from;
+    int    to;
+    int    fromVersion;
+    int    toVersion;
+
+    bool operator>(const Collapse &other) const { return cost > other.cost; }
+};
+
+// Edge collapse state over one surface, with vertices renumbered 0 .. n - 1
+class Simplifier
+{
+public:
+    Simplifier(const std::vector<Vector3d> &positions, const std::vector<Vector3i> &faces);
+
+    // Collapses the cheapest valid edges until at most `target` faces are left or none can go.
+    // Returns whether the target was reached.
+    bool simplify(int target);
+
+    int getFaceCount() const { return m_aliveFaces; }
+    // Surviving faces, in their original order
+    std::vector<Vector3i> getFaces() const;
+
+private:
+    double error(const Matrix4d &quadric, int v) const
+    {
+        Vector4d p(m_positions[v].x(), m_positions[v].y(), m_positions[v].z(), 1);
+        return p.dot(quadric * p);
+    }
+    void queueEdge(int a, int b);
+    bool isValid(int from, int to) const;
+    void collapse(int from, int to);
+    // Alive vertices sharing a face with v
+    void collectNeighbours(int v, std::vector<int> &neighbours) const;
+
+    std::vector<Vector3d>          m_positions;
+    std::vector<Vector3i>          m_faces;
+    std::vector<bool>              m_faceAlive;
+    std::vector<Matrix4d>          m_quadrics;
+    std::vector<std::vector<int>>  m_vertexFaces; // May still list faces that have since died
+    std::vector<int>               m_versions;
+    int                            m_aliveFaces;
+
+    std::priority_queue<Collapse, std::vector<Collapse>, std::greater<Collapse>> m_queue;
+};
+
+Simplifier::Simplifier(const std::vector<Vector3d> &positions, const std::vector<Vector3i> &faces)
+    : m_positions(positions),
+      m_faces(faces),
+      m_faceAlive(faces.size(), true),
+      m_quadrics(positions.size(), Matrix4d::Zero()),
+      m_vertexFaces(positions.size()),
+      m_versions(positions.size(), 0),
+      m_aliveFaces(faces.size())
+{
+    // Each vertex's quadric sums the squared distances to its faces' planes, weighted by area
+    for (size_t f = 0; f < m_faces.size(); f++) {
+        const Vector3i &face = m_faces[f];
+        for (int i = 0; i < 3; i++) m_vertexFaces[face[i]].push_back(f);
+
+        const Vector3d &a = m_positions[face[0]], &b = m_positions[face[1]], &c = m_positions[face[2]];
+        Vector3d normal = (b - a).cross(c - a);
+        double twiceArea = normal.norm();
+        if (twiceArea == 0) continue;
+        normal /= twiceArea;
+        Vector4d plane(normal.x(), normal.y(), normal.z(), -normal.dot(a));
+        Matrix4d quadric = 0.5 * twiceArea * plane * plane.transpose();
+        for (int i = 0; i < 3; i++) m_quadrics[face[i]] += quadric;
+    }
+
+    std::vector<std::pair<int, int>> edges;
+    edges.reserve(m_faces.size() * 3);
+    for (const Vector3i &face : m_faces) {
+        for (int i = 0; i < 3; i++) {
+            int a = face[i], b = face[(i + 1) % 3];
+            edges.emplace_back(std::min(a, b), std::max(a, b));
+        }
+    }
+    std::sort(edges.begin(), edges.end());
+    edges.erase(std::unique(edges.begin(), edges.end()), edges.end());
+    for (const auto &[a, b] : edges) queueEdge(a, b);
+}
+
+bool Simplifier::simplify(int target)
+{
+    while (m_aliveFaces > target) {
+        if (m_queue.empty()) return false;
+        Collapse candidate = m_queue.top();
+        m_queue.pop();
+        if (m_versions[candidate.from] != candidate.fromVersion || m_versions[candidate.to] != candidate.toVersion) {
+            continue;
+        }
+        if (isValid(candidate.from, candidate.to)) {
+            collapse(candidate.from, candidate.to);
+        }
+    }
+    return true;
+}
+
+std::vector<Vector3i> Simplifier::getFaces() const
+{
+    std::vector<Vector3i> faces;
+    faces.reserve(m_aliveFaces);
+    for (size_t f = 0; f < m_faces.size(); f++) {
+        if (m_faceAlive[f]) faces.push_back(m_faces[f]);
+    }
+    return faces;
+}
+
+void Simplifier::queueEdge(int a, int b)
+{
+    // The survivor takes the summed quadric. Both directions are queued, since the cheaper one may be blocked
+    // where the other is not.
+    Matrix4d quadric = m_quadrics[a] + m_quadrics[b];
+    m_queue.push({error(quadric, a), b, a, m_versions[b], m_versions[a]});
+    m_queue.push({error(quadric, b), a, b, m_versions[a], m_versions[b]});
+}
+
+bool Simplifier::isValid(int from, int to) const
+{
+    // Link condition: on a closed manifold, the edge's endpoints may only share the two vertices opposite it
+    std::vector<int> fromNeighbours, toNeighbours, shared;
+    collectNeighbours(from, fromNeighbours);
+    collectNeighbours(to, toNeighbours);
+    std::set_intersection(fromNeighbours.begin(), fromNeighbours.end(), toNeighbours.begin(), toNeighbours.end(),
+                          std::back_inserter(shared));
+    if (shared.size() != 2) return false;
+
+    // No face that survives the collapse may flip over or become degenerate
+    for (int f : m_vertexFaces[from]) {
+        if (!m_faceAlive[f]) continue;
+        const Vector3i &face = m_faces[f];
+        if (face[0] == to || face[1] == to || face[2] == to) continue;
+
+        Vector3d corners[3], moved[3];
+        for (int i = 0; i < 3; i++) {
+            corners[i] = m_positions[face[i]];
+            moved[i]   = face[i] == from ? m_positions[to] : corners[i];
+        }
+        Vector3d before = (corners[1] - corners[0]).cross(corners[2] - corners[0]);
+        Vector3d after  = (moved[1] - moved[0]).cross(moved[2] - moved[0]);
+        if (before.dot(after) <= 0) return false;
+    }
+    return true;
+}
+
+void Simplifier::collapse(int from, int to)
+{
+    for (int f : m_vertexFaces[from]) {
+        if (!m_faceAlive[f]) continue;
+        Vector3i &face = m_faces[f];
+        if (face[0] == to || face[1] == to || face[2] == to) {
+            m_faceAlive[f] = false;
+            m_aliveFaces--;
+        } else {
+            for (int i = 0; i < 3; i++) {
+                if (face[i] == from) face[i] = to;
+            }
+            m_vertexFaces[to].push_back(f);
+        }
+    }
+    m_vertexFaces[from].clear();
+    m_quadrics[to] += m_quadrics[from];
+    m_versions[from]++;
+    m_versions[to]++;
+
+    // Drop dead faces from the survivor's list so that it doesn't keep growing
+    std::vector<int> &toFaces = m_vertexFaces[to];
+    toFaces.erase(std::remove_if(toFaces.begin(), toFaces.end(), [&](int f) { return !m_faceAlive[f]; }),
+                  toFaces.end());
+
+    // The survivor's edges now carry a different quadric; the version bump drops their old entries
+    std::vector<int> neighbours;
+    collectNeighbours(to, neighbours);
+    for (int n : neighbours) queueEdge(to, n);
+}
+
+void Simplifier::collectNeighbours(int v, std::vector<int> &neighbours) const
+{
+    neighbours.clear();
+    for (int f : m_vertexFaces[v]) {
+        if (!m_faceAlive[f]) continue;
+        for (int i = 0; i < 3; i++) {
+            if (m_faces[f][i] != v) neighbours.push_back(m_faces[f][i]);
+        }
+    }
+    std::sort(neighbours.begin(), neighbours.end());
+    neighbours.erase(std::unique(neighbours.begin(), neighbours.end()), neighbours.end());
+}
+
+}
+
+SurfaceLod::SurfaceLod()
+{
+}
+
+void SurfaceLod::build(const std::vector<Eigen::Vector3d> &restPositions, const std::vector<Eigen::Vector3i> &faces)
+{
+    PROFILE_SCOPE("SurfaceLod::build");
+    m_levels.assign(1, faces);
+    if (static_cast<int>(faces.size() * LEVEL_RATIO) < MIN_FACES) return;
+
+    // Renumber the surface's own vertices densely, since restPositions may cover a whole scene
+    std::vector<int> vertices;
+    vertices.reserve(faces.size() * 3);
+    for (const Vector3i &face : faces) vertices.insert(vertices.end(), face.data(), face.data() + 3);
+    std::sort(vertices.begin(), vertices.end());
+    vertices.erase(std::unique(vertices.begin(), vertices.end()), vertices.end());
+
+    std::vector<Vector3d> localPositions(vertices.size());
+    for (size_t v = 0; v < vertices.size(); v++) localPositions[v] = restPositions[vertices[v]];
+    std::vector<Vector3i> localFaces(faces.size());
+    for (size_t f = 0; f < faces.size(); f++) {
+        for (int i = 0; i < 3; i++) {
+            localFaces[f][i] = std::lower_bound(vertices.begin(), vertices.end(), faces[f][i]) - vertices.begin();
+        }
+    }
+
+    Simplifier simplifier(localPositions, localFaces);
+    double target = faces.size();
+    while (static_cast<int>(m_levels.size()) < MAX_LEVELS) {
+        target *= LEVEL_RATIO;
+        if (target < MIN_FACES) break;
+        bool reached = simplifier.simplify(static_cast<int>(target));
+
+        // A level that barely improves on the last isn't worth a switch
+        if (simplifier.getFaceCount() > m_levels.back().size() * (1 + LEVEL_RATIO) / 2) break;
+        std::vector<Vector3i> level = simplifier.getFaces();
+        for (Vector3i &face : level) {
+            for (int i = 0; i < 3; i++) face[i] = vertices[face[i]];
+        }
+        m_levels.push_back(std::move(level));
+        if (!reached) break;
+    }
+}
+
+int SurfaceLod::selectLevel(double pixels) const
+{
+    const double wanted = FACES_PER_PIXEL * pixels * pixels;
+    int level = 0;
+    while (level + 1 < getLevelCount() && m_levels[level + 1].size() >= wanted) level++;
+    return level;
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <vector>
+#include "Eigen/Dense"
+
+// Levels of detail of one closed triangle surface, for drawing distant bodies with fewer triangles.
+//
+// The levels come from quadric error edge collapse (Garland and Heckbert) on the rest shape, restricted to
+// half-edge collapses: a vertex is only ever merged into one of its neighbours, never moved. Every level's
+// faces therefore still index the original vertices, i.e. the simulated tet vertices, so deformation drives
+// each level with no extra mapping and nothing extra to upload; switching level only switches index ranges.
+//
+// Level 0 is the full surface and each further level keeps about LEVEL_RATIO of the previous one's faces,
+// which matches one level per doubling of distance. Collapses that would fold a face over or make the
+// surface non-manifold are skipped.
+class SurfaceLod
+{
+public:
+    static const int MAX_LEVELS = 6;
+    static constexpr double LEVEL_RATIO = 0.25;
+    // No level is simplified below this many faces
+    static const int MIN_FACES = 32;
+    // Faces wanted per square pixel of the surface's projected bounding diameter
+    static constexpr double FACES_PER_PIXEL = 0.5;
+
+    SurfaceLod();
+
+    // `faces` index into `restPositions`, which may hold other bodies' vertices too
+    void build(const std::vector<Eigen::Vector3d> &restPositions, const std::vector<Eigen::Vector3i> &faces);
+
+    int getLevelCount() const { return m_levels.size(); }
+    const std::vector<Eigen::Vector3i> &getFaces(int level) const { return m_levels[level]; }
+
+    // The coarsest level that still has enough faces for a surface `pixels` across on screen
+    int selectLevel(double pixels) const;
+
+private:
+    std::vector<std::vector<Eigen::Vector3i>> m_levels;
+};
@@ -0,0 +1,44 @@
+#include "graphics/uniformbuffer.h"
+
+#include <iostream>
+
+UniformBuffer::UniformBuffer()
+    : m_buffer(0),
+      m_bindingPoint(0),
+      m_size(0)
+{
+}
+
+void UniformBuffer::init(size_t size, GLuint bindingPoint)
+{
+    m_size = size;
+    m_bindingPoint = bindingPoint;
+
+    glGenBuffers(1, &m_buffer);
+    glBindBuffer(GL_UNIFORM_BUFFER, m_buffer);
+    glBufferData(GL_UNIFORM_BUFFER, m_size, nullptr, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+void UniformBuffer::destroy()
+{
+    if (m_buffer == 0) return;
+    glDeleteBuffers(1, &m_buffer);
+    m_buffer = 0;
+}
+
+void UniformBuffer::update(const void *data, size_t size)
+{
+    if (size > m_size) {
+        std::cerr << "Uniform buffer update of " << size << " bytes does not fit in " << m_size << " bytes" << std::endl;
+        return;
+    }
+    glBindBuffer(GL_UNIFORM_BUFFER, m_buffer);
+    glBufferSubData(GL_UNIFORM_BUFFER, 0, size, data);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+void UniformBuffer::bind() const
+{
+    glBindBufferBase(GL_UNIFORM_BUFFER, m_bindingPoint, m_buffer);
+}
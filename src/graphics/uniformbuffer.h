@@ -0,0 +1,49 @@
+#pragma once
+
+#include <GL/glew.h>
+#include <cstddef>
+
+// Binding points shared by every program; Shader::bindUniformBlock connects a block to one of these
+enum UniformBinding : GLuint {
+    CAMERA_BINDING = 0,
+    OBJECT_BINDING = 1
+};
+
+// Mirrors the std140 "Camera" block in the shaders: written once per frame
+struct CameraBlock {
+    float proj[16];
+    float view[16];
+};
+
+// Mirrors the std140 "Object" block in the shaders: rewritten only when a shape's draw state changes
+struct ObjectBlock {
+    float model[16];
+    float inverseTransposeModel[12]; // mat3 columns are padded to vec4 in std140
+    float color[4];
+    GLint wire;
+    GLint gpuNormals;
+    GLint padding[2];
+};
+
+class UniformBuffer
+{
+public:
+    UniformBuffer();
+
+    void init(size_t size, GLuint bindingPoint);
+    void destroy();
+
+    // Replaces the whole buffer contents with a single glBufferSubData
+    void update(const void *data, size_t size);
+
+    // Attaches the buffer to its binding point
+    void bind() const;
+
+    GLuint getBufferID()     const { return m_buffer; }
+    GLuint getBindingPoint() const { return m_bindingPoint; }
+
+private:
+    GLuint m_buffer;
+    GLuint m_bindingPoint;
+    size_t m_size;
+};
@@ -0,0 +1,332 @@
+#include "io/animationcache.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+#include <iostream>
+
+using namespace Eigen;
+
+namespace {
+
+const char     CACHE_MAGIC[8] = {'F', 'E', 'M', 'C', 'A', 'C', 'H', 'E'};
+const uint32_t CACHE_VERSION  = 1;
+
+const uint8_t KEYFRAME    = 0;
+const uint8_t DELTA_FRAME = 1;
+
+struct CacheHeader {
+    char     magic[8];
+    uint32_t version;
+    uint32_t numVertices;
+    uint32_t numTets;
+    uint32_t numFaces;
+    uint32_t keyframeInterval;
+    float    quantum;
+    uint32_t numFrames;
+    uint32_t padding;
+    uint64_t indexOffset;
+};
+static_assert(sizeof(CacheHeader) == 48, "CacheHeader must match the on-disk layout");
+
+// Each frame record is { uint8 type; uint32 payloadSize; payload }
+const size_t RECORD_HEADER_SIZE = sizeof(uint8_t) + sizeof(uint32_t);
+
+inline void putVarint(std::vector<uint8_t> &buffer, int32_t value)
+{
+    // Zigzag maps small magnitudes of either sign to small unsigned values
+    uint32_t v = (static_cast<uint32_t>(value) << 1) ^ static_cast<uint32_t>(value >> 31);
+    while (v >= 0x80) {
+        buffer.push_back(static_cast<uint8_t>(v | 0x80));
+        v >>= 7;
+    }
+    buffer.push_back(static_cast<uint8_t>(v));
+}
+
+// Fails on a varint that runs past `end` or past the five bytes a 32-bit value can take
+inline bool getVarint(const uint8_t *&src, const uint8_t *end, int32_t &value)
+{
+    uint32_t v = 0;
+    for (int shift = 0; shift < 35; shift += 7) {
+        if (src >= end) return false;
+        const uint8_t byte = *src++;
+        v |= static_cast<uint32_t>(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) {
+            value = static_cast<int32_t>(v >> 1) ^ -static_cast<int32_t>(v & 1);
+            return true;
+        }
+    }
+    return false;
+}
+
+double secondsSince(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+}
+
+// ================== Writer
+
+AnimationCacheWriter::AnimationCacheWriter()
+    : m_file(nullptr),
+      m_numVertices(0),
+      m_quantum(0),
+      m_keyframeInterval(DEFAULT_KEYFRAME_INTERVAL),
+      m_bytesWritten(0),
+      m_encodeSeconds(0)
+{
+}
+
+AnimationCacheWriter::~AnimationCacheWriter()
+{
+    close();
+}
+
+bool AnimationCacheWriter::open(const std::string &path,
+                                const std::vector<Eigen::Vector4i> &tets,
+                                const std::vector<Eigen::Vector3i> &faces,
+                                int numVertices,
+                                float quantum,
+                                int keyframeInterval)
+{
+    close();
+
+    m_file = std::fopen(path.c_str(), "wb");
+    if (m_file == nullptr) {
+        std::cerr << "Error opening file: " << path << std::endl;
+        return false;
+    }
+
+    m_numVertices      = numVertices;
+    m_quantum          = quantum;
+    m_keyframeInterval = std::max(keyframeInterval, 1);
+    m_keyframe.assign(numVertices * 3, 0.f);
+    m_quantized.assign(numVertices * 3, 0);
+    m_offsets.clear();
+    m_times.clear();
+    m_encodeSeconds = 0;
+
+    // Frame count and index offset are patched in by close()
+    CacheHeader header = {};
+    std::memcpy(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+    header.version          = CACHE_VERSION;
+    header.numVertices      = numVertices;
+    header.numTets          = tets.size();
+    header.numFaces         = faces.size();
+    header.keyframeInterval = m_keyframeInterval;
+    header.quantum          = quantum;
+
+    std::fwrite(&header, sizeof(CacheHeader), 1, m_file);
+    std::fwrite(tets.data(),  sizeof(int), tets.size()  * 4, m_file);
+    std::fwrite(faces.data(), sizeof(int), faces.size() * 3, m_file);
+    m_bytesWritten = sizeof(CacheHeader) + sizeof(int) * (tets.size() * 4 + faces.size() * 3);
+    return true;
+}
+
+void AnimationCacheWriter::writeFrame(const float *positions, double time)
+{
+    if (m_file == nullptr) return;
+
+    auto start = std::chrono::steady_clock::now();
+
+    int frame = m_offsets.size();
+    m_offsets.push_back(m_bytesWritten);
+    m_times.push_back(time);
+
+    const size_t count = m_numVertices * 3;
+    uint8_t type;
+    m_buffer.clear();
+    if (frame % m_keyframeInterval == 0) {
+        type = KEYFRAME;
+        std::memcpy(m_keyframe.data(), positions, count * sizeof(float));
+        std::fill(m_quantized.begin(), m_quantized.end(), 0);
+        m_buffer.resize(count * sizeof(float));
+        std::memcpy(m_buffer.data(), positions, count * sizeof(float));
+    } else {
+        type = DELTA_FRAME;
+        float invQuantum = 1.f / m_quantum;
+        for (size_t i = 0; i < count; i++) {
+            double q = std::round((positions[i] - m_keyframe[i]) * invQuantum);
+            int32_t target = static_cast<int32_t>(std::clamp(q, -2147483647.0, 2147483647.0));
+            putVarint(m_buffer, target - m_quantized[i]);
+            m_quantized[i] = target;
+        }
+    }
+
+    uint32_t size = m_buffer.size();
+    std::fwrite(&type, sizeof(uint8_t), 1, m_file);
+    std::fwrite(&size, sizeof(uint32_t), 1, m_file);
+    std::fwrite(m_buffer.data(), 1, m_buffer.size(), m_file);
+    m_bytesWritten += RECORD_HEADER_SIZE + size;
+
+    m_encodeSeconds += secondsSince(start);
+}
+
+void AnimationCacheWriter::writeFrame(const std::vector<Eigen::Vector3d> &positions, double time)
+{
+    std::vector<float> converted(positions.size() * 3);
+    for (size_t v = 0; v < positions.size(); v++) {
+        converted[3 * v + 0] = static_cast<float>(positions[v][0]);
+        converted[3 * v + 1] = static_cast<float>(positions[v][1]);
+        converted[3 * v + 2] = static_cast<float>(positions[v][2]);
+    }
+    writeFrame(converted.data(), time);
+}
+
+void AnimationCacheWriter::close()
+{
+    if (m_file == nullptr) return;
+
+    uint64_t indexOffset = m_bytesWritten;
+    std::fwrite(m_offsets.data(), sizeof(uint64_t), m_offsets.size(), m_file);
+    std::fwrite(m_times.data(),   sizeof(double),   m_times.size(),   m_file);
+    m_bytesWritten += m_offsets.size() * (sizeof(uint64_t) + sizeof(double));
+
+    uint32_t numFrames = m_offsets.size();
+    std::fseek(m_file, offsetof(CacheHeader, numFrames), SEEK_SET);
+    std::fwrite(&numFrames, sizeof(uint32_t), 1, m_file);
+    std::fseek(m_file, offsetof(CacheHeader, indexOffset), SEEK_SET);
+    std::fwrite(&indexOffset, sizeof(uint64_t), 1, m_file);
+
+    std::fclose(m_file);
+    m_file = nullptr;
+}
+
+// ================== Reader
+
+AnimationCacheReader::AnimationCacheReader()
+    : m_file(nullptr),
+      m_numVertices(0),
+      m_quantum(0),
+      m_keyframeInterval(1),
+      m_currentFrame(-1),
+      m_decodeSeconds(0)
+{
+}
+
+AnimationCacheReader::~AnimationCacheReader()
+{
+    close();
+}
+
+bool AnimationCacheReader::open(const std::string &path)
+{
+    close();
+
+    m_file = std::fopen(path.c_str(), "rb");
+    if (m_file == nullptr) {
+        std::cerr << "Error opening file: " << path << std::endl;
+        return false;
+    }
+
+    CacheHeader header;
+    if (std::fread(&header, sizeof(CacheHeader), 1, m_file) != 1 ||
+        std::memcmp(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC)) != 0) {
+        std::cerr << path << " is not an animation cache" << std::endl;
+        close();
+        return false;
+    }
+    if (header.version != CACHE_VERSION) {
+        std::cerr << path << " has unsupported cache version " << header.version << std::endl;
+        close();
+        return false;
+    }
+    if (header.indexOffset == 0) {
+        std::cerr << path << " was not closed properly and has no frame index" << std::endl;
+        close();
+        return false;
+    }
+
+    m_numVertices      = header.numVertices;
+    m_quantum          = header.quantum;
+    m_keyframeInterval = header.keyframeInterval;
+
+    m_tets.resize(header.numTets);
+    m_faces.resize(header.numFaces);
+    m_offsets.resize(header.numFrames);
+    m_times.resize(header.numFrames);
+    bool ok = std::fread(m_tets.data(),  sizeof(int), m_tets.size()  * 4, m_file) == m_tets.size()  * 4 &&
+              std::fread(m_faces.data(), sizeof(int), m_faces.size() * 3, m_file) == m_faces.size() * 3;
+    ok = ok && std::fseek(m_file, header.indexOffset, SEEK_SET) == 0;
+    ok = ok && std::fread(m_offsets.data(), sizeof(uint64_t), m_offsets.size(), m_file) == m_offsets.size() &&
+               std::fread(m_times.data(),   sizeof(double),   m_times.size(),   m_file) == m_times.size();
+    if (!ok) {
+        std::cerr << path << " is truncated" << std::endl;
+        close();
+        return false;
+    }
+
+    m_keyframe.assign(m_numVertices * 3, 0.f);
+    m_quantized.assign(m_numVertices * 3, 0);
+    m_currentFrame  = -1;
+    m_decodeSeconds = 0;
+    return true;
+}
+
+void AnimationCacheReader::close()
+{
+    if (m_file != nullptr) std::fclose(m_file);
+    m_file = nullptr;
+    m_currentFrame = -1;
+}
+
+bool AnimationCacheReader::readFrame(int frame, std::vector<Eigen::Vector3d> &positions)
+{
+    if (m_file == nullptr || frame < 0 || frame >= getFrameCount()) return false;
+
+    auto start = std::chrono::steady_clock::now();
+
+    // Continue from the current frame when possible, otherwise from the keyframe
+    int keyframe = frame - frame % m_keyframeInterval;
+    int first = (m_currentFrame >= keyframe && m_currentFrame <= frame) ? m_currentFrame + 1 : keyframe;
+    for (int f = first; f <= frame; f++) {
+        if (!decodeFrame(f)) {
+            m_currentFrame = -1;
+            return false;
+        }
+    }
+    m_currentFrame = frame;
+
+    positions.resize(m_numVertices);
+    for (int v = 0; v < m_numVertices; v++) {
+        for (int c = 0; c < 3; c++) {
+            positions[v][c] = m_keyframe[3 * v + c] + static_cast<double>(m_quantized[3 * v + c]) * m_quantum;
+        }
+    }
+
+    m_decodeSeconds += secondsSince(start);
+    return true;
+}
+
+bool AnimationCacheReader::decodeFrame(int frame)
+{
+    uint8_t  type;
+    uint32_t size;
+    if (std::fseek(m_file, m_offsets[frame], SEEK_SET) != 0 ||
+        std::fread(&type, sizeof(uint8_t), 1, m_file) != 1 ||
+        std::fread(&size, sizeof(uint32_t), 1, m_file) != 1) {
+        return false;
+    }
+    m_buffer.resize(size);
+    if (std::fread(m_buffer.data(), 1, size, m_file) != size) return false;
+
+    const size_t count = m_numVertices * 3;
+    if (type == KEYFRAME) {
+        if (size != count * sizeof(float)) return false;
+        std::memcpy(m_keyframe.data(), m_buffer.data(), size);
+        std::fill(m_quantized.begin(), m_quantized.end(), 0);
+    } else {
+        // A truncated or corrupt frame fails rather than reading past the end of the buffer
+        const uint8_t *src = m_buffer.data();
+        const uint8_t *end = src + size;
+        for (size_t i = 0; i < count; i++) {
+            int32_t delta;
+            if (!getVarint(src, end, delta)) return false;
+            m_quantized[i] += delta;
+        }
+    }
+    return true;
+}
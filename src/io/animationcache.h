@@ -0,0 +1,115 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "Eigen/Dense"
+
+// A compact on-disk cache of a simulated animation.
+//
+// Layout:
+//   header   magic[8], uint32 version, numVertices, numTets, numFaces, keyframeInterval,
+//            float quantum, uint32 numFrames, uint64 indexOffset
+//   topology int32 tets[numTets][4], int32 faces[numFaces][3]  (stored once)
+//   frames   every keyframeInterval-th frame is a keyframe of raw float positions; the frames in between
+//            store, per coordinate, the change in round((p - keyframe) / quantum) since the previous frame
+//            as a zigzag varint
+//   index    uint64 offset and double time for every frame
+//
+// Quantization is always relative to the last keyframe, so the error against the float input stays below
+// quantum / 2 and never accumulates. Seeking to any frame decodes at most keyframeInterval frames.
+
+class AnimationCacheWriter
+{
+public:
+    static const int DEFAULT_KEYFRAME_INTERVAL = 30;
+
+    AnimationCacheWriter();
+    ~AnimationCacheWriter();
+
+    AnimationCacheWriter(const AnimationCacheWriter &)            = delete;
+    AnimationCacheWriter &operator=(const AnimationCacheWriter &) = delete;
+
+    bool open(const std::string &path,
+              const std::vector<Eigen::Vector4i> &tets,
+              const std::vector<Eigen::Vector3i> &faces,
+              int numVertices,
+              float quantum = 1e-5f,
+              int keyframeInterval = DEFAULT_KEYFRAME_INTERVAL);
+
+    // `positions` holds numVertices * 3 floats
+    void writeFrame(const float *positions, double time);
+    void writeFrame(const std::vector<Eigen::Vector3d> &positions, double time);
+
+    // Writes the frame index and patches the header
+    void close();
+
+    bool     isOpen()          const { return m_file != nullptr; }
+    int      getFrameCount()   const { return m_offsets.size(); }
+    uint64_t getBytesWritten() const { return m_bytesWritten; }
+    double   getEncodeSeconds() const { return m_encodeSeconds; }
+
+private:
+    FILE *m_file;
+    int   m_numVertices;
+    float m_quantum;
+    int   m_keyframeInterval;
+
+    std::vector<float>   m_keyframe;  // Positions of the last keyframe
+    std::vector<int32_t> m_quantized; // Last frame, in quanta relative to the keyframe
+    std::vector<uint8_t> m_buffer;    // Encoded frame being assembled
+
+    std::vector<uint64_t> m_offsets;
+    std::vector<double>   m_times;
+    uint64_t m_bytesWritten;
+    double   m_encodeSeconds;
+};
+
+class AnimationCacheReader
+{
+public:
+    AnimationCacheReader();
+    ~AnimationCacheReader();
+
+    AnimationCacheReader(const AnimationCacheReader &)            = delete;
+    AnimationCacheReader &operator=(const AnimationCacheReader &) = delete;
+
+    bool open(const std::string &path);
+    void close();
+
+    int getVertexCount()     const { return m_numVertices; }
+    int getFrameCount()      const { return m_offsets.size(); }
+    int getKeyframeInterval() const { return m_keyframeInterval; }
+    double getFrameTime(int frame) const { return m_times[frame]; }
+
+    const std::vector<Eigen::Vector4i> &getTets()  const { return m_tets; }
+    const std::vector<Eigen::Vector3i> &getFaces() const { return m_faces; }
+
+    // Decodes any frame. Stepping forward from the last decoded frame only decodes the new frame;
+    // anything else restarts from the nearest keyframe at or before `frame`.
+    bool readFrame(int frame, std::vector<Eigen::Vector3d> &positions);
+
+    double getDecodeSeconds() const { return m_decodeSeconds; }
+
+private:
+    bool decodeFrame(int frame);
+
+    FILE *m_file;
+    int   m_numVertices;
+    float m_quantum;
+    int   m_keyframeInterval;
+
+    std::vector<Eigen::Vector4i> m_tets;
+    std::vector<Eigen::Vector3i> m_faces;
+    std::vector<uint64_t>        m_offsets;
+    std::vector<double>          m_times;
+
+    std::vector<float>   m_keyframe;
+    std::vector<int32_t> m_quantized;
+    std::vector<uint8_t> m_buffer;
+    int                  m_currentFrame; // Last decoded frame, or -1
+
+    double m_decodeSeconds;
+};
@@ -0,0 +1,192 @@
+#include "io/checkpoint.h"
+
+#include <cstddef>
+#include <cstring>
+#include <iostream>
+
+namespace {
+
+const char CHECKPOINT_MAGIC[8] = {'F', 'E', 'M', 'C', 'K', 'P', 'T', '\0'};
+
+struct CheckpointHeader {
+    char     magic[8];
+    uint32_t version;
+    uint32_t numSections;
+};
+static_assert(sizeof(CheckpointHeader) == 16, "CheckpointHeader must match the on-disk layout");
+
+struct SectionHeader {
+    uint32_t tag;
+    uint32_t elementSize;
+    uint64_t bytes;
+};
+static_assert(sizeof(SectionHeader) == 16, "SectionHeader must match the on-disk layout");
+
+std::string tagName(uint32_t tag)
+{
+    char name[5] = {static_cast<char>(tag), static_cast<char>(tag >> 8),
+                    static_cast<char>(tag >> 16), static_cast<char>(tag >> 24), '\0'};
+    return name;
+}
+
+}
+
+// ================== Writer
+
+CheckpointWriter::CheckpointWriter()
+    : m_file(nullptr),
+      m_numSections(0),
+      m_bytesWritten(0),
+      m_failed(false)
+{
+}
+
+CheckpointWriter::~CheckpointWriter()
+{
+    close();
+}
+
+bool CheckpointWriter::open(const std::string &path, uint32_t version)
+{
+    close();
+
+    m_file = std::fopen(path.c_str(), "wb");
+    if (m_file == nullptr) {
+        std::cerr << "Error opening file: " << path << std::endl;
+        return false;
+    }
+
+    // The section count is patched in by close()
+    CheckpointHeader header = {};
+    std::memcpy(header.magic, CHECKPOINT_MAGIC, sizeof(CHECKPOINT_MAGIC));
+    header.version = version;
+
+    m_numSections  = 0;
+    m_failed       = std::fwrite(&header, sizeof(header), 1, m_file) != 1;
+    m_bytesWritten = sizeof(header);
+    return !m_failed;
+}
+
+void CheckpointWriter::writeSection(uint32_t tag, const void *data, uint32_t elementSize, uint64_t count)
+{
+    if (m_file == nullptr) return;
+
+    SectionHeader section = {tag, elementSize, elementSize * count};
+    m_failed |= std::fwrite(&section, sizeof(section), 1, m_file) != 1;
+    if (section.bytes > 0) {
+        m_failed |= std::fwrite(data, 1, section.bytes, m_file) != section.bytes;
+    }
+    m_bytesWritten += sizeof(section) + section.bytes;
+    m_numSections++;
+}
+
+bool CheckpointWriter::close()
+{
+    if (m_file == nullptr) return false;
+
+    std::fseek(m_file, offsetof(CheckpointHeader, numSections), SEEK_SET);
+    m_failed |= std::fwrite(&m_numSections, sizeof(uint32_t), 1, m_file) != 1;
+    m_failed |= std::fclose(m_file) != 0;
+    m_file = nullptr;
+    return !m_failed;
+}
+
+// ================== Reader
+
+CheckpointReader::CheckpointReader()
+    : m_file(nullptr),
+      m_version(0),
+      m_sectionsLeft(0),
+      m_bytesRead(0),
+      m_peeked(false),
+      m_tag(0),
+      m_elementSize(0),
+      m_bytes(0)
+{
+}
+
+CheckpointReader::~CheckpointReader()
+{
+    close();
+}
+
+bool CheckpointReader::open(const std::string &path)
+{
+    close();
+
+    m_file = std::fopen(path.c_str(), "rb");
+    if (m_file == nullptr) {
+        std::cerr << "Error opening file: " << path << std::endl;
+        return false;
+    }
+
+    CheckpointHeader header;
+    if (std::fread(&header, sizeof(header), 1, m_file) != 1 ||
+        std::memcmp(header.magic, CHECKPOINT_MAGIC, sizeof(CHECKPOINT_MAGIC)) != 0) {
+        std::cerr << path << " is not a checkpoint" << std::endl;
+        close();
+        return false;
+    }
+
+    m_version      = header.version;
+    m_sectionsLeft = header.numSections;
+    m_bytesRead    = sizeof(header);
+    m_peeked       = false;
+    return true;
+}
+
+void CheckpointReader::close()
+{
+    if (m_file != nullptr) std::fclose(m_file);
+    m_file = nullptr;
+}
+
+bool CheckpointReader::readSection(uint32_t tag, void *data, uint32_t elementSize, uint64_t &count)
+{
+    if (!peekSection()) return false;
+
+    if (m_tag != tag || m_elementSize != elementSize || m_bytes % elementSize != 0) {
+        std::cerr << "Checkpoint section " << tagName(m_tag) << " does not match the expected "
+                  << tagName(tag) << std::endl;
+        return false;
+    }
+    if (data == nullptr) {
+        count = m_bytes / elementSize;
+        return true;
+    }
+    if (count * elementSize != m_bytes) {
+        std::cerr << "Checkpoint section " << tagName(tag) << " has " << m_bytes / elementSize
+                  << " elements, expected " << count << std::endl;
+        return false;
+    }
+
+    m_peeked = false;
+    m_sectionsLeft--;
+    if (m_bytes > 0 && std::fread(data, 1, m_bytes, m_file) != m_bytes) {
+        std::cerr << "Checkpoint is truncated in section " << tagName(tag) << std::endl;
+        return false;
+    }
+    m_bytesRead += m_bytes;
+    return true;
+}
+
+bool CheckpointReader::peekSection()
+{
+    if (m_peeked) return true;
+    if (m_file == nullptr || m_sectionsLeft == 0) {
+        std::cerr << "Checkpoint has no more sections" << std::endl;
+        return false;
+    }
+
+    SectionHeader section;
+    if (std::fread(&section, sizeof(section), 1, m_file) != 1) {
+        std::cerr << "Checkpoint is truncated" << std::endl;
+        return false;
+    }
+    m_tag         = section.tag;
+    m_elementSize = section.elementSize;
+    m_bytes       = section.bytes;
+    m_bytesRead  += sizeof(section);
+    m_peeked      = true;
+    return true;
+}
@@ -0,0 +1,105 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// A versioned binary checkpoint made of tagged sections.
+//
+// Layout:
+//   header   magic[8], uint32 version, uint32 numSections
+//   sections uint32 tag, uint32 elementSize, uint64 bytes, then the raw bytes
+//
+// Every section is one contiguous array that is moved with a single fwrite/fread straight from/into its
+// final storage, so writing and reading a checkpoint is bound by memory and disk bandwidth rather than by
+// per-element work. Sections must be read back in the order they were written.
+
+// Builds a section tag from four characters, e.g. checkpointTag("POSN")
+constexpr uint32_t checkpointTag(const char (&name)[5])
+{
+    return static_cast<uint32_t>(name[0])       | static_cast<uint32_t>(name[1]) << 8 |
+           static_cast<uint32_t>(name[2]) << 16 | static_cast<uint32_t>(name[3]) << 24;
+}
+
+class CheckpointWriter
+{
+public:
+    CheckpointWriter();
+    ~CheckpointWriter();
+
+    CheckpointWriter(const CheckpointWriter &)            = delete;
+    CheckpointWriter &operator=(const CheckpointWriter &) = delete;
+
+    bool open(const std::string &path, uint32_t version);
+
+    void writeSection(uint32_t tag, const void *data, uint32_t elementSize, uint64_t count);
+
+    template <typename T>
+    void write(uint32_t tag, const std::vector<T> &values) { writeSection(tag, values.data(), sizeof(T), values.size()); }
+
+    template <typename T>
+    void write(uint32_t tag, const T &value) { writeSection(tag, &value, sizeof(T), 1); }
+
+    // Patches the section count into the header. Returns false if any write failed.
+    bool close();
+
+    uint64_t getBytesWritten() const { return m_bytesWritten; }
+
+private:
+    FILE    *m_file;
+    uint32_t m_numSections;
+    uint64_t m_bytesWritten;
+    bool     m_failed;
+};
+
+class CheckpointReader
+{
+public:
+    CheckpointReader();
+    ~CheckpointReader();
+
+    CheckpointReader(const CheckpointReader &)            = delete;
+    CheckpointReader &operator=(const CheckpointReader &) = delete;
+
+    bool open(const std::string &path);
+    void close();
+
+    uint32_t getVersion() const { return m_version; }
+
+    // Reads the next section, which must have the given tag and element size. `data` must have room for
+    // `count` elements; pass data = nullptr to set `count` to the section's size without consuming it.
+    bool readSection(uint32_t tag, void *data, uint32_t elementSize, uint64_t &count);
+
+    template <typename T>
+    bool read(uint32_t tag, std::vector<T> &values)
+    {
+        uint64_t count = 0;
+        if (!readSection(tag, nullptr, sizeof(T), count)) return false;
+        values.resize(count);
+        return readSection(tag, values.data(), sizeof(T), count);
+    }
+
+    template <typename T>
+    bool read(uint32_t tag, T &value)
+    {
+        uint64_t count = 1;
+        return readSection(tag, &value, sizeof(T), count);
+    }
+
+    uint64_t getBytesRead() const { return m_bytesRead; }
+
+private:
+    bool peekSection();
+
+    FILE    *m_file;
+    uint32_t m_version;
+    uint32_t m_sectionsLeft;
+    uint64_t m_bytesRead;
+
+    // Header of the next section, once peeked
+    bool     m_peeked;
+    uint32_t m_tag;
+    uint32_t m_elementSize;
+    uint64_t m_bytes;
+};
@@ -0,0 +1,317 @@
+#include "io/meshexporter.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <numeric>
+
+using namespace Eigen;
+
+namespace {
+
+const char     ANIMATION_MAGIC[8]  = {'F', 'E', 'M', 'A', 'N', 'I', 'M', '\0'};
+const uint32_t ANIMATION_VERSION   = 1;
+
+double secondsSince(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+}
+
+MeshExporter::MeshExporter()
+    : m_format(Format::OBJ),
+      m_backpressure(Backpressure::Block),
+      m_queueCapacity(DEFAULT_QUEUE_CAPACITY),
+      m_running(false),
+      m_nextFrame(0),
+      m_animationFile(nullptr),
+      m_stopping(false)
+{
+}
+
+MeshExporter::~MeshExporter()
+{
+    stop();
+    for (Frame *frame : m_freeFrames) delete frame;
+}
+
+bool MeshExporter::start(const std::string &path, Format format,
+                         const std::vector<Eigen::Vector3i> &faces, int numVertices,
+                         Backpressure backpressure, int queueCapacity)
+{
+    return start(path, format, std::vector<Vector4i>(), faces, numVertices, backpressure, queueCapacity);
+}
+
+bool MeshExporter::start(const std::string &path, Format format,
+                         const std::vector<Eigen::Vector4i> &tets,
+                         const std::vector<Eigen::Vector3i> &faces, int numVertices,
+                         Backpressure backpressure, int queueCapacity)
+{
+    if (m_running) stop();
+
+    m_path          = path;
+    m_format        = format;
+    m_backpressure  = backpressure;
+    m_queueCapacity = std::max(queueCapacity, 1);
+    m_nextFrame     = 0;
+    m_stopping      = false;
+    m_stats         = Stats();
+
+    if (m_format == Format::Cache) {
+        // The cache keeps the tets, so it needs every vertex in the original numbering
+        m_surfaceVertices.resize(numVertices);
+        std::iota(m_surfaceVertices.begin(), m_surfaceVertices.end(), 0);
+        m_faces = faces;
+    } else {
+        // Only export vertices that are on the surface, renumbered in order of first use
+        std::vector<int> exportedIndex(numVertices, -1);
+        m_surfaceVertices.clear();
+        m_faces.resize(faces.size());
+        for (size_t f = 0; f < faces.size(); f++) {
+            for (int i = 0; i < 3; i++) {
+                int &index = exportedIndex[faces[f][i]];
+                if (index < 0) {
+                    index = m_surfaceVertices.size();
+                    m_surfaceVertices.push_back(faces[f][i]);
+                }
+                m_faces[f][i] = index;
+            }
+        }
+    }
+
+    if (m_format == Format::Animation) {
+        m_animationFile = std::fopen(m_path.c_str(), "wb");
+        if (m_animationFile == nullptr) {
+            std::cerr << "Error opening file: " << m_path << std::endl;
+            return false;
+        }
+        m_stats.bytesWritten += writeAnimationHeader();
+    } else if (m_format == Format::Cache) {
+        if (!m_cacheWriter.open(m_path, tets, m_faces, numVertices)) return false;
+        m_stats.bytesWritten += m_cacheWriter.getBytesWritten();
+    }
+
+    // One frame per queue slot, plus the one the writer is working on
+    for (int i = static_cast<int>(m_freeFrames.size()); i < m_queueCapacity + 1; i++) {
+        m_freeFrames.push_back(new Frame());
+    }
+
+    m_running = true;
+    m_writer  = std::thread(&MeshExporter::writerLoop, this);
+    return true;
+}
+
+void MeshExporter::stop()
+{
+    if (!m_running) return;
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = true;
+    }
+    m_frameQueued.notify_one();
+    m_writer.join();
+
+    if (m_animationFile != nullptr) {
+        std::fclose(m_animationFile);
+        m_animationFile = nullptr;
+    }
+    if (m_cacheWriter.isOpen()) {
+        // Account for the frame index written on close
+        uint64_t before = m_cacheWriter.getBytesWritten();
+        m_cacheWriter.close();
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stats.bytesWritten += m_cacheWriter.getBytesWritten() - before;
+    }
+    m_running = false;
+}
+
+bool MeshExporter::submit(const std::vector<Eigen::Vector3d> &positions, double time)
+{
+    if (!m_running) return false;
+
+    Frame *frame;
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_stats.framesSubmitted++;
+        if (static_cast<int>(m_queue.size()) >= m_queueCapacity) {
+            if (m_backpressure == Backpressure::Drop) {
+                m_stats.framesDropped++;
+                return false;
+            }
+            m_frameWritten.wait(lock, [this]() { return static_cast<int>(m_queue.size()) < m_queueCapacity; });
+        }
+        frame = m_freeFrames.back();
+        m_freeFrames.pop_back();
+    }
+
+    // The snapshot is the only work done on the caller's thread
+    auto start = std::chrono::steady_clock::now();
+    frame->positions.resize(m_surfaceVertices.size() * 3);
+    float *dst = frame->positions.data();
+    for (int v : m_surfaceVertices) {
+        const Vector3d &p = positions[v];
+        *dst++ = static_cast<float>(p[0]);
+        *dst++ = static_cast<float>(p[1]);
+        *dst++ = static_cast<float>(p[2]);
+    }
+    frame->index = m_nextFrame++;
+    frame->time  = time;
+    double snapshotSeconds = secondsSince(start);
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_queue.push_back(frame);
+        m_stats.framesQueued++;
+        m_stats.snapshotSeconds += snapshotSeconds;
+        m_stats.queueDepth    = m_queue.size();
+        m_stats.maxQueueDepth = std::max(m_stats.maxQueueDepth, m_stats.queueDepth);
+    }
+    m_frameQueued.notify_one();
+    return true;
+}
+
+MeshExporter::Stats MeshExporter::getStats() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_stats;
+}
+
+// ================== Writer Thread
+
+void MeshExporter::writerLoop()
+{
+    while (true) {
+        Frame *frame;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_frameQueued.wait(lock, [this]() { return !m_queue.empty() || m_stopping; });
+            if (m_queue.empty()) break; // Stopping, and everything has been written
+            frame = m_queue.front();
+            m_queue.pop_front();
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        size_t bytes = 0;
+        switch (m_format) {
+        case Format::OBJ:       bytes = writeObj(*frame);            break;
+        case Format::PLY:       bytes = writePly(*frame);            break;
+        case Format::Animation: bytes = writeAnimationFrame(*frame); break;
+        case Format::Cache:     bytes = writeCacheFrame(*frame);     break;
+        }
+        double writeSeconds = secondsSince(start);
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_freeFrames.push_back(frame);
+            m_stats.framesWritten++;
+            m_stats.bytesWritten += bytes;
+            m_stats.writeSeconds += writeSeconds;
+            m_stats.queueDepth    = m_queue.size();
+        }
+        m_frameWritten.notify_one();
+    }
+}
+
+size_t MeshExporter::writeObj(const Frame &frame)
+{
+    std::string path = framePath(frame.index, "obj");
+    FILE *file = std::fopen(path.c_str(), "w");
+    if (file == nullptr) {
+        std::cerr << "Error opening file: " << path << std::endl;
+        return 0;
+    }
+
+    // Format into one buffer and write it in a single call
+    std::string text;
+    text.reserve(m_surfaceVertices.size() * 40 + m_faces.size() * 24);
+    char line[96];
+    const float *p = frame.positions.data();
+    for (size_t v = 0; v < m_surfaceVertices.size(); v++, p += 3) {
+        int n = std::snprintf(line, sizeof(line), "v %.6g %.6g %.6g\n", p[0], p[1], p[2]);
+        text.append(line, n);
+    }
+    for (const Vector3i &f : m_faces) {
+        int n = std::snprintf(line, sizeof(line), "f %d %d %d\n", f[0] + 1, f[1] + 1, f[2] + 1);
+        text.append(line, n);
+    }
+    size_t bytes = std::fwrite(text.data(), 1, text.size(), file);
+    std::fclose(file);
+    return bytes;
+}
+
+// Assumes a little-endian host, as do all the platforms we build on
+size_t MeshExporter::writePly(const Frame &frame)
+{
+    std::string path = framePath(frame.index, "ply");
+    FILE *file = std::fopen(path.c_str(), "wb");
+    if (file == nullptr) {
+        std::cerr << "Error opening file: " << path << std::endl;
+        return 0;
+    }
+
+    char header[256];
+    int headerSize = std::snprintf(header, sizeof(header),
+                                   "ply\nformat binary_little_endian 1.0\n"
+                                   "element vertex %zu\nproperty float x\nproperty float y\nproperty float z\n"
+                                   "element face %zu\nproperty list uchar int vertex_indices\nend_header\n",
+                                   m_surfaceVertices.size(), m_faces.size());
+
+    // Each face record is a count byte followed by three indices
+    const size_t faceRecord = 1 + 3 * sizeof(int32_t);
+    std::vector<unsigned char> faceData(m_faces.size() * faceRecord);
+    unsigned char *dst = faceData.data();
+    for (const Vector3i &f : m_faces) {
+        int32_t indices[3] = {f[0], f[1], f[2]};
+        *dst++ = 3;
+        std::memcpy(dst, indices, sizeof(indices));
+        dst += sizeof(indices);
+    }
+
+    size_t bytes = std::fwrite(header, 1, headerSize, file);
+    bytes += std::fwrite(frame.positions.data(), sizeof(float), frame.positions.size(), file) * sizeof(float);
+    bytes += std::fwrite(faceData.data(), 1, faceData.size(), file);
+    std::fclose(file);
+    return bytes;
+}
+
+// Layout: magic[8], uint32 version, uint32 numVertices, uint32 numFaces, int32 faces[numFaces][3], then
+// frames of { double time; float positions[numVertices][3] } until the end of the file
+size_t MeshExporter::writeAnimationHeader()
+{
+    uint32_t counts[3] = {ANIMATION_VERSION,
+                          static_cast<uint32_t>(m_surfaceVertices.size()),
+                          static_cast<uint32_t>(m_faces.size())};
+    size_t bytes = std::fwrite(ANIMATION_MAGIC, 1, sizeof(ANIMATION_MAGIC), m_animationFile);
+    bytes += std::fwrite(counts, 1, sizeof(counts), m_animationFile);
+    bytes += std::fwrite(m_faces.data(), sizeof(int), m_faces.size() * 3, m_animationFile) * sizeof(int);
+    std::fflush(m_animationFile);
+    return bytes;
+}
+
+size_t MeshExporter::writeAnimationFrame(const Frame &frame)
+{
+    size_t bytes = std::fwrite(&frame.time, 1, sizeof(double), m_animationFile);
+    bytes += std::fwrite(frame.positions.data(), sizeof(float), frame.positions.size(), m_animationFile) * sizeof(float);
+
+    // Keep the file readable while the simulation is still running
+    std::fflush(m_animationFile);
+    return bytes;
+}
+
+size_t MeshExporter::writeCacheFrame(const Frame &frame)
+{
+    uint64_t before = m_cacheWriter.getBytesWritten();
+    m_cacheWriter.writeFrame(frame.positions.data(), frame.time);
+    return m_cacheWriter.getBytesWritten() - before;
+}
+
+std::string MeshExporter::framePath(int index, const char *extension) const
+{
+    char filename[64];
+    std::snprintf(filename, sizeof(filename), "/frame_%05d.%s", index, extension);
+    return m_path + filename;
+}
@@ -0,0 +1,111 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Eigen/Dense"
+#include "io/animationcache.h"
+
+// Writes the deforming surface to disk every frame without blocking the simulation.
+//
+// submit() only gathers the surface vertex positions into a pooled float buffer and queues it; a writer
+// thread drains the bounded queue and does all formatting and I/O. When the queue is full, submit()
+// either waits for the writer (Backpressure::Block) or drops the frame (Backpressure::Drop).
+class MeshExporter
+{
+public:
+    enum class Format {
+        OBJ,       // One text .obj per frame
+        PLY,       // One binary little-endian .ply per frame
+        Animation, // A single appendable file: header and faces once, then fixed-size frames
+        Cache      // A delta-compressed AnimationCache of every vertex, with the tets
+    };
+
+    enum class Backpressure { Block, Drop };
+
+    struct Stats {
+        int    framesSubmitted = 0;
+        int    framesQueued    = 0; // Submitted and snapshotted, i.e. not dropped
+        int    framesWritten   = 0;
+        int    framesDropped   = 0;
+        int    queueDepth      = 0;
+        int    maxQueueDepth   = 0;
+        size_t bytesWritten    = 0;
+        double writeSeconds    = 0; // Time the writer spent formatting and writing
+        double snapshotSeconds = 0; // Time submit() spent on the caller's thread, over the queued frames
+
+        double getBandwidth() const { return writeSeconds > 0 ? bytesWritten / writeSeconds : 0; } // Bytes/second
+        double getSnapshotSeconds() const { return framesQueued > 0 ? snapshotSeconds / framesQueued : 0; } // Per frame
+    };
+
+    static const int DEFAULT_QUEUE_CAPACITY = 8;
+
+    MeshExporter();
+    ~MeshExporter();
+
+    MeshExporter(const MeshExporter &)            = delete;
+    MeshExporter &operator=(const MeshExporter &) = delete;
+
+    // `path` is a directory for OBJ/PLY and a file for Animation and Cache. Except for Cache, only vertices
+    // referenced by `faces` are exported, and faces are renumbered accordingly.
+    bool start(const std::string &path, Format format,
+               const std::vector<Eigen::Vector3i> &faces, int numVertices,
+               Backpressure backpressure = Backpressure::Block,
+               int queueCapacity = DEFAULT_QUEUE_CAPACITY);
+    bool start(const std::string &path, Format format,
+               const std::vector<Eigen::Vector4i> &tets,
+               const std::vector<Eigen::Vector3i> &faces, int numVertices,
+               Backpressure backpressure = Backpressure::Block,
+               int queueCapacity = DEFAULT_QUEUE_CAPACITY);
+
+    // Writes out everything still queued, then joins the writer thread
+    void stop();
+
+    // Returns false if the frame was dropped
+    bool submit(const std::vector<Eigen::Vector3d> &positions, double time);
+
+    bool  isRunning() const { return m_running; }
+    Stats getStats() const;
+
+private:
+    struct Frame {
+        std::vector<float> positions;
+        int    index;
+        double time;
+    };
+
+    void writerLoop();
+    size_t writeObj(const Frame &frame);
+    size_t writePly(const Frame &frame);
+    size_t writeAnimationFrame(const Frame &frame);
+    size_t writeAnimationHeader();
+    size_t writeCacheFrame(const Frame &frame);
+    std::string framePath(int index, const char *extension) const;
+
+    std::string  m_path;
+    Format       m_format;
+    Backpressure m_backpressure;
+    int          m_queueCapacity;
+    bool         m_running;
+    int          m_nextFrame;
+
+    std::vector<int>             m_surfaceVertices; // Mesh vertex index for each exported vertex
+    std::vector<Eigen::Vector3i> m_faces;           // In exported vertex numbering
+    FILE                        *m_animationFile;
+    AnimationCacheWriter         m_cacheWriter;
+
+    std::thread              m_writer;
+    mutable std::mutex       m_mutex;
+    std::condition_variable  m_frameQueued;
+    std::condition_variable  m_frameWritten;
+    std::deque<Frame *>      m_queue;
+    std::vector<Frame *>     m_freeFrames;
+    bool                     m_stopping;
+
+    Stats m_stats;
+};
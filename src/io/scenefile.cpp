@@ -0,0 +1,377 @@
+#include "io/scenefile.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <initializer_list>
+
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QJsonParseError>
+
+using namespace Eigen;
+
+namespace {
+
+// Reports keys the reader doesn't know, which are almost always typos
+void warnUnknownKeys(const QJsonObject &object, std::initializer_list<const char *> known,
+                     const std::string &path, const std::string &context)
+{
+    for (const QString &key : object.keys()) {
+        bool found = false;
+        for (const char *name : known) found = found || key == QLatin1String(name);
+        if (!found) {
+            std::cerr << path << ": ignoring unknown key \"" << key.toStdString() << "\" in " << context << std::endl;
+        }
+    }
+}
+
+// Each of these leaves `value` alone if `key` is missing, and fails if it holds the wrong type
+
+bool readNumber(const QJsonObject &object, const char *key, double &value, const std::string &path)
+{
+    if (!object.contains(key)) return true;
+    if (!object[key].isDouble()) {
+        std::cerr << path << ": \"" << key << "\" must be a number" << std::endl;
+        return false;
+    }
+    value = object[key].toDouble();
+    return true;
+}
+
+bool readInt(const QJsonObject &object, const char *key, int &value, const std::string &path)
+{
+    double number = value;
+    if (!readNumber(object, key, number, path)) return false;
+    if (number != std::floor(number)) {
+        std::cerr << path << ": \"" << key << "\" must be a whole number" << std::endl;
+        return false;
+    }
+    value = static_cast<int>(number);
+    return true;
+}
+
+bool readBool(const QJsonObject &object, const char *key, bool &value, const std::string &path)
+{
+    if (!object.contains(key)) return true;
+    if (!object[key].isBool()) {
+        std::cerr << path << ": \"" << key << "\" must be true or false" << std::endl;
+        return false;
+    }
+    value = object[key].toBool();
+    return true;
+}
+
+bool readString(const QJsonObject &object, const char *key, std::string &value, const std::string &path)
+{
+    if (!object.contains(key)) return true;
+    if (!object[key].isString()) {
+        std::cerr << path << ": \"" << key << "\" must be a string" << std::endl;
+        return false;
+    }
+    value = object[key].toString().toStdString();
+    return true;
+}
+
+bool readVector(const QJsonObject &object, const char *key, Vector3d &value, const std::string &path)
+{
+    if (!object.contains(key)) return true;
+    QJsonArray array = object[key].toArray();
+    if (!object[key].isArray() || array.size() != 3 ||
+        !array[0].isDouble() || !array[1].isDouble() || !array[2].isDouble()) {
+        std::cerr << path << ": \"" << key << "\" must be an array of three numbers" << std::endl;
+        return false;
+    }
+    value = Vector3d(array[0].toDouble(), array[1].toDouble(), array[2].toDouble());
+    return true;
+}
+
+bool readNumbers(const QJsonObject &object, const char *key, std::vector<double> &values, const std::string &path)
+{
+    if (!object.contains(key)) return true;
+    if (!object[key].isArray()) {
+        std::cerr << path << ": \"" << key << "\" must be an array of numbers" << std::endl;
+        return false;
+    }
+    values.clear();
+    for (const QJsonValue &value : object[key].toArray()) {
+        if (!value.isDouble()) {
+            std::cerr << path << ": \"" << key << "\" must be an array of numbers" << std::endl;
+            return false;
+        }
+        values.push_back(value.toDouble());
+    }
+    return true;
+}
+
+bool readObject(const QJsonObject &object, const char *key, QJsonObject &value, const std::string &path)
+{
+    if (!object.contains(key)) return true;
+    if (!object[key].isObject()) {
+        std::cerr << path << ": \"" << key << "\" must be an object" << std::endl;
+        return false;
+    }
+    value = object[key].toObject();
+    return true;
+}
+
+bool isValid(const Material &material, const std::string &path)
+{
+    if (material.density <= 0 || material.youngsModulus <= 0 || material.viscosity < 0 ||
+        material.poissonRatio <= -1 || material.poissonRatio >= 0.5) {
+        std::cerr << path << ": material needs positive density and Young's modulus, non-negative viscosity and "
+                  << "a Poisson ratio in (-1, 0.5)" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool readMaterial(const QJsonObject &object, Material &material, const std::string &path)
+{
+    warnUnknownKeys(object, {"density", "youngsModulus", "poissonRatio", "viscosity"}, path, "material");
+    return readNumber(object, "density", material.density, path) &&
+           readNumber(object, "youngsModulus", material.youngsModulus, path) &&
+           readNumber(object, "poissonRatio", material.poissonRatio, path) &&
+           readNumber(object, "viscosity", material.viscosity, path) &&
+           isValid(material, path);
+}
+
+bool readSweep(const QJsonObject &object, SceneDescription::Sweep &sweep, const std::string &path)
+{
+    warnUnknownKeys(object, {"youngsModulus", "poissonRatio", "viscosity", "density", "results", "compareSchedules"},
+                    path, "sweep");
+    if (!readNumbers(object, "youngsModulus", sweep.youngsModulus, path) ||
+        !readNumbers(object, "poissonRatio", sweep.poissonRatio, path) ||
+        !readNumbers(object, "viscosity", sweep.viscosity, path) ||
+        !readNumbers(object, "density", sweep.density, path) ||
+        !readString(object, "results", sweep.resultsPath, path) ||
+        !readBool(object, "compareSchedules", sweep.compareSchedules, path)) {
+        return false;
+    }
+
+    // Every swept value has to make a valid material with the defaults for the rest
+    auto allValid = [&](const std::vector<double> &values, double Material::*property) {
+        for (double value : values) {
+            Material material;
+            material.*property = value;
+            if (!isValid(material, path)) return false;
+        }
+        return true;
+    };
+    return allValid(sweep.youngsModulus, &Material::youngsModulus) &&
+           allValid(sweep.poissonRatio, &Material::poissonRatio) &&
+           allValid(sweep.viscosity, &Material::viscosity) &&
+           allValid(sweep.density, &Material::density);
+}
+
+bool readBody(const QJsonObject &object, SceneDescription::Body &body, const std::string &path)
+{
+    warnUnknownKeys(object, {"mesh", "renderMesh", "translation", "rotation", "scale", "material"}, path, "body");
+    Vector3d translation = Vector3d::Zero();
+    Vector3d rotation    = Vector3d::Zero();
+    double   scale       = 1;
+    QJsonObject material;
+    if (!readString(object, "mesh", body.mesh, path) ||
+        !readString(object, "renderMesh", body.renderMesh, path) ||
+        !readVector(object, "translation", translation, path) ||
+        !readVector(object, "rotation", rotation, path) ||
+        !readNumber(object, "scale", scale, path) ||
+        !readObject(object, "material", material, path) ||
+        !readMaterial(material, body.material, path)) {
+        return false;
+    }
+    if (body.mesh.empty()) {
+        std::cerr << path << ": every body needs a \"mesh\"" << std::endl;
+        return false;
+    }
+    // Tets must keep their orientation, so no mirroring
+    if (scale <= 0) {
+        std::cerr << path << ": \"scale\" must be positive" << std::endl;
+        return false;
+    }
+
+    rotation *= M_PI / 180;
+    body.transform = Translation3d(translation) *
+                     AngleAxisd(rotation.z(), Vector3d::UnitZ()) *
+                     AngleAxisd(rotation.y(), Vector3d::UnitY()) *
+                     AngleAxisd(rotation.x(), Vector3d::UnitX()) *
+                     Scaling(scale);
+    return true;
+}
+
+bool readColliders(const QJsonObject &object, SceneDescription &description, const std::string &path)
+{
+    warnUnknownKeys(object, {"directory", "spheres"}, path, "colliders");
+    if (!readString(object, "directory", description.colliderDir, path)) return false;
+    if (!object.contains("spheres")) return true;
+    if (!object["spheres"].isArray()) {
+        std::cerr << path << ": \"spheres\" must be an array" << std::endl;
+        return false;
+    }
+
+    description.spheres.clear();
+    for (const QJsonValue &value : object["spheres"].toArray()) {
+        QJsonObject sphereObject = value.toObject();
+        warnUnknownKeys(sphereObject, {"centre", "radius"}, path, "sphere");
+        SphereCollider sphere;
+        if (!value.isObject() ||
+            !readVector(sphereObject, "centre", sphere.centre, path) ||
+            !readNumber(sphereObject, "radius", sphere.radius, path)) {
+            std::cerr << path << ": bad sphere collider" << std::endl;
+            return false;
+        }
+        if (sphere.radius <= 0) {
+            std::cerr << path << ": sphere radius must be positive" << std::endl;
+            return false;
+        }
+        description.spheres.push_back(sphere);
+    }
+    return true;
+}
+
+bool readOutput(const QJsonObject &object, SceneDescription &description, const std::string &path)
+{
+    warnUnknownKeys(object, {"path", "format"}, path, "output");
+    std::string format;
+    if (!readString(object, "path", description.outputPath, path) ||
+        !readString(object, "format", format, path)) {
+        return false;
+    }
+    if      (format.empty())        return true;
+    else if (format == "obj")       description.outputFormat = MeshExporter::Format::OBJ;
+    else if (format == "ply")       description.outputFormat = MeshExporter::Format::PLY;
+    else if (format == "animation") description.outputFormat = MeshExporter::Format::Animation;
+    else if (format == "cache")     description.outputFormat = MeshExporter::Format::Cache;
+    else {
+        std::cerr << path << ": unknown output format \"" << format
+                  << "\" (expected obj, ply, animation or cache)" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+}
+
+std::vector<std::vector<Material>> SceneDescription::Sweep::expand(const std::vector<Body> &bodies) const
+{
+    // A property that isn't swept counts as a single value, each body's own
+    auto count = [](const std::vector<double> &values) { return std::max<size_t>(values.size(), 1); };
+
+    std::vector<std::vector<Material>> runs;
+    for (size_t e = 0; e < count(youngsModulus); e++) {
+        for (size_t p = 0; p < count(poissonRatio); p++) {
+            for (size_t v = 0; v < count(viscosity); v++) {
+                for (size_t d = 0; d < count(density); d++) {
+                    std::vector<Material> materials;
+                    for (const Body &body : bodies) {
+                        Material material = body.material;
+                        if (!youngsModulus.empty()) material.youngsModulus = youngsModulus[e];
+                        if (!poissonRatio.empty())  material.poissonRatio  = poissonRatio[p];
+                        if (!viscosity.empty())     material.viscosity     = viscosity[v];
+                        if (!density.empty())       material.density       = density[d];
+                        materials.push_back(material);
+                    }
+                    runs.push_back(materials);
+                }
+            }
+        }
+    }
+    return runs;
+}
+
+SceneDescription::SceneDescription()
+{
+    Body body;
+    body.mesh      = ":/example-meshes/single-tet.mesh";
+    body.transform = Translation3d(0, 2, 0);
+    bodies.push_back(body);
+}
+
+bool SceneFile::load(const std::string &path, SceneDescription &description)
+{
+    QFile file(QString::fromStdString(path));
+    if (!file.open(QIODevice::ReadOnly)) {
+        std::cerr << "Error opening scene file: " << path << std::endl;
+        return false;
+    }
+    QJsonParseError error;
+    QJsonDocument document = QJsonDocument::fromJson(file.readAll(), &error);
+    if (document.isNull()) {
+        std::cerr << path << ": " << error.errorString().toStdString() << " at offset " << error.offset << std::endl;
+        return false;
+    }
+    if (!document.isObject()) {
+        std::cerr << path << ": expected a JSON object" << std::endl;
+        return false;
+    }
+    const QJsonObject root = document.object();
+    warnUnknownKeys(root, {"bodies", "colliders", "ground", "gravity", "integrator", "reduction", "timestep",
+                           "threads", "continuousCollision", "selfCollision", "output", "sweep", "duration"},
+                    path, "scene");
+
+    // Read into a copy so that a bad file leaves the caller's description as it was
+    SceneDescription scene = description;
+
+    if (root.contains("bodies")) {
+        if (!root["bodies"].isArray() || root["bodies"].toArray().isEmpty()) {
+            std::cerr << path << ": \"bodies\" must be a non-empty array" << std::endl;
+            return false;
+        }
+        scene.bodies.clear();
+        for (const QJsonValue &value : root["bodies"].toArray()) {
+            SceneDescription::Body body;
+            if (!value.isObject()) {
+                std::cerr << path << ": every body must be an object" << std::endl;
+                return false;
+            }
+            if (!readBody(value.toObject(), body, path)) return false;
+            scene.bodies.push_back(body);
+        }
+    }
+
+    QJsonObject colliders, output, sweep;
+    std::string integrator = scene.integrator == FemSolver::Integrator::ImplicitEuler ? "implicitEuler" : "midpoint";
+    std::string reduction  = scene.reduction == FemSolver::Reduction::Atomic ? "atomic" : "deterministic";
+    if (!readObject(root, "colliders", colliders, path) ||
+        !readColliders(colliders, scene, path) ||
+        !readNumber(root, "ground", scene.groundHeight, path) ||
+        !readVector(root, "gravity", scene.gravity, path) ||
+        !readString(root, "integrator", integrator, path) ||
+        !readString(root, "reduction", reduction, path) ||
+        !readNumber(root, "timestep", scene.timestep, path) ||
+        !readInt(root, "threads", scene.threads, path) ||
+        !readBool(root, "continuousCollision", scene.continuousCollision, path) ||
+        !readBool(root, "selfCollision", scene.selfCollision, path) ||
+        !readObject(root, "output", output, path) ||
+        !readOutput(output, scene, path) ||
+        !readObject(root, "sweep", sweep, path) ||
+        !readSweep(sweep, scene.sweep, path) ||
+        !readNumber(root, "duration", scene.duration, path)) {
+        return false;
+    }
+
+    if      (integrator == "midpoint")      scene.integrator = FemSolver::Integrator::Midpoint;
+    else if (integrator == "implicitEuler") scene.integrator = FemSolver::Integrator::ImplicitEuler;
+    else {
+        std::cerr << path << ": unknown integrator \"" << integrator << "\" (expected midpoint or implicitEuler)"
+                  << std::endl;
+        return false;
+    }
+    if      (reduction == "deterministic") scene.reduction = FemSolver::Reduction::Deterministic;
+    else if (reduction == "atomic")        scene.reduction = FemSolver::Reduction::Atomic;
+    else {
+        std::cerr << path << ": unknown reduction \"" << reduction << "\" (expected deterministic or atomic)"
+                  << std::endl;
+        return false;
+    }
+    if (scene.timestep <= 0 || scene.threads < 0 || scene.duration < 0) {
+        std::cerr << path << ": \"timestep\" must be positive, and \"threads\" and \"duration\" non-negative"
+                  << std::endl;
+        return false;
+    }
+
+    description = scene;
+    return true;
+}
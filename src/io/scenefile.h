@@ -0,0 +1,102 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include "Eigen/Dense"
+#include "Eigen/Geometry"
+
+#include "collision/colliders.h"
+#include "fem/femsolver.h"
+#include "fem/material.h"
+#include "io/meshexporter.h"
+
+// Everything needed to set up a run: bodies, obstacles, solver settings and output. The defaults reproduce
+// the built-in scene, the single example tet dropped from y = 2.
+struct SceneDescription
+{
+    struct Body {
+        std::string     mesh;       // A .mesh file; Qt resource paths (":/...") work too
+        std::string     renderMesh; // An optional .obj drawn instead of the tet surface, in the mesh's frame
+        Eigen::Affine3d transform = Eigen::Affine3d::Identity();
+        Material        material;
+    };
+
+    // Materials for a headless ensemble run: every combination of the listed values, each applied to every
+    // body in place of its own. A property with no values keeps the bodies' own.
+    struct Sweep {
+        std::vector<double> youngsModulus;
+        std::vector<double> poissonRatio;
+        std::vector<double> viscosity;
+        std::vector<double> density;
+        std::string resultsPath;               // CSV of per-run metrics; empty to only print them
+        bool        compareSchedules  = false; // Also time the runs under the other Ensemble schedules
+
+        bool isEmpty() const { return youngsModulus.empty() && poissonRatio.empty() && viscosity.empty() && density.empty(); }
+        // One entry per run, holding a material per body
+        std::vector<std::vector<Material>> expand(const std::vector<Body> &bodies) const;
+    };
+
+    SceneDescription();
+
+    std::vector<Body> bodies;
+
+    // Every .obj in colliderDir becomes a static distance-field collider; empty for none
+    std::string                 colliderDir = "colliders";
+    std::vector<SphereCollider> spheres;
+    double                      groundHeight = 0;
+    Eigen::Vector3d             gravity      = Eigen::Vector3d(0, -9.81, 0);
+
+    FemSolver::Integrator integrator          = FemSolver::Integrator::Midpoint;
+    FemSolver::Reduction  reduction           = FemSolver::Reduction::Deterministic;
+    double                timestep            = 1e-3;
+    int                   threads             = 0; // 0 leaves the OpenMP default
+    bool                  continuousCollision = false;
+    bool                  selfCollision       = false;
+
+    // Written from the first step when outputPath isn't empty
+    std::string          outputPath;
+    MeshExporter::Format outputFormat = MeshExporter::Format::OBJ;
+
+    Sweep sweep;
+
+    // Simulated time of a headless run
+    double duration = 5;
+};
+
+// Reads a SceneDescription from JSON. Every key is optional and falls back to the defaults above (the comments
+// below are only explanation; JSON has none):
+//
+//   {
+//     "bodies": [{
+//       "mesh": "example-meshes/sphere.mesh",
+//       "renderMesh": "sphere-detailed.obj",  // Carried along by the tets it lies in
+//       "translation": [0, 2, 0],
+//       "rotation": [0, 45, 0],          // Degrees about x, then y, then z
+//       "scale": 1,
+//       "material": {"density": 1000, "youngsModulus": 2e4, "poissonRatio": 0.3, "viscosity": 20}
+//     }],
+//     "colliders": {"directory": "colliders", "spheres": [{"centre": [0, 0.5, 0], "radius": 0.5}]},
+//     "ground": 0,
+//     "gravity": [0, -9.81, 0],
+//     "integrator": "midpoint",             // or "implicitEuler"
+//     "reduction": "deterministic",         // or "atomic"
+//     "timestep": 0.001,
+//     "threads": 0,
+//     "continuousCollision": false,
+//     "selfCollision": false,
+//     "output": {"path": "export", "format": "obj"},  // or "ply", "animation", "cache"
+//     "sweep": {"youngsModulus": [1e4, 2e4, 5e4], "poissonRatio": [0.3, 0.45], "viscosity": [10, 20],
+//               "density": [1000], "results": "sweep.csv", "compareSchedules": false},
+//     "duration": 5
+//   }
+//
+// Relative mesh, collider and output paths are taken relative to the working directory.
+class SceneFile
+{
+public:
+    // Leaves `description` untouched on failure
+    static bool load(const std::string &path, SceneDescription &description);
+
+private:
+    SceneFile();
+};
@@ -1,15 +1,106 @@
 #include "mainwindow.h"
+#include "simulation.h"
+#include "io/scenefile.h"
+#include "profiling/profiler.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
 #include <cstdlib>
+#include <cstring>
 #include <ctime>
+#include <iostream>
 
 #include <QApplication>
 #include <QSurfaceFormat>
 #include <QScreen>
 
+namespace {
+
+void printUsage(const char *program)
+{
+    std::cerr << "Usage: " << program << " [--scene <file.json>] [--headless] [--profile <trace.json>]\n"
+              << "  --scene     set up the run from a JSON scene file (see io/scenefile.h)\n"
+              << "  --headless  simulate the scene's duration without opening a window, then exit; with a material\n"
+              << "              sweep, runs every combination concurrently and reports per-run metrics\n"
+              << "  --profile   record profiling zones from startup and write them as a Chrome trace on exit; each\n"
+              << "              thread keeps its most recent zones" << std::endl;
+}
+
+// Stops the recording --profile started and writes it out
+void writeProfile(const std::string &path)
+{
+    if (path.empty()) return;
+    Profiler::setRecording(false);
+    if (Profiler::writeChromeTrace(path)) {
+        std::cout << "Wrote " << path << " (open it in chrome://tracing or ui.perfetto.dev)" << std::endl;
+    }
+}
+
+// Steps the scene (or every run of its sweep) for its whole duration as fast as possible, writing whatever
+// output it asks for
+int runHeadless(const SceneDescription &scene)
+{
+    Simulation sim;
+    if (!sim.init(scene, false)) return EXIT_FAILURE;
+
+    const long steps = std::lround(scene.duration / scene.timestep);
+    if (!scene.sweep.isEmpty()) {
+        return sim.runSweep(steps) ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    std::cout << "Simulating " << sim.getVertexCount() << " vertices, " << sim.getTetCount() << " tets for "
+              << steps << " steps of " << scene.timestep << " s on " << FemSolver::getThreadCount() << " threads"
+              << std::endl;
+
+    auto start = std::chrono::steady_clock::now();
+    for (long s = 0; s < steps; s++) {
+        sim.update(scene.timestep);
+    }
+    double stepping = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    sim.stopOutput();
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    Simulation::Stats stats = sim.getStats();
+    std::cout << "Simulated " << sim.getTime() << " s in " << seconds << " s: "
+              << 1e3 * stepping / std::max<uint64_t>(stats.steps, 1) << " ms per step" << std::endl;
+    return EXIT_SUCCESS;
+}
+
+}
+
 int main(int argc, char *argv[])
 {
     srand(static_cast<unsigned>(time(0)));
 
+    SceneDescription scene;
+    bool headless = false;
+    std::string profilePath;
+    for (int i = 1; i < argc; i++) {
+        if (std::strcmp(argv[i], "--scene") == 0 && i + 1 < argc) {
+            if (!SceneFile::load(argv[++i], scene)) return EXIT_FAILURE;
+        } else if (std::strcmp(argv[i], "--headless") == 0) {
+            headless = true;
+        } else if (std::strcmp(argv[i], "--profile") == 0 && i + 1 < argc) {
+            profilePath = argv[++i];
+        } else {
+            printUsage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (!profilePath.empty()) {
+#if PROFILING_ENABLED
+        Profiler::setRecording(true);
+#else
+        std::cerr << "Profiling was disabled at compile time (ENABLE_PROFILING=OFF)" << std::endl;
+        profilePath.clear();
+#endif
+    }
+    if (headless) {
+        int status = runHeadless(scene);
+        writeProfile(profilePath);
+        return status;
+    }
+
     // Create a Qt application
     QApplication a(argc, argv);
     QCoreApplication::setApplicationName("Simulation");
@@ -23,7 +114,7 @@ int main(int argc, char *argv[])
     QSurfaceFormat::setDefaultFormat(fmt);
 
     // Create a GUI window
-    MainWindow w;
+    MainWindow w(scene);
     w.resize(600, 500);
     int desktopArea = QGuiApplication::primaryScreen()->size().width() *
                       QGuiApplication::primaryScreen()->size().height();
@@ -33,6 +124,7 @@ int main(int argc, char *argv[])
     else
         w.showMaximized();
 
-
-    return a.exec();
+    int status = a.exec();
+    writeProfile(profilePath);
+    return status;
 }
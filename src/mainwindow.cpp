@@ -1,9 +1,9 @@
 #include "mainwindow.h"
 #include <QHBoxLayout>
 
-MainWindow::MainWindow()
+MainWindow::MainWindow(const SceneDescription &scene)
 {
-    glWidget = new GLWidget();
+    glWidget = new GLWidget(scene);
 
     QHBoxLayout *container = new QHBoxLayout;
     container->addWidget(glWidget);
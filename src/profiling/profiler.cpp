@@ -0,0 +1,142 @@
+#include "profiling/profiler.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace {
+
+// Events per thread; older events are overwritten once a ring is full
+const uint64_t RING_CAPACITY = 1 << 16;
+
+struct ProfileEvent {
+    const char *name;
+    uint64_t    startNs;
+    uint64_t    endNs;
+};
+
+// A ring slot, read while its owner may be overwriting it, so every field is atomic (relaxed, which costs the
+// writer nothing over plain stores)
+struct EventSlot {
+    std::atomic<const char *> name{nullptr};
+    std::atomic<uint64_t>     startNs{0};
+    std::atomic<uint64_t>     endNs{0};
+};
+
+// Written only by its owning thread. head counts every event ever written, so slot (i % capacity)
+// holds event i for head - capacity <= i < head. begun is head + 1 from just before an event's slot is
+// written, so a reader that may have seen part of event i knows to drop whatever slot i overwrote.
+struct ThreadRing {
+    std::unique_ptr<EventSlot[]> events;
+    std::atomic<uint64_t>        head{0};
+    std::atomic<uint64_t>        begun{0};
+    std::atomic<uint64_t>        clearedAt{0}; // Events before this index were dropped by clear()
+};
+
+// Rings are never freed, so a trace can still be written after their threads have exited
+std::mutex                               g_ringsMutex;
+std::vector<std::unique_ptr<ThreadRing>> g_rings;
+
+ThreadRing *createRing()
+{
+    std::lock_guard<std::mutex> lock(g_ringsMutex);
+    auto ring = std::make_unique<ThreadRing>();
+    ring->events = std::make_unique<EventSlot[]>(RING_CAPACITY);
+    g_rings.push_back(std::move(ring));
+    return g_rings.back().get();
+}
+
+ThreadRing &threadRing()
+{
+    thread_local ThreadRing *ring = createRing();
+    return *ring;
+}
+
+}
+
+namespace Profiler {
+
+std::atomic<bool> g_recording(false);
+
+void setRecording(bool recording)
+{
+    g_recording.store(recording, std::memory_order_relaxed);
+}
+
+void record(const char *name, uint64_t startNs, uint64_t endNs)
+{
+    ThreadRing &ring = threadRing();
+    uint64_t head = ring.head.load(std::memory_order_relaxed);
+    ring.begun.store(head + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    EventSlot &slot = ring.events[head % RING_CAPACITY];
+    slot.name.store(name, std::memory_order_relaxed);
+    slot.startNs.store(startNs, std::memory_order_relaxed);
+    slot.endNs.store(endNs, std::memory_order_relaxed);
+    ring.head.store(head + 1, std::memory_order_release);
+}
+
+bool writeChromeTrace(const std::string &path)
+{
+    FILE *file = std::fopen(path.c_str(), "w");
+    if (file == nullptr) {
+        std::cerr << "Error opening file: " << path << std::endl;
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(g_ringsMutex);
+
+    // Timestamps are relative to the earliest event so that they stay readable in the viewer
+    uint64_t origin = UINT64_MAX;
+    std::vector<std::vector<ProfileEvent>> snapshots(g_rings.size());
+    for (size_t r = 0; r < g_rings.size(); r++) {
+        ThreadRing &ring = *g_rings[r];
+        uint64_t head  = ring.head.load(std::memory_order_acquire);
+        uint64_t first = std::max(ring.clearedAt.load(std::memory_order_relaxed),
+                                  head > RING_CAPACITY ? head - RING_CAPACITY : 0);
+        for (uint64_t i = first; i < head; i++) {
+            const EventSlot &slot = ring.events[i % RING_CAPACITY];
+            snapshots[r].push_back({slot.name.load(std::memory_order_relaxed),
+                                    slot.startNs.load(std::memory_order_relaxed),
+                                    slot.endNs.load(std::memory_order_relaxed)});
+        }
+
+        // The owning thread may have lapped us while copying. Anything it began writing is visible through
+        // begun after this fence (seqlock style), so every slot it could have touched is dropped.
+        std::atomic_thread_fence(std::memory_order_acquire);
+        uint64_t begun = ring.begun.load(std::memory_order_relaxed);
+        if (begun > first + RING_CAPACITY) {
+            size_t overwritten = std::min<uint64_t>(begun - RING_CAPACITY - first, snapshots[r].size());
+            snapshots[r].erase(snapshots[r].begin(), snapshots[r].begin() + overwritten);
+        }
+        for (const ProfileEvent &event : snapshots[r]) origin = std::min(origin, event.startNs);
+    }
+
+    std::fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    bool first = true;
+    for (size_t r = 0; r < snapshots.size(); r++) {
+        std::fprintf(file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":%zu,\"args\":{\"name\":\"Thread %zu\"}}",
+                     first ? "" : ",\n", r, r);
+        first = false;
+        for (const ProfileEvent &event : snapshots[r]) {
+            std::fprintf(file, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":0,\"tid\":%zu,\"ts\":%.3f,\"dur\":%.3f}",
+                         event.name, r, (event.startNs - origin) / 1e3, (event.endNs - event.startNs) / 1e3);
+        }
+    }
+    std::fprintf(file, "\n]}\n");
+    return std::fclose(file) == 0;
+}
+
+void clear()
+{
+    std::lock_guard<std::mutex> lock(g_ringsMutex);
+    for (std::unique_ptr<ThreadRing> &ring : g_rings) {
+        ring->clearedAt.store(ring->head.load(std::memory_order_acquire), std::memory_order_relaxed);
+    }
+}
+
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+// Scoped timing zones that are recorded per thread and dumped as a Chrome/Perfetto trace.
+//
+//     void Simulation::update(double seconds)
+//     {
+//         PROFILE_SCOPE("Simulation::update");
+//         ...
+//     }
+//
+// Zones are named after the function they time, as Class::method (or just the name of a free function); a zone
+// around part of a function appends the part, as Class::method/part. Zone names must be string literals (only
+// the pointer is stored). Each thread appends to its own
+// fixed-size ring without locking; once a ring is full the oldest events are overwritten. A trace can be
+// written while threads are still recording: a sequence counter per ring tells the writer which events were
+// overwritten while it copied them, and those are left out. While recording is off a zone costs one relaxed
+// atomic load. Building with PROFILING_ENABLED=0 removes zones entirely.
+
+#ifndef PROFILING_ENABLED
+#define PROFILING_ENABLED 1
+#endif
+
+namespace Profiler {
+
+extern std::atomic<bool> g_recording;
+
+inline bool isRecording() { return g_recording.load(std::memory_order_relaxed); }
+void setRecording(bool recording);
+
+// Nanoseconds on a monotonic clock
+inline uint64_t now()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Appends a completed zone to the calling thread's ring
+void record(const char *name, uint64_t startNs, uint64_t endNs);
+
+// Writes every thread's recorded events as Chrome trace JSON (chrome://tracing or ui.perfetto.dev)
+bool writeChromeTrace(const std::string &path);
+
+// Drops all recorded events
+void clear();
+
+}
+
+class ProfileScope
+{
+public:
+    explicit ProfileScope(const char *name)
+        : m_name(Profiler::isRecording() ? name : nullptr),
+          m_start(m_name != nullptr ? Profiler::now() : 0)
+    {
+    }
+
+    ~ProfileScope()
+    {
+        if (m_name != nullptr) Profiler::record(m_name, m_start, Profiler::now());
+    }
+
+    ProfileScope(const ProfileScope &)            = delete;
+    ProfileScope &operator=(const ProfileScope &) = delete;
+
+private:
+    const char *m_name;
+    uint64_t    m_start;
+};
+
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b)       PROFILE_CONCAT_INNER(a, b)
+
+#if PROFILING_ENABLED
+#define PROFILE_SCOPE(name) ProfileScope PROFILE_CONCAT(profileScope_, __LINE__)(name)
+#else
+#define PROFILE_SCOPE(name) ((void)0)
+#endif
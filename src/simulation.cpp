@@ -1,57 +1,155 @@
 #include "simulation.h"
+#include "fem/ensemble.h"
+#include "fem/surface.h"
+#include "graphics/meshgenerator.h"
 #include "graphics/meshloader.h"
+#include "graphics/shader.h"
+#include "io/animationcache.h"
+#include "io/checkpoint.h"
+#include "profiling/profiler.h"
 
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
 #include <iostream>
+#include <map>
+#include <sstream>
 
 using namespace Eigen;
 
-Simulation::Simulation() {}
-
-void Simulation::init()
-{
-    // STUDENTS: This code loads up the tetrahedral mesh in 'example-meshes/single-tet.mesh'
-    //    (note: your working directory must be set to the root directory of the starter code
-    //    repo for this file to load correctly). You'll probably want to instead have this code
-    //    load up a tet mesh based on e.g. a file path specified with a command line argument.
-    std::vector<Vector3d> vertices;
-    std::vector<Vector4i> tets;
-    if (MeshLoader::loadTetMesh(":/example-meshes/single-tet.mesh", vertices, tets)) {
-        // STUDENTS: This code computes the surface mesh of the loaded tet mesh, i.e. the faces
-        //    of tetrahedra which are on the exterior surface of the object. Right now, this is
-        //    hard-coded for the single-tet mesh. You'll need to implement surface mesh extraction
-        //    for arbitrary tet meshes. Think about how you can identify which tetrahedron faces
-        //    are surface faces...
-        std::vector<Vector3i> faces;
-        faces.emplace_back(1, 0, 2);
-        faces.emplace_back(2, 0, 3);
-        faces.emplace_back(3, 1, 2);
-        faces.emplace_back(3, 0, 1);
-        m_shape.init(vertices, faces, tets);
+Simulation::Simulation()
+    : m_graphics(false),
+      m_timestep(1e-3),
+      m_dropScene(false),
+      m_instanced(false),
+      m_shapeReady(false),
+      m_bodyRendererReady(false),
+      m_bodyRendererBodies(0),
+      m_lodEnabled(true),
+      m_view(Matrix4f::Identity()),
+      m_projection(Matrix4f::Identity()),
+      m_viewportHeight(0),
+      m_drawnTriangles(0),
+      m_renderMeshUploadBytes(0),
+      m_time(0),
+      m_accumulator(0),
+      m_verticesDirty(false),
+      m_steps(0),
+      m_timing(false),
+      m_stepSeconds(0)
+{
+}
+
+bool Simulation::init(const SceneDescription &description, bool graphics)
+{
+    m_description = description;
+    m_graphics    = graphics;
+    m_timestep    = description.timestep;
+
+    FemSolver::setThreadCount(description.threads);
+    if (m_graphics) initGround();
+    initColliders();
+    configureSolver(m_solver);
+
+    if (!loadMeshes()) return false;
+    buildScene(false);
+
+    if (!description.outputPath.empty() && !startOutput(m_exporter, description.outputPath, description.outputFormat)) {
+        return false;
     }
-    m_shape.setModelMatrix(Affine3f(Eigen::Translation3f(0, 2, 0)));
+    return true;
+}
+
+void Simulation::configureSolver(FemSolver &solver) const
+{
+    solver.setIntegrator(m_description.integrator);
+    solver.setReduction(m_description.reduction);
+    solver.setGravity(m_description.gravity);
+    solver.setGroundHeight(m_description.groundHeight);
+    solver.setSphereColliders(m_description.spheres);
+    solver.setContinuousCollision(m_description.continuousCollision);
+    solver.setSelfCollision(m_description.selfCollision);
 
-    initGround();
+    std::vector<const SignedDistanceField *> sdfs;
+    for (const std::unique_ptr<SignedDistanceField> &sdf : m_colliders) sdfs.push_back(sdf.get());
+    solver.setSdfColliders(sdfs);
 }
 
 void Simulation::update(double seconds)
 {
-    // STUDENTS: This method should contain all the time-stepping logic for your simulation.
-    //   Specifically, the code you write here should compute new, updated vertex positions for your
-    //   simulation mesh, and it should then call m_shape.setVertices to update the display with those
-    //   newly-updated vertices.
-
-    // STUDENTS: As currently written, the program will just continually compute simulation timesteps as long
-    //    as the program is running (see View::tick in view.cpp) . You might want to e.g. add a hotkey for pausing
-    //    the simulation, and perhaps start the simulation out in a paused state.
+    PROFILE_SCOPE("Simulation::update");
 
     // Note that the "seconds" parameter represents the amount of time that has passed since
-    // the last update
+    // the last update. It is simulated in fixed steps; if we fall too far behind, the rest is dropped
+    // rather than letting the backlog grow.
+    m_accumulator += seconds;
+    if (m_vertices.empty()) return;
+    std::chrono::steady_clock::time_point start;
+    if (m_timing) start = std::chrono::steady_clock::now();
+    int steps = 0;
+    while (m_accumulator >= m_timestep && steps < MAX_STEPS_PER_UPDATE) {
+        m_solver.step(m_vertices, m_velocities, m_timestep);
+        m_accumulator -= m_timestep;
+        m_time += m_timestep;
+        steps++;
+    }
+    m_steps += steps;
+    if (m_timing) m_stepSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    if (steps == MAX_STEPS_PER_UPDATE) {
+        m_accumulator = std::min(m_accumulator, m_timestep);
+    }
+    if (steps == 0) return;
+
+    // The GL context isn't necessarily current here, so the upload happens in draw()
+    m_verticesDirty = true;
+
+    // Only takes a snapshot here; the exporters' own threads do the writing
+    if (m_exporter.isRunning()) {
+        m_exporter.submit(m_vertices, m_time);
+    }
+    if (m_cacheExporter.isRunning()) {
+        m_cacheExporter.submit(m_vertices, m_time);
+    }
 }
 
 void Simulation::draw(Shader *shader)
 {
-    m_shape.draw(shader);
+    PROFILE_SCOPE("Simulation::draw");
+
+    if (!m_instanced && m_shapeReady) {
+        if (m_verticesDirty) {
+            m_shape.setVertices(m_vertices);
+            for (RenderMesh &mesh : m_renderMeshes) {
+                mesh.embedding.update(m_vertices, mesh.vertices);
+                mesh.shape->setVertices(mesh.vertices);
+            }
+            for (int b = 0; b < m_scene.getBodyCount(); b++) {
+                const Scene::Body &body = m_scene.getBody(b);
+                m_bodyBounds[b].setEmpty();
+                for (int v = body.vertexStart; v < body.vertexStart + body.vertexCount; v++) {
+                    m_bodyBounds[b].extend(m_vertices[v]);
+                }
+            }
+            m_verticesDirty = false;
+        }
+        selectLods();
+        m_shape.draw(shader);
+        for (const RenderMesh &mesh : m_renderMeshes) {
+            mesh.shape->draw(shader);
+            m_drawnTriangles += mesh.triangleCount;
+        }
+    } else {
+        m_drawnTriangles = m_instanced ? m_faces.size() : 0;
+    }
     m_ground.draw(shader);
+    for (const std::unique_ptr<Shape> &collider : m_colliderShapes) {
+        collider->draw(shader);
+    }
+    if (m_instanced) {
+        drawBodies(shader);
+    }
 }
 
 void Simulation::toggleWire()
@@ -59,15 +157,670 @@ void Simulation::toggleWire()
     m_shape.toggleWireframe();
 }
 
+void Simulation::setView(const Eigen::Matrix4f &view, const Eigen::Matrix4f &projection, int viewportHeight)
+{
+    m_view           = view;
+    m_projection     = projection;
+    m_viewportHeight = viewportHeight;
+}
+
+void Simulation::toggleLod()
+{
+    m_lodEnabled = !m_lodEnabled;
+    std::cout << "Surface level of detail " << (m_lodEnabled ? "on" : "off") << std::endl;
+}
+
+AlignedBox3d Simulation::getBounds() const
+{
+    AlignedBox3d bounds;
+    for (const Vector3d &v : m_vertices) bounds.extend(v);
+    return bounds;
+}
+
+void Simulation::toggleExport()
+{
+    if (m_exporter.isRunning()) {
+        stopOutput();
+    } else {
+        startOutput(m_exporter, "export", MeshExporter::Format::OBJ);
+    }
+}
+
+void Simulation::stopOutput()
+{
+    if (!m_exporter.isRunning()) return;
+    m_exporter.stop();
+    MeshExporter::Stats stats = m_exporter.getStats();
+    std::cout << "Exported " << stats.framesWritten << " frames (" << stats.framesDropped << " dropped), "
+              << stats.bytesWritten / 1e6 << " MB at " << stats.getBandwidth() / 1e6 << " MB/s, "
+              << "max queue depth " << stats.maxQueueDepth << ", "
+              << 1e6 * stats.getSnapshotSeconds() << " us per snapshot" << std::endl;
+}
+
+bool Simulation::startOutput(MeshExporter &exporter, const std::string &path, MeshExporter::Format format)
+{
+    // OBJ and PLY write a directory of frames; the other formats a single file
+    bool perFrame = format == MeshExporter::Format::OBJ || format == MeshExporter::Format::PLY;
+    std::filesystem::path directory = perFrame ? std::filesystem::path(path) : std::filesystem::path(path).parent_path();
+    if (!directory.empty()) std::filesystem::create_directories(directory);
+
+    bool started = format == MeshExporter::Format::Cache
+                 ? exporter.start(path, format, m_tets, m_faces, m_vertices.size())
+                 : exporter.start(path, format, m_faces, m_vertices.size());
+    if (started) {
+        std::cout << "Exporting to " << path << std::endl;
+    }
+    return started;
+}
+
+void Simulation::toggleCache()
+{
+    const char *path = "export/simulation.femcache";
+    if (!m_cacheExporter.isRunning()) {
+        startOutput(m_cacheExporter, path, MeshExporter::Format::Cache);
+        return;
+    }
+
+    m_cacheExporter.stop();
+    MeshExporter::Stats stats = m_cacheExporter.getStats();
+
+    // Compare against dumping double positions every frame
+    double rawBytes = static_cast<double>(stats.framesWritten) * m_vertices.size() * 3 * sizeof(double);
+    std::cout << "Cached " << stats.framesWritten << " frames in " << stats.bytesWritten / 1e6 << " MB, "
+              << rawBytes / std::max<double>(stats.bytesWritten, 1) << "x smaller than raw doubles, encoded at "
+              << rawBytes / std::max(stats.writeSeconds, 1e-9) / 1e6 << " MB/s" << std::endl;
+
+    AnimationCacheReader reader;
+    if (!reader.open(path)) return;
+    std::vector<Vector3d> positions;
+    auto start = std::chrono::steady_clock::now();
+    for (int f = 0; f < reader.getFrameCount(); f++) {
+        reader.readFrame(f, positions);
+    }
+    double sequential = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    // Scrubbing backwards defeats the sequential fast path, so every read restarts at a keyframe
+    start = std::chrono::steady_clock::now();
+    for (int f = reader.getFrameCount() - 1; f >= 0; f--) {
+        reader.readFrame(f, positions);
+    }
+    double scrubbing = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::cout << "Decoded at " << rawBytes / std::max(sequential, 1e-9) / 1e6 << " MB/s sequentially, "
+              << 1e3 * scrubbing / std::max(reader.getFrameCount(), 1) << " ms per frame scrubbing backwards"
+              << std::endl;
+}
+
+void Simulation::toggleReduction()
+{
+    bool deterministic = m_solver.getReduction() == FemSolver::Reduction::Deterministic;
+    int evaluations = m_solver.getForceEvaluations();
+    std::cout << (deterministic ? "Deterministic" : "Atomic") << " reduction: "
+              << 1e3 * m_solver.getForceSeconds() / std::max(evaluations, 1) << " ms per force evaluation over "
+              << evaluations << " evaluations" << std::endl;
+
+    m_solver.setReduction(deterministic ? FemSolver::Reduction::Atomic : FemSolver::Reduction::Deterministic);
+    m_solver.resetTimings();
+    std::cout << "Switched to " << (deterministic ? "atomic" : "deterministic") << " reduction" << std::endl;
+}
+
+void Simulation::toggleContinuousCollision()
+{
+    bool enabled = !m_solver.getContinuousCollision();
+    if (!enabled) {
+        std::cout << "Continuous collision resolved " << m_solver.getCcdImpacts() << " impacts, taking "
+                  << 1e3 * m_solver.getCcdSeconds() << " ms in total" << std::endl;
+    }
+    m_solver.setContinuousCollision(enabled);
+    m_solver.resetCollisionTimings();
+    std::cout << "Continuous collision " << (enabled ? "on" : "off") << std::endl;
+}
+
+void Simulation::toggleSelfCollision()
+{
+    bool enabled = !m_solver.getSelfCollision();
+    if (!enabled) {
+        const SelfCollision::Timings &timings = m_solver.getSelfCollisionTimings();
+        std::cout << "Self collision over " << timings.evaluations << " evaluations: bvh "
+                  << 1e3 * timings.bvhSeconds << " ms (" << timings.rebuilds << " rebuilds), broadphase "
+                  << 1e3 * timings.broadphaseSeconds << " ms (" << timings.candidates << " candidates), narrowphase "
+                  << 1e3 * timings.narrowphaseSeconds << " ms (" << timings.contacts << " contacts), response "
+                  << 1e3 * timings.responseSeconds << " ms, crossings " << 1e3 * timings.crossingSeconds << " ms ("
+                  << timings.crossings << " vertices and " << timings.edgeCrossings << " edges put back)" << std::endl;
+    }
+    m_solver.setSelfCollision(enabled);
+    m_solver.resetCollisionTimings();
+    std::cout << "Self collision " << (enabled ? "on" : "off") << std::endl;
+}
+
+void Simulation::toggleDropScene()
+{
+    // The exporters were started for the current vertex count and surface
+    if (m_exporter.isRunning() || m_cacheExporter.isRunning()) {
+        std::cerr << "Stop exporting before switching scenes" << std::endl;
+        return;
+    }
+    if (m_meshes.empty() || m_meshes[0].tets.empty()) return;
+    buildScene(!m_dropScene);
+    std::cout << "Simulating " << m_scene.getBodyCount() << (m_scene.getBodyCount() == 1 ? " body, " : " bodies, ")
+              << m_tets.size() << " tets" << std::endl;
+}
+
+void Simulation::setTiming(bool enabled)
+{
+    m_timing = enabled;
+    m_solver.setThreadTiming(enabled);
+}
+
+Simulation::Stats Simulation::getStats() const
+{
+    Stats stats;
+    stats.steps       = m_steps;
+    stats.stepSeconds = m_stepSeconds;
+    stats.uploadBytes = m_shape.getUploadBytes() + m_bodyRenderer.getUploadBytes() + m_renderMeshUploadBytes;
+    for (const RenderMesh &mesh : m_renderMeshes) {
+        stats.uploadBytes += mesh.shape->getUploadBytes();
+    }
+    stats.threadBusySeconds      = m_solver.getThreadBusySeconds();
+    stats.threadAvailableSeconds = m_solver.getThreadAvailableSeconds();
+    if (m_instanced && m_bodyRendererReady) {
+        stats.drawCalls = m_bodyRenderer.getDrawCalls();
+        stats.submitMs  = m_bodyRenderer.getSubmitTime();
+    }
+    return stats;
+}
+
+// ================== Checkpoints
+
+bool Simulation::saveCheckpoint(const std::string &path)
+{
+    auto start = std::chrono::steady_clock::now();
+
+    uint32_t counts[2] = {static_cast<uint32_t>(m_vertices.size()), static_cast<uint32_t>(m_tets.size())};
+    uint32_t modes[2]  = {m_solver.getContinuousCollision(), m_solver.getSelfCollision()};
+    uint32_t drop      = m_dropScene;
+    std::vector<Material> materials(m_scene.getBodyCount());
+    for (int b = 0; b < m_scene.getBodyCount(); b++) materials[b] = m_scene.getBody(b).material;
+
+    CheckpointWriter writer;
+    if (!writer.open(path, CHECKPOINT_VERSION)) return false;
+    writer.write(checkpointTag("MESH"), counts);
+    writer.write(checkpointTag("DROP"), drop);
+    writer.write(checkpointTag("MATL"), materials);
+    writer.write(checkpointTag("TIME"), m_time);
+    writer.write(checkpointTag("ACCM"), m_accumulator);
+    writer.write(checkpointTag("STEP"), m_timestep);
+    writer.write(checkpointTag("INTG"), static_cast<uint32_t>(m_solver.getIntegrator()));
+    writer.write(checkpointTag("RDCT"), static_cast<uint32_t>(m_solver.getReduction()));
+    writer.write(checkpointTag("MODE"), modes);
+    writer.write(checkpointTag("POSN"), m_vertices);
+    writer.write(checkpointTag("VELO"), m_velocities);
+    uint64_t bytes = writer.getBytesWritten();
+    if (!writer.close()) {
+        std::cerr << "Failed to write checkpoint " << path << std::endl;
+        return false;
+    }
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "Saved checkpoint " << path << " at t = " << m_time << ": " << bytes / 1e6 << " MB in "
+              << 1e3 * seconds << " ms (" << bytes / std::max(seconds, 1e-9) / 1e6 << " MB/s)" << std::endl;
+    return true;
+}
+
+bool Simulation::loadCheckpoint(const std::string &path)
+{
+    auto start = std::chrono::steady_clock::now();
+
+    CheckpointReader reader;
+    if (!reader.open(path)) return false;
+    if (reader.getVersion() != CHECKPOINT_VERSION) {
+        std::cerr << path << " has checkpoint version " << reader.getVersion()
+                  << ", expected " << CHECKPOINT_VERSION << std::endl;
+        return false;
+    }
+
+    // Read into temporaries so a bad file leaves the running simulation untouched
+    uint32_t counts[2], drop;
+    std::vector<Material> materials;
+    if (!reader.read(checkpointTag("MESH"), counts) ||
+        !reader.read(checkpointTag("DROP"), drop) ||
+        !reader.read(checkpointTag("MATL"), materials)) {
+        return false;
+    }
+
+    // Checked against the scene it was saved from, which needn't be the one running
+    if (drop && (m_meshes.empty() || m_meshes[0].tets.empty())) {
+        std::cerr << path << " was saved from the drop scene, which has no mesh here" << std::endl;
+        return false;
+    }
+    const size_t numBodies = drop ? DROP_BODIES : m_bodyMeshes.size();
+    size_t numVertices = 0, numTets = 0;
+    for (size_t b = 0; b < numBodies; b++) {
+        const TetMesh &mesh = m_meshes[drop ? 0 : m_bodyMeshes[b]];
+        numVertices += mesh.vertices.size();
+        numTets     += mesh.tets.size();
+    }
+    if (counts[0] != numVertices || counts[1] != numTets || materials.size() != numBodies) {
+        std::cerr << path << " was saved from a different scene (" << materials.size() << " bodies, "
+                  << counts[0] << " vertices, " << counts[1] << " tets)" << std::endl;
+        return false;
+    }
+    if (static_cast<bool>(drop) != m_dropScene && (m_exporter.isRunning() || m_cacheExporter.isRunning())) {
+        std::cerr << "Stop exporting before loading a checkpoint of the other scene" << std::endl;
+        return false;
+    }
+
+    double time, accumulator, timestep;
+    uint32_t integrator, reduction, modes[2];
+    std::vector<Vector3d> vertices, velocities;
+    if (!reader.read(checkpointTag("TIME"), time) ||
+        !reader.read(checkpointTag("ACCM"), accumulator) ||
+        !reader.read(checkpointTag("STEP"), timestep) ||
+        !reader.read(checkpointTag("INTG"), integrator) ||
+        !reader.read(checkpointTag("RDCT"), reduction) ||
+        !reader.read(checkpointTag("MODE"), modes) ||
+        !reader.read(checkpointTag("POSN"), vertices) ||
+        !reader.read(checkpointTag("VELO"), velocities)) {
+        return false;
+    }
+    uint64_t bytes = reader.getBytesRead();
+
+    // Re-initialising also drops the contact BVH, which is set up again from the rest shape
+    if (static_cast<bool>(drop) != m_dropScene) buildScene(drop);
+    m_solver.init(m_solver.getMesh(), materials);
+    m_time        = time;
+    m_accumulator = accumulator;
+    m_timestep    = timestep;
+    m_solver.setIntegrator(static_cast<FemSolver::Integrator>(integrator));
+    m_solver.setReduction(static_cast<FemSolver::Reduction>(reduction));
+    m_solver.setContinuousCollision(modes[0] != 0);
+    m_solver.setSelfCollision(modes[1] != 0);
+    m_vertices    = std::move(vertices);
+    m_velocities  = std::move(velocities);
+    m_verticesDirty = true;
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "Loaded checkpoint " << path << " at t = " << m_time << ": " << bytes / 1e6 << " MB in "
+              << 1e3 * seconds << " ms (" << bytes / std::max(seconds, 1e-9) / 1e6 << " MB/s)" << std::endl;
+    return true;
+}
+
+// ================== Scenes
+
+bool Simulation::loadMeshes()
+{
+    PROFILE_SCOPE("Simulation::loadMeshes");
+
+    // Bodies that name the same file share one copy of it
+    std::map<std::string, int> loaded;
+    m_meshes.clear();
+    m_bodyMeshes.clear();
+    for (const SceneDescription::Body &body : m_description.bodies) {
+        auto found = loaded.find(body.mesh);
+        if (found == loaded.end()) {
+            TetMesh mesh;
+            if (!MeshLoader::loadTetMesh(body.mesh, mesh.vertices, mesh.tets)) {
+                m_meshes.clear();
+                m_bodyMeshes.clear();
+                return false;
+            }
+            found = loaded.emplace(body.mesh, m_meshes.size()).first;
+            m_meshes.push_back(std::move(mesh));
+        }
+        m_bodyMeshes.push_back(found->second);
+    }
+    return true;
+}
+
+void Simulation::buildScene(bool drop)
+{
+    PROFILE_SCOPE("Simulation::buildScene");
+
+    m_scene.clear();
+    if (!drop) {
+        for (size_t b = 0; b < m_description.bodies.size(); b++) {
+            const SceneDescription::Body &body = m_description.bodies[b];
+            const TetMesh &mesh = m_meshes[m_bodyMeshes[b]];
+            m_scene.addBody(mesh.vertices, mesh.tets, body.material, body.transform);
+        }
+    } else {
+        // Spaced so that bodies start apart whichever way they are turned, each layer a little higher than the
+        // one below and turned to break the symmetry
+        const TetMesh &mesh = m_meshes[0];
+        const Material &material = m_description.bodies[0].material;
+        AlignedBox3d bounds;
+        for (const Vector3d &v : mesh.vertices) bounds.extend(v);
+        const double spacing = 1.2 * bounds.diagonal().norm();
+        for (int b = 0; b < DROP_BODIES; b++) {
+            int i = b % DROP_GRID, k = (b / DROP_GRID) % DROP_GRID, layer = b / (DROP_GRID * DROP_GRID);
+            Vector3d position((i - 0.5 * (DROP_GRID - 1)) * spacing,
+                              m_description.groundHeight + 0.5 + (layer + 0.5) * spacing,
+                              (k - 0.5 * (DROP_GRID - 1)) * spacing);
+            Affine3d transform = Translation3d(position) * AngleAxisd(0.7 * b, Vector3d(1, 1, 0).normalized()) *
+                                 Translation3d(-bounds.center());
+            m_scene.addBody(mesh.vertices, mesh.tets, material, transform);
+        }
+    }
+    m_dropScene = drop;
+    m_instanced = m_scene.getBodyCount() > 1 && m_scene.sharesTopology() && (drop || !hasRenderMeshes());
+
+    m_vertices = m_scene.getRestPositions();
+    m_tets     = m_scene.getTets();
+    m_faces    = m_scene.getFaces();
+    m_velocities.assign(m_vertices.size(), Vector3d::Zero());
+    m_solver.init(m_scene);
+    m_verticesDirty = true;
+
+    if (m_graphics && !m_instanced && !m_shapeReady) {
+        m_shape.setGpuNormals(true);
+        m_shape.init(m_vertices, m_faces, m_tets);
+        m_shapeReady = true;
+        initRenderMeshes();
+        buildLods();
+    }
+}
+
+bool Simulation::hasRenderMeshes() const
+{
+    return std::any_of(m_description.bodies.begin(), m_description.bodies.end(),
+                       [](const SceneDescription::Body &body) { return !body.renderMesh.empty(); });
+}
+
+// A render mesh that fails to load or to embed leaves its body drawing its tet surface
+void Simulation::initRenderMeshes()
+{
+    // Keeps the upload total from going backwards when the old meshes go
+    for (const RenderMesh &mesh : m_renderMeshes) {
+        m_renderMeshUploadBytes += mesh.shape->getUploadBytes();
+    }
+    m_renderMeshes.clear();
+    m_bodyHasRenderMesh.assign(m_scene.getBodyCount(), false);
+    for (int b = 0; b < m_scene.getBodyCount(); b++) {
+        const SceneDescription::Body &description = m_description.bodies[b];
+        if (description.renderMesh.empty()) continue;
+
+        auto start = std::chrono::steady_clock::now();
+        RenderMesh mesh;
+        std::vector<Vector3i> faces;
+        if (!MeshLoader::loadTriangleMesh(description.renderMesh, mesh.vertices, faces) || faces.empty()) {
+            std::cerr << "Drawing the tet surface of body " << b << " instead" << std::endl;
+            continue;
+        }
+        for (Vector3d &v : mesh.vertices) v = description.transform * v;
+
+        const Scene::Body &body = m_scene.getBody(b);
+        std::vector<Vector4i> tets(m_tets.begin() + body.tetStart, m_tets.begin() + body.tetStart + body.tetCount);
+        if (!mesh.embedding.bind(m_vertices, tets, mesh.vertices)) {
+            std::cerr << "Drawing the tet surface of body " << b << " instead" << std::endl;
+            continue;
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        std::cout << "Embedded " << description.renderMesh << " (" << mesh.vertices.size() << " vertices, "
+                  << faces.size() << " triangles) in " << body.tetCount << " tets in " << seconds << " s; "
+                  << mesh.embedding.getOutsideCount() << " vertices lie outside them, by up to "
+                  << mesh.embedding.getMaxOutsideDistance() << std::endl;
+
+        mesh.triangleCount = faces.size();
+        mesh.shape         = std::make_unique<Shape>();
+        mesh.shape->setGpuNormals(true);
+        mesh.shape->init(mesh.vertices, faces);
+        m_renderMeshes.push_back(std::move(mesh));
+        m_bodyHasRenderMesh[b] = true;
+    }
+}
+
+// ================== Surface Level of Detail
+
+void Simulation::buildLods()
+{
+    auto start = std::chrono::steady_clock::now();
+    const int numBodies = m_scene.getBodyCount();
+    m_bodyLods.assign(numBodies, SurfaceLod());
+    m_lodFirstTriangles.assign(numBodies, {});
+    m_bodyBounds.assign(numBodies, AlignedBox3d());
+
+    // Simplified from the rest shape, which m_vertices still is
+    size_t extraTriangles = 0;
+    for (int b = 0; b < numBodies; b++) {
+        if (m_bodyHasRenderMesh[b]) continue;
+        const Scene::Body &body = m_scene.getBody(b);
+        std::vector<Vector3i> faces(m_faces.begin() + body.faceStart, m_faces.begin() + body.faceStart + body.faceCount);
+        m_bodyLods[b].build(m_vertices, faces);
+        for (int level = 1; level < m_bodyLods[b].getLevelCount(); level++) {
+            m_lodFirstTriangles[b].push_back(m_shape.addTriangles(m_bodyLods[b].getFaces(level)));
+            extraTriangles += m_bodyLods[b].getFaces(level).size();
+        }
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "Built surface levels of detail in " << seconds << " s: " << m_faces.size() << " triangles, "
+              << extraTriangles << " more in simplified levels" << std::endl;
+}
+
+// Each body gets the coarsest level with enough triangles for the height its bounding sphere covers on screen.
+// Bodies reaching behind the near side of the camera get their full surface, and bodies with a render mesh
+// none of it.
+void Simulation::selectLods()
+{
+    const bool lod = m_lodEnabled && m_viewportHeight > 0;
+    if (!lod && m_renderMeshes.empty()) {
+        m_shape.setDrawRanges({});
+        m_drawnTriangles = m_faces.size();
+        return;
+    }
+
+    std::vector<Vector2i> ranges;
+    m_drawnTriangles = 0;
+    for (int b = 0; b < m_scene.getBodyCount(); b++) {
+        const Scene::Body &body = m_scene.getBody(b);
+        if (m_bodyHasRenderMesh[b]) {
+            ranges.emplace_back(body.faceStart, 0);
+            continue;
+        }
+        const double radius = 0.5 * m_bodyBounds[b].diagonal().norm();
+        const Vector4f center = m_view * m_bodyBounds[b].center().cast<float>().homogeneous();
+        const double depth = -center.z();
+
+        int level = 0;
+        if (lod && depth > radius) {
+            // The projection maps y / depth to [-1, 1] scaled by its (1, 1) entry
+            const double pixels = radius * m_projection(1, 1) * m_viewportHeight / depth;
+            level = m_bodyLods[b].selectLevel(pixels);
+        }
+        int count = m_bodyLods[b].getFaces(level).size();
+        ranges.emplace_back(level == 0 ? body.faceStart : m_lodFirstTriangles[b][level - 1], count);
+        m_drawnTriangles += count;
+    }
+    m_shape.setDrawRanges(ranges);
+}
+
+void Simulation::drawBodies(Shader *shader)
+{
+    // Every body is a copy of the first mesh, so the first body's surface serves for all of them, in the
+    // described scene and the drop scene alike
+    if (!m_bodyRendererReady) {
+        const Scene::Body &first = m_scene.getBody(0);
+        std::vector<Vector3i> faces(m_faces.begin() + first.faceStart, m_faces.begin() + first.faceStart + first.faceCount);
+        for (Vector3i &face : faces) face -= Vector3i::Constant(first.vertexStart);
+        const int maxBodies = std::max<int>(m_description.bodies.size(), DROP_BODIES);
+        m_bodyRenderer.init(faces, first.vertexCount, maxBodies);
+        for (int b = 0; b < maxBodies; b++) {
+            float hue = std::fmod(0.618034f * b, 1.0f);
+            m_bodyRenderer.setColor(b, Vector4f(0.5f + 0.5f * std::cos(6.2831853f * hue),
+                                                0.5f + 0.5f * std::cos(6.2831853f * (hue - 1.0f / 3)),
+                                                0.5f + 0.5f * std::cos(6.2831853f * (hue - 2.0f / 3)), 1));
+        }
+        m_instancedShader = std::make_unique<Shader>(":/resources/shaders/instanced.vert",
+                                                     ":/resources/shaders/instanced.frag");
+        m_instancedShader->bindUniformBlock("Camera", CAMERA_BINDING);
+        m_bodyRendererReady = true;
+    }
+
+    if (m_bodyRendererBodies != m_scene.getBodyCount()) {
+        m_bodyRenderer.setBodyCount(m_scene.getBodyCount());
+        m_bodyRendererBodies = m_scene.getBodyCount();
+        m_verticesDirty = true;
+    }
+    if (m_verticesDirty) {
+        m_bodyRenderer.beginUpdate();
+        for (int b = 0; b < m_scene.getBodyCount(); b++) {
+            m_bodyRenderer.setBodyVertices(b, m_vertices.data() + m_scene.getBody(b).vertexStart);
+        }
+        m_bodyRenderer.endUpdate();
+        m_verticesDirty = false;
+    }
+
+    shader->unbind();
+    m_instancedShader->bind();
+    m_bodyRenderer.draw(m_instancedShader.get());
+    m_instancedShader->unbind();
+    shader->bind();
+}
+
 void Simulation::initGround()
 {
+    const double y = m_description.groundHeight;
     std::vector<Vector3d> groundVerts;
     std::vector<Vector3i> groundFaces;
-    groundVerts.emplace_back(-5, 0, -5);
-    groundVerts.emplace_back(-5, 0, 5);
-    groundVerts.emplace_back(5, 0, 5);
-    groundVerts.emplace_back(5, 0, -5);
+    groundVerts.emplace_back(-5, y, -5);
+    groundVerts.emplace_back(-5, y, 5);
+    groundVerts.emplace_back(5, y, 5);
+    groundVerts.emplace_back(5, y, -5);
     groundFaces.emplace_back(0, 1, 2);
     groundFaces.emplace_back(0, 2, 3);
     m_ground.init(groundVerts, groundFaces);
 }
+
+void Simulation::initColliders()
+{
+    // Spheres are simulated analytically and only drawn as meshes
+    if (m_graphics) {
+        std::vector<Vector3d> sphereVertices;
+        std::vector<Vector4i> sphereTets;
+        std::vector<Vector3i> sphereFaces;
+        MeshGenerator::generateSphere(SPHERE_RESOLUTION, 1, sphereVertices, sphereTets);
+        extractSurface(sphereVertices, sphereTets, sphereFaces);
+        for (const SphereCollider &sphere : m_description.spheres) {
+            std::vector<Vector3d> vertices(sphereVertices.size());
+            for (size_t v = 0; v < vertices.size(); v++) vertices[v] = sphere.centre + sphere.radius * sphereVertices[v];
+            auto shape = std::make_unique<Shape>();
+            shape->init(vertices, sphereFaces);
+            m_colliderShapes.push_back(std::move(shape));
+        }
+    }
+
+    const std::string &directory = m_description.colliderDir;
+    if (directory.empty() || !std::filesystem::is_directory(directory)) return;
+
+    // Sorted, so that colliders are always applied in the same order
+    std::vector<std::filesystem::path> paths;
+    for (const auto &entry : std::filesystem::directory_iterator(directory)) {
+        if (entry.path().extension() == ".obj") paths.push_back(entry.path());
+    }
+    std::sort(paths.begin(), paths.end());
+
+    for (const std::filesystem::path &path : paths) {
+        std::vector<Vector3d> vertices;
+        std::vector<Vector3i> faces;
+        if (!MeshLoader::loadTriangleMesh(path.string(), vertices, faces) || faces.empty()) continue;
+
+        AlignedBox3d bounds;
+        for (const Vector3d &v : vertices) bounds.extend(v);
+        double voxelSize = bounds.sizes().maxCoeff() / SDF_RESOLUTION;
+        double bandWidth = SDF_BAND_VOXELS * voxelSize;
+        uint64_t key = SignedDistanceField::makeSourceKey(path.string(), voxelSize, bandWidth);
+        std::string cachePath = std::filesystem::path(path).replace_extension(".sdf").string();
+
+        auto sdf = std::make_unique<SignedDistanceField>();
+        auto start = std::chrono::steady_clock::now();
+        bool cached = sdf->load(cachePath, key);
+        if (!cached) {
+            sdf->build(vertices, faces, voxelSize, bandWidth);
+            sdf->save(cachePath, key);
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        const Vector3i &resolution = sdf->getResolution();
+        std::cout << (cached ? "Loaded " : "Built ") << resolution.x() << "x" << resolution.y() << "x" << resolution.z()
+                  << " distance field for " << path.string() << " (" << faces.size() << " triangles) in "
+                  << 1e3 * seconds << " ms" << std::endl;
+
+        if (m_graphics) {
+            auto shape = std::make_unique<Shape>();
+            shape->init(vertices, faces);
+            m_colliderShapes.push_back(std::move(shape));
+        }
+        m_colliders.push_back(std::move(sdf));
+    }
+}
+
+// ================== Ensembles
+
+bool Simulation::runSweep(int steps)
+{
+    const std::vector<std::vector<Material>> runs = m_description.sweep.expand(m_description.bodies);
+    if (m_vertices.empty() || runs.empty()) return false;
+
+    Ensemble ensemble;
+    ensemble.init(m_scene, runs);
+    for (int m = 0; m < ensemble.getMemberCount(); m++) {
+        configureSolver(ensemble.getSolver(m));
+    }
+    // Lockstep batches need nothing but gravity and the ground; anything else runs a member per thread
+    const Ensemble::Schedule schedule = ensemble.supportsLockstep() ? Ensemble::Schedule::Lockstep
+                                                                    : Ensemble::Schedule::Concurrent;
+    std::cout << "Running " << runs.size() << " members of " << m_tets.size() << " tets for " << steps << " steps, "
+              << (schedule == Ensemble::Schedule::Lockstep ? "in lockstep batches of " + std::to_string(Ensemble::LANES)
+                                                           : std::string("one per thread"))
+              << " on " << FemSolver::getThreadCount() << " threads" << std::endl;
+    ensemble.run(steps, m_timestep, schedule);
+
+    // Member-steps per second
+    auto throughput = [&]() {
+        long long total = 0;
+        for (int m = 0; m < ensemble.getMemberCount(); m++) total += ensemble.getResult(m).steps;
+        return total / std::max(ensemble.getSeconds(), 1e-9);
+    };
+    const double ensembleThroughput = throughput();
+
+    // Body 0's material stands for the run, since every body gets the same swept values
+    std::ostringstream table;
+    table << "run,youngsModulus,poissonRatio,viscosity,density,stable,steps,seconds,kineticEnergy,maxSpeed,"
+          << "centroidHeight,lowestPoint\n";
+    for (int m = 0; m < ensemble.getMemberCount(); m++) {
+        const Material &material = runs[m][0];
+        const Ensemble::Result &result = ensemble.getResult(m);
+        table << m << "," << material.youngsModulus << "," << material.poissonRatio << "," << material.viscosity
+              << "," << material.density << "," << (result.stable ? 1 : 0) << "," << result.steps << ","
+              << result.seconds << "," << result.kineticEnergy << "," << result.maxSpeed << ","
+              << result.centroidHeight << "," << result.lowestPoint << "\n";
+    }
+    std::cout << table.str();
+    std::cout << "Ensemble took " << ensemble.getSeconds() << " s, " << ensembleThroughput << " member-steps/s"
+              << std::endl;
+
+    if (m_description.sweep.compareSchedules) {
+        const std::pair<Ensemble::Schedule, const char *> others[] = {
+            {Ensemble::Schedule::Concurrent, "One per thread"},
+            {Ensemble::Schedule::Sequential, "One after another"},
+        };
+        for (const auto &[other, name] : others) {
+            if (other == schedule) continue;
+            ensemble.reset();
+            ensemble.run(steps, m_timestep, other);
+            double otherThroughput = throughput();
+            std::cout << name << " took " << ensemble.getSeconds() << " s, " << otherThroughput
+                      << " member-steps/s; the ensemble run was " << ensembleThroughput / otherThroughput
+                      << "x faster" << std::endl;
+        }
+    }
+
+    const std::string &path = m_description.sweep.resultsPath;
+    if (!path.empty()) {
+        std::ofstream file(path);
+        if (!(file << table.str())) {
+            std::cerr << "Failed to write " << path << std::endl;
+            return false;
+        }
+        std::cout << "Wrote " << path << std::endl;
+    }
+    return true;
+}
@@ -1,24 +1,194 @@
 #pragma once
 
+#include "graphics/multibodyrenderer.h"
 #include "graphics/shape.h"
+#include "graphics/surfacelod.h"
+#include "collision/signeddistancefield.h"
+#include "fem/embeddedmesh.h"
+#include "fem/femsolver.h"
+#include "fem/scene.h"
+#include "io/meshexporter.h"
+#include "io/scenefile.h"
+
+#include <memory>
+#include <string>
 
 class Shader;
 
 class Simulation
 {
 public:
+    // Running totals since init(); readers take differences between two snapshots. The step and thread times
+    // only advance while timing is on (see setTiming).
+    struct Stats {
+        uint64_t steps       = 0;
+        double   stepSeconds = 0;
+        uint64_t uploadBytes = 0;
+        double   threadBusySeconds      = 0; // See FemSolver::getThreadBusySeconds
+        double   threadAvailableSeconds = 0;
+        // Not totals: the last frame of the instanced renderer, which draws scenes of bodies that share one
+        // topology; zero for other scenes
+        int      drawCalls = 0;
+        double   submitMs  = 0; // CPU time spent issuing them
+    };
+
     Simulation();
 
-    void init();
+    // Sets up everything the description asks for. Without graphics nothing touches OpenGL, and draw() must
+    // not be called. Returns false if a mesh failed to load, leaving an empty scene.
+    bool init(const SceneDescription &description, bool graphics = true);
 
     void update(double seconds);
 
+    // Runs the description's material sweep as an Ensemble of the described scene for `steps` steps, then
+    // prints each run's metrics and writes them to the sweep's results file. Leaves this simulation as it was.
+    bool runSweep(int steps);
+
     void draw(Shader *shader);
 
     void toggleWire();
+
+    // The camera the next draw() is seen from, which picks each body's surface level of detail
+    void setView(const Eigen::Matrix4f &view, const Eigen::Matrix4f &projection, int viewportHeight);
+    // Switches between picking levels of detail and always drawing the full surfaces
+    void toggleLod();
+    void setLodEnabled(bool enabled) { m_lodEnabled = enabled; }
+    bool isLodEnabled() const { return m_lodEnabled; }
+
+    // Starts/stops streaming the surface to export/ every step
+    void toggleExport();
+    // Stops the export started by toggleExport() or by the scene's output settings, reporting what was written
+    void stopOutput();
+
+    // Starts/stops recording every vertex to export/simulation.femcache, then reports compression and
+    // encode/decode throughput. Independent of the export, which has its own exporter.
+    void toggleCache();
+
+    // Writes/restores the state, which of the two scenes is running, every body's material, the integrator and
+    // timestep, and the run-time collision and reduction modes. With deterministic reduction, a run resumed
+    // under the same scene file and build continues bit-identically from this point.
+    bool saveCheckpoint(const std::string &path);
+    bool loadCheckpoint(const std::string &path);
+
+    // Switches between deterministic and atomic force reduction, reporting the cost of the mode left
+    void toggleReduction();
+
+    // Turns continuous collision against the static obstacles on/off, reporting its cost when turned off
+    void toggleContinuousCollision();
+    void toggleSelfCollision();
+
+    // Switches between the described scene and DROP_BODIES copies of its first body falling onto each other
+    void toggleDropScene();
+
+    // Times every update's steps and the solver's threads, for a display of getStats(); off by default, so that
+    // runs nobody watches don't pay for the clock reads and atomics
+    void  setTiming(bool enabled);
+    Stats getStats() const;
+    int   getVertexCount() const { return m_vertices.size(); }
+    int   getTetCount()    const { return m_tets.size(); }
+    double getTime()       const { return m_time; }
+    // Surface triangles the last draw() drew, over every level of detail
+    int getDrawnTriangles() const { return m_drawnTriangles; }
+    // Current bounds of every body together
+    Eigen::AlignedBox3d getBounds() const;
 private:
+    static const uint32_t CHECKPOINT_VERSION = 5;
+
+    static const int MAX_STEPS_PER_UPDATE = 50;
+
+    // Every .obj in the scene's collider directory becomes a static collider, sampled into a distance field
+    // cached next to it as .sdf. Fields have SDF_RESOLUTION voxels along the mesh's longest side and an exact
+    // band SDF_BAND_VOXELS wide.
+    static const int SDF_RESOLUTION = 64;
+    static const int SDF_BAND_VOXELS = 4;
+
+    // Cubes across the diameter of the meshes drawn for sphere colliders
+    static const int SPHERE_RESOLUTION = 16;
+
+    // Bodies are stacked DROP_GRID x DROP_GRID per layer, as many layers as it takes
+    static const int DROP_BODIES = 100;
+    static const int DROP_GRID = 5;
+
+    SceneDescription m_description;
+    bool             m_graphics;
+    double           m_timestep; // Fixed, so that runs don't depend on the frame rate; checkpoints restore it
+
+    // Every distinct mesh file the description names, in its own frame, and the one each body uses
+    struct TetMesh {
+        std::vector<Eigen::Vector3d> vertices;
+        std::vector<Eigen::Vector4i> tets;
+    };
+    std::vector<TetMesh> m_meshes;
+    std::vector<int>     m_bodyMeshes;
+
+    // Scenes of copies of one mesh go through the instanced renderer; anything else is drawn as a whole with
+    // m_shape, which is only ever set up for the described scene since the drop scene is always copies
+    Scene m_scene;
+    bool  m_dropScene;
+    bool  m_instanced;
     Shape m_shape;
+    bool  m_shapeReady;
+    MultiBodyRenderer       m_bodyRenderer;
+    std::unique_ptr<Shader> m_instancedShader;
+    bool                    m_bodyRendererReady;
+    int                     m_bodyRendererBodies; // Bodies the renderer was last given vertices for
+    bool loadMeshes();
+    void buildScene(bool drop);
+
+    // Levels of detail of each body's surface in m_shape, whose index buffer holds every level; level l > 0 of
+    // body b starts at triangle m_lodFirstTriangles[b][l - 1]. The instanced renderer draws every body from one
+    // index range, so it always draws full surfaces.
+    std::vector<SurfaceLod>       m_bodyLods;
+    std::vector<std::vector<int>> m_lodFirstTriangles;
+    std::vector<Eigen::AlignedBox3d> m_bodyBounds; // Updated whenever m_shape's vertices are
+    bool            m_lodEnabled;
+    Eigen::Matrix4f m_view;
+    Eigen::Matrix4f m_projection;
+    int             m_viewportHeight;
+    int             m_drawnTriangles;
+    void buildLods();
+    void selectLods();
+
+    // Bodies with a render mesh draw it, carried along by their tets, instead of their tet surface. Only the
+    // described scene has them, and it stays off the instanced renderer when it does.
+    struct RenderMesh {
+        EmbeddedMesh                 embedding;
+        std::vector<Eigen::Vector3d> vertices;
+        int                          triangleCount;
+        std::unique_ptr<Shape>       shape;
+    };
+    std::vector<RenderMesh> m_renderMeshes;
+    uint64_t                m_renderMeshUploadBytes; // Uploaded by render meshes since replaced
+    std::vector<bool>       m_bodyHasRenderMesh;
+    bool hasRenderMeshes() const;
+    void initRenderMeshes();
+    void drawBodies(Shader *shader);
+
+    // Every body's state, packed as in m_scene
+    std::vector<Eigen::Vector3d> m_vertices;
+    std::vector<Eigen::Vector4i> m_tets;
+    std::vector<Eigen::Vector3i> m_faces;
+    std::vector<Eigen::Vector3d> m_velocities;
+    double m_time;
+    double m_accumulator; // Time passed to update() but not yet simulated
+    bool m_verticesDirty; // Positions changed outside of the GL context and need uploading in draw()
+
+    uint64_t m_steps;
+    bool     m_timing;
+    double   m_stepSeconds;
+
+    FemSolver m_solver;
+    // Applies the description's solver settings and colliders
+    void configureSolver(FemSolver &solver) const;
+
+    MeshExporter m_exporter;      // toggleExport() and the scene's output settings
+    MeshExporter m_cacheExporter; // toggleCache()
+    bool startOutput(MeshExporter &exporter, const std::string &path, MeshExporter::Format format);
 
     Shape m_ground;
     void initGround();
+
+    std::vector<std::unique_ptr<SignedDistanceField>> m_colliders;
+    std::vector<std::unique_ptr<Shape>>               m_colliderShapes;
+    void initColliders();
 };